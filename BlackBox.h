@@ -0,0 +1,226 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "HAL.h"
+
+// BlackBox
+//
+// A flight recorder for the firmware.  The last BLACK_BOX_RECORDS things that happened
+// (switch changes, events coming and going, and how long the passes took) are kept
+// in a ring in RAM that a reset doesn't clear (HAL_NOINIT).  With the watchdog on, a
+// loop that hangs gets the board reset within HAL_WATCHDOG_MS, and the ring still
+// holds what led up to it, followed by a BOOT record saying why the board reset.
+// Only a power cycle loses it.
+//
+// Each record is four bytes: the low 16 bits of HAL_Millis(), a kind, and a value.
+// Recording one is a store and an index bump, cheap enough to do every pass.  Passes
+// in a row share one PASS record, which keeps the longest of them and the time of
+// the latest, so the ring isn't all passes: the record says when the loop was last
+// seen alive, and how slow it had been getting.
+//
+// At startup the firmware prints
+//
+//   BB reset <cause> <records>      cause is the RESET_ bits in hex
+//
+// and sending BLACK_BOX_DUMP_COMMAND over Serial dumps the ring, oldest first:
+//
+//   BB begin <records>
+//   BB <ms> <kind> <value>          all hex
+//   BB end
+//
+// A line goes out each pass, so the dump never holds up the loop, and recording
+// stops until it's done so that the ring holds still.  Host/BlackBoxDecode.cpp turns
+// a captured log into a readable timeline.
+//
+// Define BLACK_BOX to build it in, which also turns on the watchdog.  Without it the
+// calls below compile to nothing.
+
+#define BLACK_BOX_RECORDS      32					// Power of two
+#define BLACK_BOX_MAGIC        0xB10C
+#define BLACK_BOX_DUMP_COMMAND 'D'
+
+enum BLACK_BOX_KIND : uint8_t
+{
+	BB_BOOT = 1,										// value: the RESET_ bits
+	BB_INPUTS,											// value: the INPUT_ bits, at the top of a pass
+	BB_LATE_INPUTS,										// value: the INPUT_ bits, latched late (see composeFrame())
+	BB_LAYERS,											// value: a bit for each layer showing, in z-order
+	BB_PASS												// value: the longest pass since the last record, in 128us units, rounded up
+};
+
+#define BLACK_BOX_PASS_UNIT_US 128
+
+struct BlackBoxRecord
+{
+	uint16_t ms;
+	uint8_t  kind;
+	uint8_t  value;
+};
+
+#ifdef BLACK_BOX
+
+struct BlackBoxRing
+{
+	uint16_t       magic;								// BLACK_BOX_MAGIC when the rest is intact
+	uint8_t        head;								// Where the next record goes
+	uint8_t        cRecords;
+	BlackBoxRecord records[BLACK_BOX_RECORDS];
+};
+
+static_assert((BLACK_BOX_RECORDS & (BLACK_BOX_RECORDS - 1)) == 0 && BLACK_BOX_RECORDS <= 128, "BLACK_BOX_RECORDS must be a power of two that fits the indexes");
+
+static BlackBoxRing s_blackBox HAL_NOINIT;
+static uint8_t      s_blackBoxInputs;
+static uint8_t      s_blackBoxLayers;
+static uint8_t      s_blackBoxDumpLeft;				// Records still to send, while a dump is going
+static uint8_t      s_blackBoxDumpNext;
+static bool         s_blackBoxDumping;
+
+static inline void BlackBoxRecordNow(uint8_t kind, uint8_t value)
+{
+	if (s_blackBoxDumping)
+		return;
+
+	BlackBoxRecord & record = s_blackBox.records[s_blackBox.head];
+	record.ms    = (uint16_t) HAL_Millis();
+	record.kind  = kind;
+	record.value = value;
+	s_blackBox.head = (s_blackBox.head + 1) & (BLACK_BOX_RECORDS - 1);
+	if (s_blackBox.cRecords < BLACK_BOX_RECORDS)
+		s_blackBox.cRecords++;
+}
+
+// BlackBoxBegin
+//
+// Keeps the ring if it made it through the reset and starts a new one if not, records
+// the boot, and starts the watchdog.  Call last in setup, once the slow startup work
+// is done.
+
+static void BlackBoxBegin()
+{
+	uint8_t cause = HAL_ResetCause();
+
+	if ((cause & RESET_POWER_ON) || s_blackBox.magic != BLACK_BOX_MAGIC
+		|| s_blackBox.head >= BLACK_BOX_RECORDS || s_blackBox.cRecords > BLACK_BOX_RECORDS)
+	{
+		memset(&s_blackBox, 0, sizeof(s_blackBox));
+		s_blackBox.magic = BLACK_BOX_MAGIC;
+	}
+	s_blackBoxInputs   = 0xFF;
+	s_blackBoxLayers   = 0xFF;
+	s_blackBoxDumping  = false;
+
+	char szBuf[24];
+	snprintf(szBuf, sizeof(szBuf), "BB reset %x %u", (unsigned) cause, (unsigned) s_blackBox.cRecords);
+	HAL_SerialPrintln(szBuf);
+
+	BlackBoxRecordNow(BB_BOOT, cause);
+	HAL_WatchdogEnable();
+}
+
+static inline void BlackBoxInputs(uint8_t inputs)
+{
+	if (inputs != s_blackBoxInputs)
+	{
+		s_blackBoxInputs = inputs;
+		BlackBoxRecordNow(BB_INPUTS, inputs);
+	}
+}
+
+static inline void BlackBoxLateInputs(uint8_t inputs)
+{
+	s_blackBoxInputs = inputs;
+	BlackBoxRecordNow(BB_LATE_INPUTS, inputs);
+}
+
+static inline void BlackBoxLayers(uint8_t layers)
+{
+	if (layers != s_blackBoxLayers)
+	{
+		s_blackBoxLayers = layers;
+		BlackBoxRecordNow(BB_LAYERS, layers);
+	}
+}
+
+static void BlackBoxDump()
+{
+	if (s_blackBoxDumping)
+		return;
+
+	char szBuf[16];
+	snprintf(szBuf, sizeof(szBuf), "BB begin %u", (unsigned) s_blackBox.cRecords);
+	HAL_SerialPrintln(szBuf);
+
+	s_blackBoxDumping  = true;
+	s_blackBoxDumpLeft = s_blackBox.cRecords;
+	s_blackBoxDumpNext = (s_blackBox.head - s_blackBox.cRecords) & (BLACK_BOX_RECORDS - 1);
+}
+
+// BlackBoxPass
+//
+// Call at the end of every pass with how long it took.  Folds it into the PASS
+// record, resets the watchdog, and sends the next line of a dump if one is going.
+
+static void BlackBoxPass(uint32_t passUs)
+{
+	uint8_t units = (uint8_t) min((passUs + BLACK_BOX_PASS_UNIT_US - 1) / BLACK_BOX_PASS_UNIT_US, (uint32_t) 255);
+	uint8_t last  = (s_blackBox.head - 1) & (BLACK_BOX_RECORDS - 1);
+
+	if (!s_blackBoxDumping && s_blackBox.cRecords && s_blackBox.records[last].kind == BB_PASS)
+	{
+		s_blackBox.records[last].ms    = (uint16_t) HAL_Millis();
+		s_blackBox.records[last].value = max(s_blackBox.records[last].value, units);
+	}
+	else
+	{
+		BlackBoxRecordNow(BB_PASS, units);
+	}
+
+	HAL_WatchdogReset();
+
+	if (s_blackBoxDumping)
+	{
+		char szBuf[20];
+		if (s_blackBoxDumpLeft)
+		{
+			const BlackBoxRecord & record = s_blackBox.records[s_blackBoxDumpNext];
+			snprintf(szBuf, sizeof(szBuf), "BB %04x %x %02x", (unsigned) record.ms, (unsigned) record.kind, (unsigned) record.value);
+			s_blackBoxDumpNext = (s_blackBoxDumpNext + 1) & (BLACK_BOX_RECORDS - 1);
+			s_blackBoxDumpLeft--;
+		}
+		else
+		{
+			strcpy(szBuf, "BB end");
+			s_blackBoxDumping = false;
+		}
+		HAL_SerialPrintln(szBuf);
+	}
+}
+
+#else
+
+static inline void BlackBoxBegin()
+{
+}
+
+static inline void BlackBoxInputs(uint8_t)
+{
+}
+
+static inline void BlackBoxLateInputs(uint8_t)
+{
+}
+
+static inline void BlackBoxLayers(uint8_t)
+{
+}
+
+static inline void BlackBoxDump()
+{
+}
+
+static inline void BlackBoxPass(uint32_t)
+{
+}
+
+#endif
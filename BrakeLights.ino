@@ -16,57 +16,43 @@
 //
 //---------------------------------------------------------------------------
 
-#include <Adafruit_NeoPixel.h>
-#ifdef __AVR__
-#include <avr/power.h>
+// #define USE_FASTLED								// Build the FastLED backend (needs the FastLED library)
+// #define BENCHMARK_OUTPUTS						// Time each LED backend at startup and report over Serial
+// #define GOLDEN_FRAMES							// Print frame hashes of the demo drive and stop (Tools/golden_frames.sh)
+// #define BENCHMARK_EFFECTS						// Time each effect at this strip length and stop (Tools/scaling_bench.py)
+// #define RECORD_INPUT_TRACE						// Log every switch edge over Serial for Host/TraceReplay.cpp
+// #define BLACK_BOX								// Keep the last moments before a reset in RAM that survives it, under a watchdog (BlackBox.h)
+// #define PARTICLE_EFFECTS						// Sparkle off the strip when the brake lets go (Particles.h)
+
+#if defined(GOLDEN_FRAMES) || defined(BENCHMARK_EFFECTS)
+#define HAL_VIRTUAL_CLOCK
+#endif
+#ifdef BENCHMARK_EFFECTS
+#define COST_MODEL_UNCHECKED
 #endif
-#include <Wire.h>
-#include <LiquidCrystal_I2C.h>
-#include <assert.h>
-
-#define LCD_WIDTH 20
-#define LCD_HEIGHT 4
-
-LiquidCrystal_I2C lcd(0x27, LCD_WIDTH, LCD_HEIGHT);  // set the LCD address to 0x27 for a 16 chars and 2 line display
-
-#define PIN 6
-
-#define TOTAL_STRIP_PIXELS 144						// How many pixels in entire string
-#define NUMBER_USED_PIXELS 144						// The number of pixels that we use (normally, all of them)
-#define NUMBER_TURN_PIXELS 50						// How many pixels on the end will be use for turn signals
-
-#define LEFT_TURN_PIN  PIND3						// Digital input pins 
-#define RIGHT_TURN_PIN PIND2
-#define STOP_PIN       PIND4
-#define BACKUP_PIN     PIND5
-
-#define COLOR_BLACK    (Adafruit_NeoPixel::Color(  0,   0,   0))
-#define COLOR_WHITE    (Adafruit_NeoPixel::Color(255, 255, 255))
-#define COLOR_RED      (Adafruit_NeoPixel::Color(255,   0,   0))
-#define COLOR_DARK_RED (Adafruit_NeoPixel::Color( 64,   0,   0))
-#define COLOR_BLUE     (Adafruit_NeoPixel::Color(  0,   0, 255))
-#define COLOR_AMBER    (Adafruit_NeoPixel::Color(255,  48,   0))
-#define COLOR_GREEN    (Adafruit_NeoPixel::Color(  0, 255,   0))
-#define COLOR_PURPLE   (Adafruit_NeoPixel::Color(255,   0, 255))
-#define COLOR_YELLOW   (Adafruit_NeoPixel::Color(255, 255,   0))
-
-#include "LightingEvents.h"
-
-	// Parameter 1 = number of pixels in strip
-	// Parameter 2 = Arduino pin number (most are valid)
-	// Parameter 3 = pixel type flags, add together as needed:
-	//   NEO_KHZ800  800 KHz bitstream (most NeoPixel products w/WS2812 LEDs)
-	//   NEO_BRG     Pixels are wired for BRG bitstream order (uncommon I think)
-
-Adafruit_NeoPixel _strip = Adafruit_NeoPixel(TOTAL_STRIP_PIXELS, PIN, NEO_GRB + NEO_KHZ800);
 
-BrakingEvent   * pBraking   = nullptr;
-BackupEvent	   * pBackup    = nullptr;
-SignalEvent    * pLeftTurn  = nullptr;
-SignalEvent    * pRightTurn = nullptr;
-SignalEvent    * pHazard    = nullptr;
-PoliceLightBar * pPoliceBar = nullptr;
+// Wiring, strip geometry, and colors are in Config.h, and a vehicle profile
+// (Vehicles/, Tools/gen_vehicle.py) can override them.  Everything that touches the
+// board goes through the HAL, and the lighting logic itself lives in Engine.h so that
+// it can also be built and run off the board.
 
+#include "HAL.h"
+#include "Engine.h"
+#ifdef BENCHMARK_OUTPUTS
+#include "OutputBenchmark.h"
+#endif
+#if defined(GOLDEN_FRAMES) || defined(BENCHMARK_EFFECTS)
+#include <avr/sleep.h>
+#endif
+#ifdef GOLDEN_FRAMES
+#include "GoldenFrames.h"
+#endif
+#ifdef BENCHMARK_EFFECTS
+#include "EffectBenchmark.h"
+#endif
+#ifdef RECORD_INPUT_TRACE
+#include "InputTrace.h"
+#endif
 
 // IMPORTANT: To reduce NeoPixel burnout risk, add 1000 uF capacitor across
 // pixel power leads, add 300 - 500 Ohm resistor on first pixel's data input
@@ -82,139 +68,75 @@ unsigned long turnStartTime   = 0;
 
 void setup()
 {
-	pBraking   = new BrakingEvent(&_strip);
-	pBackup    = new BackupEvent(&_strip);
-	pLeftTurn  = new SignalEvent(&_strip, SignalEvent::SIGNAL_STYLE::LEFT_TURN);
-	pRightTurn = new SignalEvent(&_strip, SignalEvent::SIGNAL_STYLE::RIGHT_TURN);
-	pHazard    = new SignalEvent(&_strip, SignalEvent::SIGNAL_STYLE::HAZARD);
-	pPoliceBar = new PoliceLightBar(&_strip);
-
-	Serial.begin(115200);
-	Serial.println("BrakeLight Startup");
-
-	_strip.begin();
-	_strip.setBrightness(255);
-	for (uint16_t i = 0; i < NUMBER_USED_PIXELS; i++)
-	{
-		_strip.setPixelColor(i, _strip.Color(0, 0, 0));
-		_strip.show();
-	}
-	pinMode(LEFT_TURN_PIN, INPUT_PULLUP);
-	pinMode(RIGHT_TURN_PIN, INPUT_PULLUP);
-	pinMode(STOP_PIN, INPUT_PULLUP);
-	pinMode(BACKUP_PIN, INPUT_PULLUP);
-
-	lcd.init();
-	lcd.backlight();
-	lcd.setCursor(0, 0);
-	lcd.print("Starting...");
-}
+#ifdef BENCHMARK_OUTPUTS
+	HAL_SerialBegin(115200);
+	runOutputBenchmark();
+#endif
 
-void loop()
-{
-	processAndDisplayInputs();
-	delay(1);
-	return;
+#ifdef BENCHMARK_EFFECTS
+	HAL_SerialBegin(115200);
+	RunEffectBenchmark();
+	Serial.flush();
+	cli();											// As below, ends a simavr run
+	sleep_cpu();
+#endif
+
+	setupEngine();
+
+#ifdef RECORD_INPUT_TRACE
+	InputTraceBegin();
+#endif
+
+#ifdef GOLDEN_FRAMES
+	runGoldenFrames();
+	Serial.flush();
+	cli();											// Sleeping with interrupts off ends a simavr run
+	sleep_cpu();
+#endif
 }
 
-// processAndDisplayInputs()
-// 
-// Main update loop
+#ifdef BENCHMARK_OUTPUTS
 
-void processAndDisplayInputs()
-{
-	// Backup
+// runOutputBenchmark()
+//
+// Races every LED backend we can build against the others on the same frames.  The
+// benchmark runs before the engine creates its own output, and each backend is freed
+// again before the next one is created.  Pin 6 is bit 6 of PORTD on the Uno.
+
+LEDOutput * createNeoPixelOutput() { return new NeoPixelOutput(TOTAL_STRIP_PIXELS, PIN); }
+LEDOutput * createCaptureOutput()  { return new CaptureOutput(TOTAL_STRIP_PIXELS); }
+#ifdef HAVE_BITBANG_OUTPUT
+LEDOutput * createBitBangOutput()  { return new BitBangOutput<PIN>(TOTAL_STRIP_PIXELS); }
+#endif
+#ifdef USE_FASTLED
+LEDOutput * createFastLEDOutput()  { return new FastLEDOutput<PIN>(TOTAL_STRIP_PIXELS); }
+#endif
 
-	if (digitalRead(BACKUP_PIN) == 0)
-	{
-		if (pBackup->GetActive() == false)
-			pBackup->Begin();
-	}
-	else
+void runOutputBenchmark()
+{
+	static const OutputBenchmarkEntry entries[] =
 	{
-		if (pBackup->GetActive() == true)
-			pBackup->End();
-	}
-		
-	// Hazards
+		{ "Adafruit_NeoPixel", createNeoPixelOutput },
+#ifdef HAVE_BITBANG_OUTPUT
+		{ "BitBang",           createBitBangOutput  },
+#endif
+#ifdef USE_FASTLED
+		{ "FastLED",           createFastLEDOutput  },
+#endif
+		{ "Capture",           createCaptureOutput  },
+	};
 
-	if (digitalRead(LEFT_TURN_PIN) == 0 && digitalRead(RIGHT_TURN_PIN) == 0 && digitalRead(STOP_PIN) == 0)
-	{
-		if (pPoliceBar->GetActive() == false)
-			pPoliceBar->Begin();
-	}
-	else
-	{
-		if (pPoliceBar->GetActive() == true)
-			pPoliceBar->End();
-
-		// Braking  
-
-		if (digitalRead(STOP_PIN) == 0)
-		{
-			if (pBraking->GetActive() == false)
-				pBraking->Begin();
-		}
-		else
-		{
-			if (pBraking->GetActive() == true)
-				pBraking->End();
-		}
-
-		if (digitalRead(LEFT_TURN_PIN) == 0 && digitalRead(RIGHT_TURN_PIN) == 0)
-		{
-			if (pHazard->GetActive() == false)
-				pHazard->Begin();
-		}
-		else
-		{
-			if (pHazard->GetActive() == true)
-				pHazard->End();
-
-			// Left turn
-
-			if (digitalRead(LEFT_TURN_PIN) == 0)
-			{
-				if (pLeftTurn->GetActive() == false)
-					pLeftTurn->Begin();
-			}
-			else
-			{
-				if (pLeftTurn->GetActive() == true)
-					pLeftTurn->End();
-			}
-
-			// Right turn
-
-			if (digitalRead(RIGHT_TURN_PIN) == 0)
-			{
-				if (pRightTurn->GetActive() == false)
-					pRightTurn->Begin();
-			}
-			else
-			{
-				if (pRightTurn->GetActive() == true)
-					pRightTurn->End();
-			}
-		}
-	}
-
-	pBackup->Draw();
-	pLeftTurn->Draw();
-	pRightTurn->Draw();
-	pBraking->Draw();
-	pHazard->Draw();
-	pPoliceBar->Draw();
-
-	char szBuf[LCD_WIDTH*LCD_HEIGHT + 1];
-	lcd.setCursor(0, 0);
-	szBuf[0] = '\0';
-	strcpy(szBuf, pBraking->GetActive() ? "STOP" : "    ");
-	strcat(szBuf, ":");
-	strcat(szBuf, pLeftTurn->GetActive() ? "LEFT" : "    ");
-	strcat(szBuf, ":");
-	strcat(szBuf, pRightTurn->GetActive() ? "RIGHT" : "     ");
-	strcat(szBuf, ":");
-	strcat(szBuf, pBackup->GetActive() ? "BACK" : "    ");
-	lcd.print(szBuf);
+	BenchmarkOutputs(entries, ARRAYSIZE(entries));
+}
+
+#endif
+
+void loop()
+{
+	processAndDisplayInputs();
+#ifdef RECORD_INPUT_TRACE
+	InputTraceDrain();
+#endif
+	HAL_Delay(1);
+	return;
 }
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+
+// Config
+//
+// Strip geometry, wiring, and colors.  Everything else includes this rather than
+// reaching back into BrakeLights.ino, so that the host and Cortex-M builds see the
+// same configuration the firmware does.
+//
+// A vehicle profile overrides the defaults here.  Tools/gen_vehicle.py turns a file in
+// Vehicles/ into VehicleProfile.h next to this one, and every build picks it up from
+// there; delete it to go back to the defaults.
+
+#if defined(__has_include)
+#if __has_include("VehicleProfile.h")
+#include "VehicleProfile.h"
+#endif
+#endif
+
+#define LCD_WIDTH 20
+#define LCD_HEIGHT 4
+#define LCD_I2C_ADDRESS 0x27						// I2C address of the LCD's PCF8574 backpack
+
+#ifndef PIN
+#define PIN 6										// LED data pin
+#endif
+
+// Strip geometry can be overridden on the compiler command line (-DTOTAL_STRIP_PIXELS=300)
+// so that the same code can be built and measured at different strip lengths.  The
+// turn zones stay the same fraction of the strip: 50 of 144 pixels.
+
+#ifndef TOTAL_STRIP_PIXELS
+#define TOTAL_STRIP_PIXELS 144						// How many pixels in entire string
+#endif
+#ifndef NUMBER_USED_PIXELS
+#define NUMBER_USED_PIXELS TOTAL_STRIP_PIXELS		// The number of pixels that we use (normally, all of them)
+#endif
+#ifndef NUMBER_TURN_PIXELS
+#define NUMBER_TURN_PIXELS ((uint16_t)(NUMBER_USED_PIXELS * 50L / 144))	// How many pixels on the end will be use for turn signals
+#endif
+
+#define FRAME_BUDGET_US      30000					// Longest a pass through the main loop should take
+#define LCD_SLOW_REFRESH_MS  1000					// How often the LCD still updates when the governor sheds it
+#define BRAKE_DEADLINE_US    (2 * FRAME_BUDGET_US)	// Longest from pressing the pedal to the strip showing red
+
+#ifndef LEFT_TURN_PIN
+#define LEFT_TURN_PIN  3							// Digital input pins.  All must be on PORTD (pins 0-7)
+#define RIGHT_TURN_PIN 2							//   so that they can be read in a single snapshot
+#define STOP_PIN       4
+#define BACKUP_PIN     5
+#endif
+
+#define PACK_RGB(r, g, b) ((((uint32_t)(r)) << 16) | (((uint32_t)(g)) << 8) | ((uint32_t)(b)))
+
+#define COLOR_BLACK    (PACK_RGB(  0,   0,   0))
+#define COLOR_WHITE    (PACK_RGB(255, 255, 255))
+#define COLOR_RED      (PACK_RGB(255,   0,   0))
+#define COLOR_DARK_RED (PACK_RGB( 64,   0,   0))
+#define COLOR_BLUE     (PACK_RGB(  0,   0, 255))
+#define COLOR_AMBER    (PACK_RGB(255,  48,   0))
+#define COLOR_GREEN    (PACK_RGB(  0, 255,   0))
+#define COLOR_PURPLE   (PACK_RGB(255,   0, 255))
+#define COLOR_YELLOW   (PACK_RGB(255, 255,   0))
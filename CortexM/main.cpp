@@ -0,0 +1,112 @@
+//+--------------------------------------------------------------------------
+//
+// Brakelights - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        main.cpp
+//
+// Description:
+//
+//   Startup code and test driver for running the lighting engine bare-metal
+//   on a Cortex-M3 under QEMU.  Drives the engine through the demo drive and
+//   reports, over semihosting, how long each frame took to render on a 32-bit
+//   core with a hardware multiplier.
+//
+//   Build:  arm-none-eabi-g++ -mcpu=cortex-m3 -mthumb -O2 -std=gnu++11
+//             -fno-exceptions -fno-rtti -ffunction-sections -nostartfiles
+//             -DHAL_CORTEXM -T mps2-an385.ld --specs=nano.specs
+//             --specs=nosys.specs main.cpp -o brakelights.elf
+//
+//   Run:    qemu-system-arm -M mps2-an385 -nographic -semihosting
+//             -icount shift=0 -kernel brakelights.elf
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include "../Engine.h"
+#include "../Host/DemoDrive.h"
+
+extern "C"
+{
+	extern uint32_t __data_load, __data_start, __data_end, __bss_start, __bss_end, __stack_top;
+	extern void (*__init_array_start[])();
+	extern void (*__init_array_end[])();
+
+	int  main();
+	void Reset_Handler();
+
+	void Default_Handler()
+	{
+		for (;;)
+			;
+	}
+
+	void Reset_Handler()
+	{
+		uint32_t * pSrc = &__data_load;
+		for (uint32_t * pDst = &__data_start; pDst < &__data_end; )
+			*pDst++ = *pSrc++;
+
+		for (uint32_t * pDst = &__bss_start; pDst < &__bss_end; )
+			*pDst++ = 0;
+
+		for (void (**ppfn)() = __init_array_start; ppfn < __init_array_end; ppfn++)
+			(*ppfn)();
+
+		main();
+		HAL_CortexExit();
+		Default_Handler();
+	}
+
+	// The first 16 entries are the core's own; nothing here uses vendor interrupts
+
+	__attribute__((section(".vectors"), used))
+	void (* const g_vectors[16])() =
+	{
+		(void (*)()) &__stack_top,
+		Reset_Handler,
+		Default_Handler,								// NMI
+		Default_Handler,								// HardFault
+		Default_Handler,								// MemManage
+		Default_Handler,								// BusFault
+		Default_Handler,								// UsageFault
+		0, 0, 0, 0,
+		Default_Handler,								// SVCall
+		Default_Handler,								// DebugMon
+		0,
+		Default_Handler,								// PendSV
+		SysTick_Handler,
+	};
+}
+
+int main()
+{
+	HAL_CortexInit();
+	setupEngine();
+
+	uint32_t cFrames = 0, totalUs = 0, worstUs = 0;
+
+	for (size_t step = 0; step < ARRAYSIZE(g_demoDrive); step++)
+	{
+		HAL_CortexSetInputs(g_demoDrive[step].inputs);
+		uint32_t stepStart = HAL_Millis();
+
+		while (HAL_Millis() - stepStart < g_demoDrive[step].durationMs)
+		{
+			uint32_t frameStart = HAL_Micros();
+			processAndDisplayInputs();
+			uint32_t frameUs = HAL_Micros() - frameStart;
+
+			cFrames++;
+			totalUs += frameUs;
+			worstUs  = max(worstUs, frameUs);
+
+			HAL_Delay(1);
+		}
+	}
+
+	char szBuf[80];
+	snprintf(szBuf, sizeof(szBuf), "%lu frames, average %lu us, worst %lu us",
+			 (unsigned long) cFrames, (unsigned long)(totalUs / cFrames), (unsigned long) worstUs);
+	HAL_SerialPrintln(szBuf);
+	return 0;
+}
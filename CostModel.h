@@ -0,0 +1,109 @@
+#pragma once
+#include "Config.h"
+#include "EffectCosts.h"
+
+// CostModel
+//
+// What a frame and a pass through the main loop cost, in microseconds, built from the
+// measured worst cases in EffectCosts.h (Tools/gen_cost_model.py).  The numbers are
+// constexpr so that admission decisions made at compile time cost nothing at run time,
+// and so that the build fails outright when the brake light can't meet its deadline.
+// The engine also costs each set of layers as it comes on, so the governor can shed
+// work before a load that won't fit has run over budget (see admitLayers() in
+// Engine.h).
+//
+// The budgets are meant to be measured under simavr.  The EffectCosts.h checked in
+// now came from the host model instead (its header says so), so the render part of
+// each cost is counted rather than measured, and so are these checks.
+//
+// Costs were measured at EFFECT_COSTS_PIXELS pixels.  Rendering and showing are both
+// linear in the strip length, so a build at another length scales them; regenerate
+// EffectCosts.h at that length for a measured figure instead of an estimate.
+//
+// The LCD can't be measured under simavr (there's nothing on the other end of the I2C
+// bus), so it's costed the way the host models it: LiquidCrystal_I2C at 100KHz spends
+// about 1.1ms per character, and updateLcd() writes a full line plus the cursor move.
+
+#define COST_LCD_CHAR_US  1100
+#define COST_LCD_LINE_US  ((uint32_t)(LCD_WIDTH + 1) * COST_LCD_CHAR_US)
+#define COST_LOOP_DELAY_US 1000						// loop()'s HAL_Delay(1)
+
+constexpr uint32_t EffectCostUs(uint32_t cycles)
+{
+	return (uint32_t)(((uint64_t) cycles * NUMBER_USED_PIXELS * 1000000UL + (uint64_t) EFFECT_COSTS_F_CPU * EFFECT_COSTS_PIXELS - 1)
+					  / ((uint64_t) EFFECT_COSTS_F_CPU * EFFECT_COSTS_PIXELS));
+}
+
+constexpr uint32_t COST_BACKUP_FRAME_US  = EffectCostUs(EFFECT_COST_BACKUP_CYCLES);
+constexpr uint32_t COST_BRAKE_FRAME_US   = EffectCostUs(EFFECT_COST_BRAKE_CYCLES);
+constexpr uint32_t COST_SIGNAL_FRAME_US  = EffectCostUs(EFFECT_COST_SIGNAL_CYCLES);
+constexpr uint32_t COST_HAZARD_FRAME_US  = EffectCostUs(EFFECT_COST_HAZARD_CYCLES);
+constexpr uint32_t COST_POLICE_FRAME_US  = EffectCostUs(EFFECT_COST_POLICE_CYCLES);
+constexpr uint32_t COST_SPARKLE_FRAME_US = EffectCostUs(EFFECT_COST_SPARKLE_CYCLES);
+constexpr uint32_t COST_WORST_FRAME_US   = EffectCostUs(EFFECT_COST_ALL_CYCLES);	// Every layer at once
+
+// Showing a frame costs the same whatever is in it, so what each effect adds to a
+// frame is its cost less that
+
+constexpr uint32_t COST_SHOW_US = EffectCostUs(EFFECT_COSTS_SHOW_CYCLES);
+
+constexpr uint32_t EffectRenderUs(uint32_t frameUs)
+{
+	return frameUs > COST_SHOW_US ? frameUs - COST_SHOW_US : 0;
+}
+
+// An uploaded pattern isn't benchmarked, so it's costed as every effect stacked
+
+constexpr uint32_t COST_PATTERN_FRAME_US = COST_WORST_FRAME_US;
+
+// Every layer the engine has, stacked in one frame: the most that admitLayers() in
+// Engine.h can be asked to fit.  Each effect's render includes clearing the frame, so
+// this errs high.
+
+constexpr uint32_t COST_ALL_LAYERS_FRAME_US = COST_SHOW_US
+											+ EffectRenderUs(COST_BACKUP_FRAME_US)
+											+ EffectRenderUs(COST_PATTERN_FRAME_US)
+											+ EffectRenderUs(COST_BRAKE_FRAME_US)
+											+ EffectRenderUs(COST_SIGNAL_FRAME_US) * 2
+											+ EffectRenderUs(COST_HAZARD_FRAME_US)
+											+ EffectRenderUs(COST_POLICE_FRAME_US)
+#ifdef PARTICLE_EFFECTS
+											+ EffectRenderUs(COST_SPARKLE_FRAME_US)
+#endif
+											;
+
+// A switch that comes on while a frame is being drawn has the frame drawn again (see
+// composeFrame() in Engine.h).  Costed as a whole frame, show() included, which is
+// more than a redraw takes.
+
+constexpr uint32_t COST_LATE_LATCH_US   = COST_WORST_FRAME_US;
+
+// The slowest pass through the loop draws every layer twice and refreshes the LCD
+
+constexpr uint32_t COST_WORST_PASS_US   = COST_WORST_FRAME_US + COST_LATE_LATCH_US + COST_LCD_LINE_US + COST_LOOP_DELAY_US;
+
+// The latest a press can land and still miss a frame is just after the late read
+// before its commit.  It waits out the rest of that pass, at worst all of it, and then
+// the next pass draws red before it touches the LCD, perhaps twice if another switch
+// came on too.
+
+constexpr uint32_t COST_BRAKE_LATENCY_US = COST_WORST_PASS_US + COST_WORST_FRAME_US + COST_LATE_LATCH_US;
+
+// At the governor's lowest stage the pass leaves out the LCD, bar its refresh once a
+// second, which the governor's average absorbs.  What's left is every layer drawn,
+// perhaps twice for a late switch, and the loop's delay.  If that doesn't fit, there's
+// no stage left for admitLayers() to step down to.
+
+constexpr uint32_t COST_LOWEST_STAGE_PASS_US = COST_ALL_LAYERS_FRAME_US * 2 + COST_LOOP_DELAY_US;
+
+// Benchmark builds define COST_MODEL_UNCHECKED: measuring strips that are too long
+// to meet the deadline is how you find out where the limit is
+
+#ifndef COST_MODEL_UNCHECKED
+static_assert(COST_BRAKE_LATENCY_US <= BRAKE_DEADLINE_US,
+			  "The brake light can take longer than BRAKE_DEADLINE_US to come on at this strip length (see CostModel.h)");
+static_assert(COST_BRAKE_FRAME_US + COST_LCD_LINE_US + COST_LOOP_DELAY_US <= FRAME_BUDGET_US,
+			  "A pass with only the brakes on doesn't fit in FRAME_BUDGET_US (see CostModel.h)");
+static_assert(COST_LOWEST_STAGE_PASS_US <= FRAME_BUDGET_US,
+			  "Every layer at once doesn't fit in FRAME_BUDGET_US even at the governor's lowest stage (see CostModel.h)");
+#endif
@@ -0,0 +1,117 @@
+#pragma once
+#include "HAL.h"
+
+// Easing
+//
+// Curves for the effects' timed phases: how far along a bloom or fade is drawn at
+// each moment of it.  Every effect's phases are linear by default, which is exactly
+// what they've always drawn.  A phase's timing can pick one of the others instead:
+//
+//   EASE_OUT_CUBIC  fast at first, settling gently: 1 - (1 - t)^3
+//   EASE_IN_OUT     slow at both ends, fastest through the middle (cubic)
+//   EASE_OUT_EXPO   almost all of the way in the first third: 1 - 2^(-10t)
+//
+// Each curve is 256 bytes of flash, indexed by the phase in 1/256ths.  The phase
+// comes from multiplying the time into the phase by a step the effect works out once
+// when it's created, so drawing an eased phase is a multiply, a table read, and a
+// divide by a constant that the compiler turns into a multiply.
+
+enum EASING_CURVE : uint8_t
+{
+	EASE_LINEAR = 0,
+	EASE_OUT_CUBIC,
+	EASE_IN_OUT,
+	EASE_OUT_EXPO
+};
+
+// round(255 * curve(i / 255)), so every curve runs from exactly 0 to exactly 255
+
+static const uint8_t g_easingCurves[3][256] HAL_FLASH =
+{
+	{	// EASE_OUT_CUBIC
+		  0,   3,   6,   9,  12,  15,  18,  20,  23,  26,  29,  32,  34,  37,  40,  42,
+		 45,  48,  50,  53,  55,  58,  60,  63,  65,  68,  70,  73,  75,  77,  80,  82,
+		 84,  87,  89,  91,  93,  96,  98, 100, 102, 104, 106, 108, 111, 113, 115, 117,
+		119, 121, 123, 124, 126, 128, 130, 132, 134, 136, 137, 139, 141, 143, 144, 146,
+		148, 150, 151, 153, 154, 156, 158, 159, 161, 162, 164, 165, 167, 168, 170, 171,
+		173, 174, 175, 177, 178, 179, 181, 182, 183, 185, 186, 187, 188, 190, 191, 192,
+		193, 194, 195, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, 208, 209,
+		210, 211, 212, 213, 214, 215, 215, 216, 217, 218, 219, 220, 220, 221, 222, 223,
+		223, 224, 225, 226, 226, 227, 228, 228, 229, 230, 230, 231, 232, 232, 233, 233,
+		234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 239, 240, 240, 241, 241, 241,
+		242, 242, 243, 243, 243, 244, 244, 245, 245, 245, 246, 246, 246, 247, 247, 247,
+		247, 248, 248, 248, 249, 249, 249, 249, 249, 250, 250, 250, 250, 251, 251, 251,
+		251, 251, 252, 252, 252, 252, 252, 252, 252, 253, 253, 253, 253, 253, 253, 253,
+		253, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	},
+	{	// EASE_IN_OUT
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,
+		  2,   2,   2,   3,   3,   3,   3,   4,   4,   4,   5,   5,   5,   6,   6,   6,
+		  7,   7,   8,   8,   9,   9,  10,  10,  11,  11,  12,  13,  13,  14,  15,  15,
+		 16,  17,  18,  19,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,
+		 31,  33,  34,  35,  36,  38,  39,  41,  42,  43,  45,  46,  48,  49,  51,  53,
+		 54,  56,  58,  60,  62,  63,  65,  67,  69,  71,  73,  75,  77,  80,  82,  84,
+		 86,  89,  91,  94,  96,  99, 101, 104, 106, 109, 112, 114, 117, 120, 123, 126,
+		129, 132, 135, 138, 141, 143, 146, 149, 151, 154, 156, 159, 161, 164, 166, 169,
+		171, 173, 175, 178, 180, 182, 184, 186, 188, 190, 192, 193, 195, 197, 199, 201,
+		202, 204, 206, 207, 209, 210, 212, 213, 214, 216, 217, 219, 220, 221, 222, 224,
+		225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 236, 237, 238, 239,
+		240, 240, 241, 242, 242, 243, 244, 244, 245, 245, 246, 246, 247, 247, 248, 248,
+		249, 249, 249, 250, 250, 250, 251, 251, 251, 252, 252, 252, 252, 253, 253, 253,
+		253, 253, 253, 254, 254, 254, 254, 254, 254, 254, 254, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	},
+	{	// EASE_OUT_EXPO
+		  0,   7,  13,  20,  26,  32,  38,  44,  50,  55,  61,  66,  71,  76,  81,  85,
+		 90,  94,  99, 103, 107, 111, 115, 119, 122, 126, 129, 133, 136, 139, 142, 145,
+		148, 151, 154, 157, 159, 162, 164, 167, 169, 171, 174, 176, 178, 180, 182, 184,
+		186, 188, 189, 191, 193, 195, 196, 198, 199, 201, 202, 204, 205, 206, 208, 209,
+		210, 211, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 224, 225,
+		226, 227, 228, 228, 229, 230, 230, 231, 232, 232, 233, 234, 234, 235, 235, 236,
+		236, 237, 237, 238, 238, 239, 239, 239, 240, 240, 241, 241, 241, 242, 242, 243,
+		243, 243, 243, 244, 244, 244, 245, 245, 245, 245, 246, 246, 246, 246, 247, 247,
+		247, 247, 248, 248, 248, 248, 248, 249, 249, 249, 249, 249, 249, 249, 250, 250,
+		250, 250, 250, 250, 250, 251, 251, 251, 251, 251, 251, 251, 251, 251, 252, 252,
+		252, 252, 252, 252, 252, 252, 252, 252, 252, 252, 252, 253, 253, 253, 253, 253,
+		253, 253, 253, 253, 253, 253, 253, 253, 253, 253, 253, 253, 253, 254, 254, 254,
+		254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254,
+		254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254, 254,
+		254, 254, 254, 254, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+	}
+};
+
+static inline uint8_t Ease(EASING_CURVE curve, uint8_t phase)
+{
+	return curve == EASE_LINEAR ? phase : HAL_ReadFlashByte(&g_easingCurves[curve - 1][phase]);
+}
+
+// EasePhaseStep
+//
+// What to multiply ms into a phase of durationMs by, then shift down 16 bits, for the
+// phase in 1/256ths.  Anything short of the whole duration stays under 2^24 when
+// multiplied, so it never overflows.
+
+constexpr uint32_t EasePhaseStep(uint32_t durationMs)
+{
+	return durationMs ? ((uint32_t) 256 << 16) / durationMs : 0;
+}
+
+// EaseCount
+//
+// How much of count a phase has reached elapsedMs into durationMs, along the curve.
+// Linear is count * elapsedMs / durationMs, to the ms, as the effects have always
+// drawn it; the curves go by the phase to 1/256th.  Either way the whole duration
+// gives all of count.
+
+static inline uint32_t EaseCount(EASING_CURVE curve, uint32_t count, uint32_t elapsedMs, uint32_t durationMs, uint32_t step)
+{
+	if (elapsedMs >= durationMs)
+		return count;
+	if (curve == EASE_LINEAR)
+		return count * elapsedMs / durationMs;
+	return count * Ease(curve, (uint8_t)((elapsedMs * step) >> 16)) / 255;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <stdio.h>
+#include "HAL.h"
+#include "LightingEvents.h"
+#include "Particles.h"
+#include "Noise.h"
+
+// EffectBenchmark
+//
+// Measures what each effect costs at the strip length this build was compiled for:
+// the time to render a frame (clear plus every layer's Draw), the time to show it,
+// the frame rate the two allow, and the RAM left over once the frame buffer exists.
+// Tools/scaling_bench.py builds the sketch at several strip lengths, runs this on the
+// host and under simavr, and collects the results.
+//
+// Each effect is timed in two batches of frames, first rendering only and then
+// rendering and committing, and the show time is the difference.  Timing whole
+// batches keeps the AVR stopwatch's 4us ticks from rounding away short renders; the
+// batch is kept small enough that a long strip's show() doesn't wrap the stopwatch.
+//
+// The benchmark runs on the virtual clock, and every batch draws the same ten
+// moments spread across the first second of the effect, so both batches and both
+// platforms render exactly the same frames.
+//
+// The committing batch also times each frame on its own, and the slowest of them is
+// the worst case: what Tools/gen_cost_model.py turns into the cost budgets in
+// EffectCosts.h.  It's the worst of the ten moments sampled, not a proof that no
+// moment of the animation is slower.
+//
+// Output is one CSV line per effect, prefixed with "E," so it can be picked out of
+// whatever else is on the serial port.  Times are nanoseconds per frame.
+
+#ifndef EFFECT_BENCHMARK_FRAMES
+#define EFFECT_BENCHMARK_FRAMES 10					// Must be a multiple of the ten sample times
+#endif
+
+#define EFFECT_BENCHMARK_STEP_MS 100
+
+static uint32_t TimeEffectFrames(LEDOutput * pOutput, LightingEvent ** ppEvents, uint8_t cEvents, bool commit, uint32_t * pWorstUs)
+{
+	*pWorstUs = 0;
+
+	HAL_SetVirtualMillis(0);
+	for (uint8_t i = 0; i < cEvents; i++)
+		ppEvents[i]->Begin();
+
+	HAL_StopwatchStart();
+	for (uint16_t frame = 0; frame < EFFECT_BENCHMARK_FRAMES; frame++)
+	{
+		HAL_SetVirtualMillis((uint32_t)(frame % 10) * EFFECT_BENCHMARK_STEP_MS);
+		uint32_t startUs = HAL_StopwatchMicros();
+		pOutput->Clear();
+		for (uint8_t i = 0; i < cEvents; i++)
+			ppEvents[i]->Draw();
+		if (commit)
+			pOutput->Commit();
+
+		*pWorstUs = max(*pWorstUs, HAL_StopwatchMicros() - startUs);
+	}
+	uint32_t us = HAL_StopwatchMicros();
+
+	for (uint8_t i = 0; i < cEvents; i++)
+		ppEvents[i]->End();
+	return us;
+}
+
+static void BenchmarkEffect(const char * pszName, LEDOutput * pOutput, LightingEvent ** ppEvents, uint8_t cEvents)
+{
+	uint32_t worstUs;
+	uint32_t renderUs = TimeEffectFrames(pOutput, ppEvents, cEvents, false, &worstUs);
+	uint32_t totalUs  = TimeEffectFrames(pOutput, ppEvents, cEvents, true, &worstUs);
+	uint32_t renderNs = renderUs * 1000UL / EFFECT_BENCHMARK_FRAMES;
+	uint32_t showNs   = totalUs > renderUs ? (totalUs - renderUs) * 1000UL / EFFECT_BENCHMARK_FRAMES : 0;
+	uint32_t frameNs  = renderNs + showNs;
+
+	char szBuf[96];
+	snprintf(szBuf, sizeof(szBuf), "E,%s,%u,%lu,%lu,%lu,%d,%lu", pszName, (unsigned) NUMBER_USED_PIXELS,
+			 (unsigned long) renderNs, (unsigned long) showNs,
+			 (unsigned long)(frameNs ? 1000000000UL / frameNs : 0), HAL_FreeMemory(),
+			 (unsigned long) worstUs * 1000UL);
+	HAL_SerialPrintln(szBuf);
+}
+
+// RunEffectBenchmark
+//
+// Benchmarks every effect alone, then all of them stacked the way the engine would
+// with the hazards on while braking and backing up, and the sparkles on top in a
+// PARTICLE_EFFECTS build.  Creates its own output and events and frees them again
+// when done.  The particle and noise effects are timed even when the engine leaves
+// them out, the particles with pools as static as the engine's would be.
+
+static void RunEffectBenchmark()
+{
+	static_assert(EFFECT_BENCHMARK_FRAMES % 10 == 0, "EFFECT_BENCHMARK_FRAMES must be a multiple of 10");
+
+	HAL_SerialPrintln("E,effect,pixels,render_ns,show_ns,fps,free_bytes,worst_ns");
+
+	LEDOutput * pOutput = HAL_CreateLEDOutput(TOTAL_STRIP_PIXELS);
+	if (pOutput->GetPixels() == nullptr)
+	{
+		char szBuf[64];
+		snprintf(szBuf, sizeof(szBuf), "# No room for %u pixels, %d bytes free", (unsigned) TOTAL_STRIP_PIXELS, HAL_FreeMemory());
+		HAL_SerialPrintln(szBuf);
+		delete pOutput;
+		return;
+	}
+
+	BackupEvent    backup(pOutput);
+	BrakingEvent   braking(pOutput);
+	SignalEvent    leftTurn(pOutput, SignalEvent::SIGNAL_STYLE::LEFT_TURN);
+	SignalEvent    hazard(pOutput, SignalEvent::SIGNAL_STYLE::HAZARD);
+	PoliceLightBar policeBar(pOutput);
+
+	static Particle sparklePool[SPARKLE_POOL];
+	static Particle cometPool[COMET_POOL];
+	ParticleEvent   sparkle(pOutput, ParticleEvent::SPARKLE, sparklePool, ARRAYSIZE(sparklePool));
+	ParticleEvent   comets(pOutput, ParticleEvent::LEFT_COMETS, cometPool, ARRAYSIZE(cometPool));
+	NoiseEvent      embers(pOutput, NoiseEvent::EMBERS);
+	NoiseEvent      rainbow(pOutput, NoiseEvent::RAINBOW);
+
+#ifdef PARTICLE_EFFECTS
+	LightingEvent * pAll[] = { &backup, &braking, &hazard, &policeBar, &sparkle };
+#else
+	LightingEvent * pAll[] = { &backup, &braking, &hazard, &policeBar };
+#endif
+
+	LightingEvent * pEvent;
+	pEvent = &backup;    BenchmarkEffect("backup",  pOutput, &pEvent, 1);
+	pEvent = &braking;   BenchmarkEffect("brake",   pOutput, &pEvent, 1);
+	pEvent = &leftTurn;  BenchmarkEffect("signal",  pOutput, &pEvent, 1);
+	pEvent = &hazard;    BenchmarkEffect("hazard",  pOutput, &pEvent, 1);
+	pEvent = &policeBar; BenchmarkEffect("police",  pOutput, &pEvent, 1);
+	pEvent = &sparkle;   BenchmarkEffect("sparkle", pOutput, &pEvent, 1);
+	pEvent = &comets;    BenchmarkEffect("comet",   pOutput, &pEvent, 1);
+	pEvent = &embers;    BenchmarkEffect("embers",  pOutput, &pEvent, 1);
+	pEvent = &rainbow;   BenchmarkEffect("rainbow", pOutput, &pEvent, 1);
+	BenchmarkEffect("all", pOutput, pAll, ARRAYSIZE(pAll));
+
+	delete pOutput;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+
+// EffectCosts
+//
+// Generated by Tools/gen_cost_model.py; don't edit it by hand, run that again.
+// Worst cycles per frame (render plus show) that EffectBenchmark.h measured for
+// each effect alone, and for all of them stacked, at EFFECT_COSTS_PIXELS pixels,
+// and the cycles that showing a frame costs whatever is in it.
+//
+// Source: host model (modelled wire time and render cycles, not measured on the board)
+//
+// These should be measured under simavr; they were generated with --host because
+// it wasn't available.  The show cost is the WS2812 wire time and the render is
+// HAL_Host.h's count of AVR cycles for the frame buffer work, so the effects' own
+// arithmetic isn't in them.  Run this again without --host to replace them.
+
+#define EFFECT_COSTS_PIXELS 144
+#define EFFECT_COSTS_F_CPU  16000000UL
+
+constexpr uint32_t EFFECT_COSTS_SHOW_CYCLES = 69920;
+
+constexpr uint32_t EFFECT_COST_BACKUP_CYCLES  = 74368;
+constexpr uint32_t EFFECT_COST_BRAKE_CYCLES   = 74368;
+constexpr uint32_t EFFECT_COST_SIGNAL_CYCLES  = 73232;
+constexpr uint32_t EFFECT_COST_HAZARD_CYCLES  = 73952;
+constexpr uint32_t EFFECT_COST_POLICE_CYCLES  = 75200;
+constexpr uint32_t EFFECT_COST_SPARKLE_CYCLES = 74208;
+constexpr uint32_t EFFECT_COST_ALL_CYCLES     = 80336;
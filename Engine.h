@@ -0,0 +1,598 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "HAL.h"
+#include "LightingEvents.h"
+#include "Governor.h"
+#include "CostModel.h"
+#include "Pattern.h"
+#include "PatternLoader.h"
+#include "BlackBox.h"
+#ifdef PARTICLE_EFFECTS
+#include "Particles.h"
+#endif
+
+// Engine
+//
+// The lighting events and the loop that drives them: read the switches, start and
+// stop events to match, compose the frame, and update the LCD.  It talks to the
+// board only through the HAL, so the firmware, the host simulator, and the Cortex-M
+// build all run exactly this code.
+//
+// Each pass is timed and fed to the overload governor (see Governor.h), which decides
+// how much of the frame and LCD work the next passes can skip.  A new set of layers
+// is costed from the cost model (CostModel.h) as it comes on, so the governor can
+// skip work before it has run over budget.
+//
+// A pattern uploaded to EEPROM (see Pattern.h) runs while its switch combination is
+// held, as a layer under the brakes and signals, so those always show over it.
+//
+// Built with BLACK_BOX, the loop also keeps a record of its last moments that
+// survives a reset (see BlackBox.h), under a watchdog.
+//
+// Built with PARTICLE_EFFECTS, sparkles scatter off the strip for a moment each time
+// the brake lets go (see Particles.h).  They're the top layer, so the layer bits the
+// black box records for the others don't move.
+//
+// The engine's state is HAL_THREAD_LOCAL, so on the host every thread can run an
+// engine of its own.
+
+HAL_THREAD_LOCAL LEDOutput      * pOutput    = nullptr;
+
+HAL_THREAD_LOCAL BrakingEvent   * pBraking   = nullptr;
+HAL_THREAD_LOCAL BackupEvent    * pBackup    = nullptr;
+HAL_THREAD_LOCAL SignalEvent    * pLeftTurn  = nullptr;
+HAL_THREAD_LOCAL SignalEvent    * pRightTurn = nullptr;
+HAL_THREAD_LOCAL SignalEvent    * pHazard    = nullptr;
+HAL_THREAD_LOCAL PoliceLightBar * pPoliceBar = nullptr;
+HAL_THREAD_LOCAL PatternEvent   * pPattern   = nullptr;
+#ifdef PARTICLE_EFFECTS
+HAL_THREAD_LOCAL ParticleEvent  * pSparkle   = nullptr;
+
+static HAL_THREAD_LOCAL Particle s_sparklePool[SPARKLE_POOL];
+#endif
+
+HAL_THREAD_LOCAL PatternLoader  * pLoader    = nullptr;
+
+#ifdef PARTICLE_EFFECTS
+HAL_THREAD_LOCAL LightingEvent  * pLayers[8];		// Every event, in z-order, bottom layer first
+#else
+HAL_THREAD_LOCAL LightingEvent  * pLayers[7];
+#endif
+
+static const char * const s_layerNames[ARRAYSIZE(pLayers)] =	// For tracing
+{
+	"draw backup", "draw pattern", "draw brake", "draw left", "draw right", "draw hazard", "draw police",
+#ifdef PARTICLE_EFFECTS
+	"draw sparkle"
+#endif
+};
+
+// What each layer adds to the render of a frame, from the cost model (CostModel.h)
+
+static const uint32_t s_layerRenderUs[ARRAYSIZE(pLayers)] HAL_FLASH =
+{
+	EffectRenderUs(COST_BACKUP_FRAME_US), EffectRenderUs(COST_PATTERN_FRAME_US), EffectRenderUs(COST_BRAKE_FRAME_US),
+	EffectRenderUs(COST_SIGNAL_FRAME_US), EffectRenderUs(COST_SIGNAL_FRAME_US), EffectRenderUs(COST_HAZARD_FRAME_US),
+	EffectRenderUs(COST_POLICE_FRAME_US),
+#ifdef PARTICLE_EFFECTS
+	EffectRenderUs(COST_SPARKLE_FRAME_US)
+#endif
+};
+
+HAL_THREAD_LOCAL OverloadGovernor g_governor(FRAME_BUDGET_US);
+
+static HAL_THREAD_LOCAL uint8_t  s_lastInputs     = 0xFF;
+static HAL_THREAD_LOCAL uint32_t s_frameCount     = 0;
+static HAL_THREAD_LOCAL uint32_t s_lastLcdRefresh = 0;
+static HAL_THREAD_LOCAL uint8_t  s_drawnLayers    = 0;	// Which layers were active in the frame on the strip
+static HAL_THREAD_LOCAL uint32_t s_frameStaleMs   = 0;	// ...and when some layer of it will change
+
+static_assert(ARRAYSIZE(pLayers) <= 8, "s_drawnLayers has a bit per layer");
+
+// The switches that bring up a safety-critical event.  One of these coming on while a
+// frame is being drawn gets the frame redrawn with it (see composeFrame()).
+
+#define LATE_LATCH_INPUTS (INPUT_STOP | INPUT_LEFT_TURN | INPUT_RIGHT_TURN)
+
+// serialCommand()
+//
+// The one-byte commands that can be sent over Serial, outside of a pattern upload
+
+static void serialCommand(uint8_t command)
+{
+	if (command == BLACK_BOX_DUMP_COMMAND)
+		BlackBoxDump();
+}
+
+// setupEngine()
+//
+// Creates the LED output and the events, and brings up the inputs, serial, and LCD
+
+void setupEngine()
+{
+	pOutput    = HAL_CreateLEDOutput(TOTAL_STRIP_PIXELS);
+
+	pBraking   = new BrakingEvent(pOutput);
+	pBackup    = new BackupEvent(pOutput);
+	pLeftTurn  = new SignalEvent(pOutput, SignalEvent::SIGNAL_STYLE::LEFT_TURN);
+	pRightTurn = new SignalEvent(pOutput, SignalEvent::SIGNAL_STYLE::RIGHT_TURN);
+	pHazard    = new SignalEvent(pOutput, SignalEvent::SIGNAL_STYLE::HAZARD);
+	pPoliceBar = new PoliceLightBar(pOutput);
+	pPattern   = new PatternEvent(pOutput);
+#ifdef PARTICLE_EFFECTS
+	pSparkle   = new ParticleEvent(pOutput, ParticleEvent::SPARKLE, s_sparklePool, ARRAYSIZE(s_sparklePool));
+#endif
+	pLoader    = new PatternLoader(pPattern);
+	pLoader->SetCommandHandler(serialCommand);
+
+	// The signals share the ends of the strip with the brake lights, so they take the
+	// brighter of each channel rather than replacing what's beneath them: where both
+	// are lit the result doesn't depend on which draws last
+
+	pLeftTurn->SetBlendMode(BLEND_MAX);
+	pRightTurn->SetBlendMode(BLEND_MAX);
+	pHazard->SetBlendMode(BLEND_MAX);
+
+	pLayers[0] = pBackup;
+	pLayers[1] = pPattern;
+	pLayers[2] = pBraking;
+	pLayers[3] = pLeftTurn;
+	pLayers[4] = pRightTurn;
+	pLayers[5] = pHazard;
+	pLayers[6] = pPoliceBar;
+#ifdef PARTICLE_EFFECTS
+	pLayers[7] = pSparkle;
+#endif
+
+	pPattern->Load();
+
+	HAL_SerialBegin(115200);
+	HAL_SerialPrintln("BrakeLight Startup");
+
+	pOutput->SetBrightness(255);
+	pOutput->Clear();
+	pOutput->Commit();
+
+	HAL_InitInputs();
+
+	HAL_LcdInit();
+	HAL_LcdPrint(0, "Starting...");
+
+	BlackBoxBegin();
+}
+
+// shutdownEngine()
+//
+// Frees everything setupEngine() created and puts the loop's state back the way it
+// started, so that a host driver can run the engine from scratch more than once
+
+void shutdownEngine()
+{
+	delete pBraking;
+	delete pBackup;
+	delete pLeftTurn;
+	delete pRightTurn;
+	delete pHazard;
+	delete pPoliceBar;
+	delete pPattern;
+#ifdef PARTICLE_EFFECTS
+	delete pSparkle;
+#endif
+	delete pLoader;
+	delete pOutput;
+
+	pBraking   = nullptr;
+	pBackup    = nullptr;
+	pLeftTurn  = nullptr;
+	pRightTurn = nullptr;
+	pHazard    = nullptr;
+	pPoliceBar = nullptr;
+	pPattern   = nullptr;
+#ifdef PARTICLE_EFFECTS
+	pSparkle   = nullptr;
+#endif
+	pLoader    = nullptr;
+	pOutput    = nullptr;
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+		pLayers[i] = nullptr;
+
+	g_governor        = OverloadGovernor(FRAME_BUDGET_US);
+	s_lastInputs      = 0xFF;
+	s_frameCount      = 0;
+	s_lastLcdRefresh  = 0;
+	s_drawnLayers     = 0;
+	s_frameStaleMs    = 0;
+}
+
+// setEventActive()
+//
+// Begins or ends an event so that its active state matches the input
+
+static inline void setEventActive(LightingEvent * pEvent, bool active)
+{
+	if (active)
+	{
+		if (pEvent->GetActive() == false)
+			pEvent->Begin();
+	}
+	else
+	{
+		if (pEvent->GetActive() == true)
+			pEvent->End();
+	}
+}
+
+// applyInputs()
+//
+// Starts and stops the events to match a snapshot of the switches.  This is the
+// priority the input logic gives the events, which isn't the order they're drawn in.
+
+void applyInputs(uint8_t inputs)
+{
+	bool left   = (inputs & INPUT_LEFT_TURN)  != 0;
+	bool right  = (inputs & INPUT_RIGHT_TURN) != 0;
+	bool stop   = (inputs & INPUT_STOP)       != 0;
+	bool backup = (inputs & INPUT_BACKUP)     != 0;
+
+#ifdef PARTICLE_EFFECTS
+	bool wasBraking = pBraking->GetActive();
+#endif
+
+	// Backup
+
+	setEventActive(pBackup, backup);
+
+	// Uploaded pattern
+
+	setEventActive(pPattern, pPattern->IsLoaded() && inputs == pPattern->GetInputs());
+		
+	// Hazards
+
+	if (left && right && stop)
+	{
+		setEventActive(pPoliceBar, true);
+	}
+	else
+	{
+		setEventActive(pPoliceBar, false);
+
+		// Braking  
+
+		setEventActive(pBraking, stop);
+
+		if (left && right)
+		{
+			setEventActive(pHazard, true);
+		}
+		else
+		{
+			setEventActive(pHazard, false);
+
+			// Left turn
+
+			setEventActive(pLeftTurn, left);
+
+			// Right turn
+
+			setEventActive(pRightTurn, right);
+		}
+	}
+
+#ifdef PARTICLE_EFFECTS
+
+	// Sparkles when the brake lets go.  The layer stays active after the burst, drawing
+	// nothing, until the brake comes on again.
+
+	if (pBraking->GetActive())
+		setEventActive(pSparkle, false);
+	else if (wasBraking)
+		pSparkle->Begin();
+#endif
+}
+
+// activeLayers()
+//
+// A bit for each layer that's showing, in z-order
+
+uint8_t activeLayers()
+{
+	uint8_t layers = 0;
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+		if (pLayers[i]->GetActive())
+			layers |= 1 << i;
+	return layers;
+}
+
+// EngineLayers
+//
+// Which layers are showing, and when each of them began.  Every effect draws purely
+// from its start time and the time now, so along with the time this is all a frame
+// depends on: restoring it and drawing gives the same bytes the loop would have
+// drawn at that moment, however the engine came to be there.
+
+struct EngineLayers
+{
+	uint8_t  active;								// A bit per layer, as from activeLayers()
+	uint32_t startMs[ARRAYSIZE(pLayers)];
+};
+
+void captureLayers(EngineLayers & layers)
+{
+	layers.active = activeLayers();
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+		layers.startMs[i] = pLayers[i]->GetStartMs();
+}
+
+void restoreLayers(const EngineLayers & layers)
+{
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+	{
+		if (layers.active & (1 << i))
+			pLayers[i]->BeginAt(layers.startMs[i]);
+		else
+			setEventActive(pLayers[i], false);
+	}
+}
+
+// drawLayers()
+//
+// Every event draws its layer into the cleared strip from the bottom up, blending with
+// what's beneath it.  Layer order is z-order, not the priority the input logic gives
+// the events.
+//
+// Before drawing, asks every layer how long it will look the way it does now.  Asking
+// first means a layer that changes while the frame is being drawn is caught next pass
+// instead of missed until its following change.
+
+void drawLayers()
+{
+	uint32_t msUntilChange = EVENT_NO_CHANGE;
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+		msUntilChange = min(msUntilChange, pLayers[i]->MsUntilChange());
+	s_frameStaleMs = HAL_Millis() + msUntilChange;
+
+	if (!HAL_DrawLayers())							// Off when a host simulator only wants the decisions
+		return;
+
+	pOutput->Clear();
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+	{
+		if (pLayers[i]->GetActive())
+			HAL_TraceBegin("layers", s_layerNames[i]);
+		pLayers[i]->Draw();
+		if (pLayers[i]->GetActive())
+			HAL_TraceEnd("layers", s_layerNames[i]);
+	}
+}
+
+// composeFrame()
+//
+// Draws the frame for the switches as they were at the top of the pass and sends it
+// out in one commit.  On the AVR the layers can take milliseconds to draw, so just
+// before the commit the switches are read again: if one in LATE_LATCH_INPUTS has come
+// on meanwhile, just those newly pressed switches are added to the snapshot, the events
+// are brought up to date and the frame is drawn again, so the brake light goes out with
+// this frame rather than a whole pass later.  Anything else that changed, a release or
+// the backup switch, waits for the next pass.  Returns the inputs the frame shows.
+
+uint8_t composeFrame(uint8_t inputs)
+{
+	drawLayers();
+
+	uint8_t late = HAL_ReadInputs();
+	if (late & ~inputs & LATE_LATCH_INPUTS)
+	{
+		inputs |= late & ~inputs & LATE_LATCH_INPUTS;
+		BlackBoxLateInputs(inputs);
+		HAL_TraceInstant("inputs", "late latch", inputs);
+		applyInputs(inputs);
+		drawLayers();
+	}
+
+	pOutput->Commit();
+	return inputs;
+}
+
+// reportGovernor()
+//
+// Telemetry: tells the serial port whenever the governor changes stage
+
+void reportGovernor()
+{
+	char szBuf[64];
+	snprintf(szBuf, sizeof(szBuf), "GOV stage %u avg %luus budget %luus",
+			 (unsigned) g_governor.GetStage(),
+			 (unsigned long) g_governor.GetAverageFrameUs(),
+			 (unsigned long) g_governor.GetBudgetUs());
+	HAL_SerialPrintln(szBuf);
+}
+
+// admitLayers()
+//
+// Costs a pass with these layers from the cost model, and when it won't fit in the
+// frame budget, has the governor step straight down to the first stage where it does
+// instead of finding out over GOVERNOR_DOWN_FRAMES frames over budget.  Every layer's
+// cost includes clearing the frame, so a stack of them errs high.
+
+void admitLayers(uint8_t layers)
+{
+	uint32_t frameUs = COST_SHOW_US;
+	bool     safety  = false;
+	for (size_t i = 0; i < ARRAYSIZE(pLayers); i++)
+	{
+		if (layers & (1 << i))
+		{
+			uint32_t renderUs;
+			HAL_ReadFlash(&renderUs, &s_layerRenderUs[i], sizeof(renderUs));
+			frameUs += renderUs;
+			safety  |= pLayers[i]->IsSafetyCritical();
+		}
+	}
+
+	// Half rate only halves the frames when nothing safety-critical is showing, and
+	// with the LCD given up the pass is all frame
+
+	QUALITY_STAGE stage  = QUALITY_FULL;
+	uint32_t      passUs = frameUs + COST_LCD_LINE_US + COST_LOOP_DELAY_US;
+	if (passUs > FRAME_BUDGET_US)
+	{
+		stage = QUALITY_HALF_RATE;
+		if (!safety)
+			passUs -= frameUs / 2;
+	}
+	if (passUs > FRAME_BUDGET_US)
+		stage = QUALITY_NO_LCD;
+
+	if (g_governor.Admit(stage))
+		reportGovernor();
+}
+
+// updateLcd()
+//
+// Shows which events are active on the top line of the LCD
+
+void updateLcd()
+{
+	char szBuf[LCD_WIDTH*LCD_HEIGHT + 1];
+	szBuf[0] = '\0';
+	strcpy(szBuf, pBraking->GetActive() ? "STOP" : "    ");
+	strcat(szBuf, ":");
+	strcat(szBuf, pLeftTurn->GetActive() ? "LEFT" : "    ");
+	strcat(szBuf, ":");
+	strcat(szBuf, pRightTurn->GetActive() ? "RIGHT" : "     ");
+	strcat(szBuf, ":");
+	strcat(szBuf, pBackup->GetActive() ? "BACK" : "    ");
+	HAL_LcdPrint(0, szBuf);
+}
+
+// processAndDisplayInputs()
+// 
+// Main update loop
+
+void processAndDisplayInputs()
+{
+	HAL_StopwatchStart();
+	HAL_TraceBegin("loop", "pass");
+
+	// Take one snapshot of all the switches so the whole frame agrees on them
+
+	uint8_t inputs = HAL_ReadInputs();
+	BlackBoxInputs(inputs);
+	applyInputs(inputs);
+
+	// A frame only needs drawing when it would differ from the one already on the
+	// strip: a layer has come or gone, or one of them has reached its next change.
+	// Until then the strip holds the last frame and the pass is just the inputs.
+
+	uint8_t layers     = activeLayers();
+	bool    frameStale = layers != s_drawnLayers || (int32_t)(HAL_Millis() - s_frameStaleMs) >= 0;
+	BlackBoxLayers(layers);
+
+	// Layers that have just come on get costed before they're drawn
+
+	if (layers != s_drawnLayers)
+		admitLayers(layers);
+
+	// At half rate we only draw every other frame, unless the inputs just changed or a
+	// safety-critical event is showing, either of which always gets drawn right away
+
+	bool drawFrame = g_governor.FullFrameRate() || inputs != s_lastInputs || (s_frameCount & 1) == 0;
+	for (size_t i = 0; i < ARRAYSIZE(pLayers) && !drawFrame; i++)
+		drawFrame = pLayers[i]->GetActive() && pLayers[i]->IsSafetyCritical();
+
+	if (drawFrame && frameStale)
+	{
+		inputs        = composeFrame(inputs);
+		s_drawnLayers = activeLayers();
+		BlackBoxLayers(s_drawnLayers);
+	}
+
+	s_lastInputs = inputs;
+	s_frameCount++;
+
+	// The LCD is the slowest thing we do, so it's the last thing the governor gives up
+
+	if (g_governor.AllowLcdRefresh() || HAL_Millis() - s_lastLcdRefresh >= LCD_SLOW_REFRESH_MS)
+	{
+		updateLcd();
+		s_lastLcdRefresh = HAL_Millis();
+	}
+
+	// A byte at most of any pattern upload's EEPROM writing
+
+	pLoader->Poll();
+
+	uint32_t passUs = HAL_StopwatchMicros();
+	BlackBoxPass(passUs);
+
+	if (g_governor.AddFrame(passUs))
+		reportGovernor();
+
+	HAL_TraceEnd("loop", "pass");
+}
+
+// EngineSnapshot
+//
+// Everything the loop carries from one pass to the next: the layers, the pattern and
+// its loader, the governor, the frame skipping and LCD bookkeeping, and the frame
+// being composed.  A host simulator keeps these at checkpoints so that it can seek
+// through a long drive without running it again from the start (Host/Snapshot.h adds
+// the HAL's side).  A snapshot can go back into any engine on the same build, such as
+// another thread's: the loader it holds is pointed at that engine's pattern.
+
+struct EngineSnapshot
+{
+	EngineLayers     layers;
+	bool             patternLoaded;
+	PatternLoader    loader;
+	OverloadGovernor governor;
+	uint8_t          lastInputs;
+	uint32_t         frameCount;
+	uint32_t         lastLcdRefresh;
+	uint8_t          drawnLayers;
+	uint32_t         frameStaleMs;
+	uint8_t          pixels[TOTAL_STRIP_PIXELS * BYTES_PER_PIXEL];
+
+	EngineSnapshot()
+		: loader(nullptr),
+		  governor(FRAME_BUDGET_US)
+	{
+	}
+};
+
+void snapshotEngine(EngineSnapshot & snapshot)
+{
+	captureLayers(snapshot.layers);
+	snapshot.patternLoaded  = pPattern->IsLoaded();
+	snapshot.loader         = *pLoader;
+	snapshot.governor       = g_governor;
+	snapshot.lastInputs     = s_lastInputs;
+	snapshot.frameCount     = s_frameCount;
+	snapshot.lastLcdRefresh = s_lastLcdRefresh;
+	snapshot.drawnLayers    = s_drawnLayers;
+	snapshot.frameStaleMs   = s_frameStaleMs;
+	memcpy(snapshot.pixels, pOutput->GetPixels(), pOutput->GetLength() * BYTES_PER_PIXEL);
+}
+
+// The pattern is loaded again from EEPROM rather than copied, so the EEPROM has to be
+// back the way it was first
+
+void restoreEngine(const EngineSnapshot & snapshot)
+{
+	if (snapshot.patternLoaded)
+		pPattern->Load();
+	else
+		pPattern->Unload();
+	restoreLayers(snapshot.layers);
+
+	*pLoader         = snapshot.loader;
+	pLoader->SetPattern(pPattern);
+	g_governor       = snapshot.governor;
+	s_lastInputs     = snapshot.lastInputs;
+	s_frameCount     = snapshot.frameCount;
+	s_lastLcdRefresh = snapshot.lastLcdRefresh;
+	s_drawnLayers    = snapshot.drawnLayers;
+	s_frameStaleMs   = snapshot.frameStaleMs;
+	memcpy(pOutput->GetPixels(), snapshot.pixels, pOutput->GetLength() * BYTES_PER_PIXEL);
+}
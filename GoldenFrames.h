@@ -0,0 +1,60 @@
+#pragma once
+#include <stdio.h>
+#include "Engine.h"
+#include "Host/DemoDrive.h"
+
+// GoldenFrames
+//
+// Renders the demo drive on a virtual clock, one frame per millisecond, and prints a
+// hash of every frame that differs from the one before it.  The firmware built with
+// GOLDEN_FRAMES (run under simavr) and Host/GoldenFrames.cpp run exactly this, so if
+// the two outputs are identical then every frame the host renders is bit for bit the
+// frame the ATmega would have shown.  Tools/golden_frames.sh builds both and diffs.
+//
+// Every line starts with "G " so it can be picked out of a simulator's other output.
+
+// FrameHash
+//
+// 32 bit FNV-1a of the frame's bytes
+
+static uint32_t FrameHash(const uint8_t * p, uint16_t cBytes, uint32_t hash = 2166136261UL)
+{
+	while (cBytes--)
+		hash = (hash ^ *p++) * 16777619UL;
+	return hash;
+}
+
+void runGoldenFrames()
+{
+	char     szBuf[40];
+	uint32_t now       = 0;
+	uint32_t lastHash  = 0;
+	uint32_t runHash   = 2166136261UL;
+	uint32_t cChanges  = 0;
+	uint16_t cBytes    = pOutput->GetLength() * BYTES_PER_PIXEL;
+
+	for (size_t step = 0; step < ARRAYSIZE(g_demoDrive); step++)
+	{
+		HAL_SetVirtualInputs(g_demoDrive[step].inputs);
+
+		for (uint32_t ms = 0; ms < g_demoDrive[step].durationMs; ms++, now++)
+		{
+			HAL_SetVirtualMillis(now);
+			processAndDisplayInputs();
+
+			uint32_t hash = FrameHash(pOutput->GetPixels(), cBytes);
+			runHash = FrameHash((const uint8_t *) &hash, sizeof(hash), runHash);
+
+			if (hash != lastHash || now == 0)
+			{
+				snprintf(szBuf, sizeof(szBuf), "G %lu %08lx", (unsigned long) now, (unsigned long) hash);
+				HAL_SerialPrintln(szBuf);
+				lastHash = hash;
+				cChanges++;
+			}
+		}
+	}
+
+	snprintf(szBuf, sizeof(szBuf), "G end %lu %lu %08lx", (unsigned long) now, (unsigned long) cChanges, (unsigned long) runHash);
+	HAL_SerialPrintln(szBuf);
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <stdint.h>
+
+// OverloadGovernor
+//
+// Watches how long each pass through the main loop takes, and when effects pile up
+// and frames start running over budget, gives up quality one stage at a time instead
+// of letting every animation slow down.  Each stage keeps the savings of the ones
+// before it:
+//
+//   QUALITY_FULL          Everything on
+//   QUALITY_HALF_RATE     Non-safety effects only redrawn every other frame
+//   QUALITY_NO_LCD        LCD only refreshed once a second
+//
+// No effect dithers or cross-fades yet, so there are no stages that give those up.
+// A stage that sheds nothing would only hold off the real savings while it waits out
+// its run of frames over budget; add one when some effect has something to give.
+//
+// Safety-critical events (braking and the turn signals) are never dropped to half
+// rate, and any change in the inputs is always drawn on the very next frame, so the
+// brake light comes on just as fast at every stage.
+//
+// It steps down after GOVERNOR_DOWN_FRAMES frames in a row over budget, or at once
+// when the engine's cost model says the layers just turned on can't fit (Admit()),
+// and back up after a run of frames comfortably (25%) under it.  That run starts at
+// GOVERNOR_UP_FRAMES and doubles each time stepping up immediately put us back over
+// budget, so a load that sits right on the edge doesn't make it flap.
+
+enum QUALITY_STAGE : uint8_t
+{
+	QUALITY_FULL = 0,
+	QUALITY_HALF_RATE,
+	QUALITY_NO_LCD,
+	QUALITY_STAGE_COUNT
+};
+
+#define GOVERNOR_DOWN_FRAMES     8
+#define GOVERNOR_UP_FRAMES       64
+#define GOVERNOR_MAX_UP_FRAMES   2048
+
+class OverloadGovernor
+{
+	uint32_t      _budgetUs;
+	uint32_t      _averageUs;						// Moving average of the last several frames
+	QUALITY_STAGE _stage;
+	bool          _lastWasUp;
+	uint16_t      _cOver;
+	uint16_t      _cUnder;
+	uint16_t      _upFrames;
+
+  public:
+
+	OverloadGovernor(uint32_t budgetUs)
+	{
+		_budgetUs  = budgetUs;
+		_averageUs = 0;
+		_stage     = QUALITY_FULL;
+		_lastWasUp = false;
+		_cOver     = 0;
+		_cUnder    = 0;
+		_upFrames  = GOVERNOR_UP_FRAMES;
+	}
+
+	QUALITY_STAGE GetStage()
+	{
+		return _stage;
+	}
+
+	uint32_t GetAverageFrameUs()
+	{
+		return _averageUs;
+	}
+
+	uint32_t GetBudgetUs()
+	{
+		return _budgetUs;
+	}
+
+	bool FullFrameRate()      { return _stage < QUALITY_HALF_RATE; }
+	bool AllowLcdRefresh()    { return _stage < QUALITY_NO_LCD;    }
+
+	// Admit
+	//
+	// Steps straight down to stage, if it isn't there already, because the load that's
+	// about to start is known not to fit at the stages above it.  Coming back up is
+	// left to the frames themselves, as always.  Returns true if that moved the
+	// governor to a different stage.
+
+	bool Admit(QUALITY_STAGE stage)
+	{
+		if (stage <= _stage)
+			return false;
+
+		_stage     = stage;
+		_lastWasUp = false;
+		_cOver     = 0;
+		_cUnder    = 0;
+		return true;
+	}
+
+	// AddFrame
+	//
+	// Records how long the frame just finished took.  Returns true if that moved the
+	// governor to a different stage.
+
+	bool AddFrame(uint32_t frameUs)
+	{
+		if (_averageUs == 0)
+			_averageUs = frameUs;
+		else
+			_averageUs = _averageUs - (_averageUs >> 3) + (frameUs >> 3);
+
+		if (_averageUs > _budgetUs)
+		{
+			_cUnder = 0;
+			if (++_cOver >= GOVERNOR_DOWN_FRAMES && _stage < QUALITY_STAGE_COUNT - 1)
+			{
+				if (_lastWasUp && _upFrames < GOVERNOR_MAX_UP_FRAMES)
+					_upFrames *= 2;
+
+				_stage     = (QUALITY_STAGE)(_stage + 1);
+				_lastWasUp = false;
+				_cOver     = 0;
+				return true;
+			}
+		}
+		else if (_averageUs < _budgetUs - _budgetUs / 4)
+		{
+			_cOver = 0;
+			if (++_cUnder >= _upFrames && _stage > QUALITY_FULL)
+			{
+				_stage     = (QUALITY_STAGE)(_stage - 1);
+				_lastWasUp = true;
+				_cUnder    = 0;
+				if (_stage == QUALITY_FULL)
+					_upFrames = GOVERNOR_UP_FRAMES;
+				return true;
+			}
+		}
+		else
+		{
+			_cOver  = 0;
+			_cUnder = 0;
+		}
+		return false;
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include "Config.h"
+
+// HAL
+//
+// The thin layer between the lighting engine and the board it runs on.  The engine
+// only ever talks to the hardware through these:
+//
+//   Time     HAL_Millis(), HAL_Micros(), HAL_Delay()
+//            HAL_StopwatchStart(), HAL_StopwatchMicros() - for timing work that may
+//            run with interrupts off, up to about a quarter second
+//   Inputs   HAL_InitInputs(), HAL_ReadInputs() - one snapshot of all four switches
+//   LEDs     HAL_CreateLEDOutput() - the platform's LEDOutput backend
+//   I2C      HAL_LcdInit(), HAL_LcdPrint() - the character LCD on the I2C bus
+//   Serial   HAL_SerialBegin(), HAL_SerialPrint(), HAL_SerialPrintln(), HAL_SerialRead()
+//   Memory   HAL_FreeMemory() - bytes between the heap and the stack, or -1 where
+//            the platform doesn't track it
+//   Flash    HAL_FLASH, HAL_ReadFlash(), HAL_ReadFlashByte() - constant tables kept
+//            in program memory instead of RAM, and copying out of them
+//   EEPROM   HAL_EepromRead(), HAL_EepromReady(), HAL_EepromWriteByte() - the
+//            HAL_EEPROM_SIZE bytes that survive a power cycle.  A byte takes about
+//            3.4ms to write, so writes are started one at a time and never waited on
+//   Resets   HAL_NOINIT, HAL_ResetCause(), HAL_WatchdogEnable(), HAL_WatchdogReset() -
+//            RAM that startup doesn't clear, so it survives anything short of a power
+//            cycle; why the board last reset, as RESET_ bits; and a watchdog that
+//            resets the board if it isn't reset itself every HAL_WATCHDOG_MS
+//   Tracing  HAL_TraceBegin(), HAL_TraceEnd(), HAL_TraceInstant() - mark spans of work
+//            and moments on a timeline, by track.  Only the host records them (see
+//            Host/ChromeTrace.h); elsewhere they compile to nothing
+//   Threads  HAL_THREAD_LOCAL - what the engine's own state is declared with.  The
+//            host gives each thread an engine of its own, so a tool can run several
+//            side by side; a board only ever has the one
+//
+// Backends:
+//
+//   HAL_AVR.h      The real thing: Arduino on an ATmega328P
+//   HAL_Host.h     A desktop build with a virtual clock and simulated switches
+//   HAL_CortexM.h  A bare-metal Cortex-M3 build meant to be run under QEMU
+//
+// The Arduino IDE defines ARDUINO, which selects the AVR backend.  Anything built
+// without it is the host, unless it asks for HAL_CORTEXM.
+//
+// Builds that run on a virtual clock (the host always does; the AVR does when built
+// with HAL_VIRTUAL_CLOCK) also provide HAL_SetVirtualMillis() and
+// HAL_SetVirtualInputs(), so that a driver can step every platform through exactly
+// the same sequence of times and switch states.
+
+#define INPUT_LEFT_TURN   0x01						// Bits returned by HAL_ReadInputs().  A set bit means
+#define INPUT_RIGHT_TURN  0x02						//   the switch is on (the pin is pulled low)
+#define INPUT_STOP        0x04
+#define INPUT_BACKUP      0x08
+
+#define HAL_EEPROM_SIZE   1024						// The 328P's; the other backends have the same
+
+#define RESET_POWER_ON    0x01						// Bits returned by HAL_ResetCause(), the same as the
+#define RESET_EXTERNAL    0x02						//   328P's MCUSR.  More than one can be set.
+#define RESET_BROWN_OUT   0x04
+#define RESET_WATCHDOG    0x08
+
+#define HAL_WATCHDOG_MS   250
+
+#if defined(HAL_CORTEXM)
+#include "HAL_CortexM.h"
+#elif defined(ARDUINO) && defined(__AVR__)
+#include "HAL_AVR.h"
+#elif !defined(ARDUINO)
+#include "HAL_Host.h"
+#else
+#error No HAL backend for this board
+#endif
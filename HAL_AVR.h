@@ -0,0 +1,253 @@
+#pragma once
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include <avr/power.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <Wire.h>
+#include <LiquidCrystal_I2C.h>
+#include "LEDOutput.h"
+
+// HAL_AVR
+//
+// Arduino on the ATmega328P.  The switches are all on PORTD, so one read of PIND
+// captures all four at the same instant.
+//
+// Built with HAL_VIRTUAL_CLOCK, time and the switches come from variables that a test
+// driver sets instead of from the hardware, and the LCD is left alone (there isn't
+// one under a simulator like simavr).
+
+static_assert(LEFT_TURN_PIN < 8 && RIGHT_TURN_PIN < 8 && STOP_PIN < 8 && BACKUP_PIN < 8, "Input pins must all be on PORTD");
+
+static LiquidCrystal_I2C s_lcd(LCD_I2C_ADDRESS, LCD_WIDTH, LCD_HEIGHT);
+
+#ifdef HAL_VIRTUAL_CLOCK
+
+static uint32_t s_virtualMillis;
+static uint8_t  s_virtualInputs;
+
+static inline void HAL_SetVirtualMillis(uint32_t ms)
+{
+	s_virtualMillis = ms;
+}
+
+static inline void HAL_SetVirtualInputs(uint8_t inputs)
+{
+	s_virtualInputs = inputs;
+}
+
+static inline uint32_t HAL_Millis()
+{
+	return s_virtualMillis;
+}
+
+static inline uint32_t HAL_Micros()
+{
+	return s_virtualMillis * 1000;
+}
+
+#else
+
+static inline uint32_t HAL_Millis()
+{
+	return millis();
+}
+
+static inline uint32_t HAL_Micros()
+{
+	return micros();
+}
+
+#endif
+
+static inline void HAL_Delay(uint32_t ms)
+{
+	delay(ms);
+}
+
+// The LED drivers run with interrupts off, during which micros() stops keeping time,
+// so the stopwatch is Timer1 instead: it counts in hardware regardless.  At clk/64 it
+// ticks every 4us and wraps after 262ms.
+
+static inline void HAL_StopwatchStart()
+{
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11) | _BV(CS10);
+	TCNT1  = 0;
+}
+
+static inline uint32_t HAL_StopwatchMicros()
+{
+	return (uint32_t) TCNT1 * 4;
+}
+
+// What's left between the top of the heap and the stack.  The frame buffer is on the
+// heap, so this is what a longer strip has to come out of.
+
+extern char   __heap_start;
+extern char * __brkval;
+
+static inline int HAL_FreeMemory()
+{
+	char top;
+	return &top - (__brkval ? __brkval : &__heap_start);
+}
+
+// Without PROGMEM a const table is copied into RAM at startup, and the 328P only has
+// 2K of it.  PROGMEM leaves it in flash, where it has to be read with memcpy_P().
+
+#define HAL_FLASH PROGMEM
+
+static inline void HAL_ReadFlash(void * pDest, const void * pFlash, size_t cb)
+{
+	memcpy_P(pDest, pFlash, cb);
+}
+
+static inline uint8_t HAL_ReadFlashByte(const uint8_t * pFlash)	// One LPM, for tables read a byte at a time
+{
+	return pgm_read_byte(pFlash);
+}
+
+// Startup zeroes .bss and copies .data, but leaves .noinit alone
+
+#define HAL_NOINIT __attribute__((section(".noinit")))
+
+// MCUSR has to be read, and the watchdog stopped, before anything else runs: after a
+// watchdog reset the watchdog stays on at its shortest timeout and would reset the
+// board again long before setup().  So this runs from .init3, ahead of the C runtime's
+// own startup.  Optiboot clears MCUSR before it starts the sketch, but newer versions
+// leave what it held in r2, which is used instead when MCUSR reads 0.
+
+static uint8_t s_resetCause HAL_NOINIT;
+
+extern "C" void HAL_CaptureResetCause() __attribute__((naked, used, section(".init3")));
+extern "C" void HAL_CaptureResetCause()
+{
+	uint8_t r2;
+	asm volatile("mov %0, r2" : "=r" (r2));
+	s_resetCause = (MCUSR ? MCUSR : r2) & (RESET_POWER_ON | RESET_EXTERNAL | RESET_BROWN_OUT | RESET_WATCHDOG);
+	MCUSR = 0;
+	wdt_disable();
+}
+
+static inline uint8_t HAL_ResetCause()
+{
+	return s_resetCause;
+}
+
+static_assert(HAL_WATCHDOG_MS == 250, "HAL_WatchdogEnable() only knows 250ms");
+
+static inline void HAL_WatchdogEnable()
+{
+	wdt_enable(WDTO_250MS);
+}
+
+static inline void HAL_WatchdogReset()
+{
+	wdt_reset();
+}
+
+// One engine, on one core
+
+#define HAL_THREAD_LOCAL
+
+// Nothing here records a timeline
+
+static inline void HAL_TraceBegin(const char *, const char *, int = -1)
+{
+}
+
+static inline void HAL_TraceEnd(const char *, const char *)
+{
+}
+
+static inline void HAL_TraceInstant(const char *, const char *, int = -1)
+{
+}
+
+static inline void HAL_InitInputs()
+{
+	pinMode(LEFT_TURN_PIN, INPUT_PULLUP);
+	pinMode(RIGHT_TURN_PIN, INPUT_PULLUP);
+	pinMode(STOP_PIN, INPUT_PULLUP);
+	pinMode(BACKUP_PIN, INPUT_PULLUP);
+}
+
+static inline uint8_t HAL_ReadInputs()
+{
+#ifdef HAL_VIRTUAL_CLOCK
+	return s_virtualInputs;
+#else
+	uint8_t pins   = ~PIND;								// Switches pull low when on
+	uint8_t inputs = 0;
+
+	if (pins & _BV(LEFT_TURN_PIN))  inputs |= INPUT_LEFT_TURN;
+	if (pins & _BV(RIGHT_TURN_PIN)) inputs |= INPUT_RIGHT_TURN;
+	if (pins & _BV(STOP_PIN))       inputs |= INPUT_STOP;
+	if (pins & _BV(BACKUP_PIN))     inputs |= INPUT_BACKUP;
+	return inputs;
+#endif
+}
+
+// The board always draws its frames
+
+static inline bool HAL_DrawLayers()
+{
+	return true;
+}
+
+static inline LEDOutput * HAL_CreateLEDOutput(uint16_t cPixels)
+{
+	return new NeoPixelOutput(cPixels, PIN);
+}
+
+static inline void HAL_LcdInit()
+{
+#ifndef HAL_VIRTUAL_CLOCK
+	s_lcd.init();
+	s_lcd.backlight();
+#endif
+}
+
+static inline void HAL_LcdPrint(uint8_t row, const char * psz)
+{
+#ifndef HAL_VIRTUAL_CLOCK
+	s_lcd.setCursor(0, row);
+	s_lcd.print(psz);
+#endif
+}
+
+static inline void HAL_SerialBegin(unsigned long baud)
+{
+	Serial.begin(baud);
+}
+
+static inline void HAL_SerialPrint(const char * psz)
+{
+	Serial.print(psz);
+}
+
+static inline void HAL_SerialPrintln(const char * psz)
+{
+	Serial.println(psz);
+}
+
+static inline int HAL_SerialRead()					// Next byte received, or -1 if none is waiting
+{
+	return Serial.read();
+}
+
+static inline void HAL_EepromRead(uint16_t addr, void * pDest, uint16_t cb)
+{
+	eeprom_read_block(pDest, (const void *)(uintptr_t) addr, cb);
+}
+
+static inline bool HAL_EepromReady()					// True when a write can start without waiting
+{
+	return eeprom_is_ready();
+}
+
+static inline void HAL_EepromWriteByte(uint16_t addr, uint8_t value)
+{
+	eeprom_update_byte((uint8_t *)(uintptr_t) addr, value);	// Starts the write and returns; skips it if unchanged
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "LEDOutput.h"
+
+// HAL_CortexM
+//
+// Bare-metal Cortex-M3 with no vendor libraries, written against the MPS2-AN385
+// board that QEMU emulates (qemu-system-arm -M mps2-an385).  The only peripherals
+// used are the ones every Cortex-M has, so it should come up on real silicon too:
+//
+//   Time     SysTick, interrupting once per millisecond
+//   Inputs   A variable the test driver sets; there are no switches to read
+//   LEDs     CaptureOutput, since there is no strip attached
+//   I2C/LCD  Accepted and thrown away
+//   Serial   ARM semihosting, which QEMU prints to its console with -semihosting
+//
+// QEMU is not cycle accurate, but run with -icount shift=0 it advances virtual time
+// by exactly 1ns per instruction executed, so HAL_Micros() measures instructions.
+
+using std::min;
+using std::max;
+
+#define CORTEXM_CLOCK_HZ 25000000UL					// MPS2-AN385 system clock
+
+#define SYST_CSR (*(volatile uint32_t *) 0xE000E010)
+#define SYST_RVR (*(volatile uint32_t *) 0xE000E014)
+#define SYST_CVR (*(volatile uint32_t *) 0xE000E018)
+
+#define SEMIHOST_SYS_WRITE0 0x04
+#define SEMIHOST_SYS_READC  0x07
+#define SEMIHOST_SYS_EXIT   0x18
+
+static volatile uint32_t s_cortexMillis;
+static volatile uint8_t  s_cortexInputs;
+static uint8_t           s_cortexEeprom[HAL_EEPROM_SIZE];	// There is no EEPROM; this lasts until reset
+static uint32_t          s_cortexStopwatch;
+
+extern "C" void SysTick_Handler()
+{
+	s_cortexMillis++;
+}
+
+static inline int Semihost(int op, const void * pArg)
+{
+	register int          r0 asm("r0") = op;
+	register const void * r1 asm("r1") = pArg;
+	asm volatile("bkpt 0xAB" : "+r" (r0) : "r" (r1) : "memory");
+	return r0;
+}
+
+static inline void HAL_CortexInit()
+{
+	SYST_RVR = CORTEXM_CLOCK_HZ / 1000 - 1;
+	SYST_CVR = 0;
+	SYST_CSR = 0x7;									// Processor clock, interrupt, enable
+	memset(s_cortexEeprom, 0xFF, sizeof(s_cortexEeprom));
+}
+
+static inline void HAL_CortexSetInputs(uint8_t inputs)
+{
+	s_cortexInputs = inputs;
+}
+
+static inline void HAL_CortexExit()					// Ends the QEMU session
+{
+	Semihost(SEMIHOST_SYS_EXIT, (const void *) 0x20026);	// ADP_Stopped_ApplicationExit
+}
+
+static inline uint32_t HAL_Millis()
+{
+	return s_cortexMillis;
+}
+
+static inline uint32_t HAL_Micros()
+{
+	uint32_t ms, count;
+	do
+	{
+		ms    = s_cortexMillis;
+		count = SYST_CVR;
+	} while (ms != s_cortexMillis);					// Retry if the tick fired in between
+
+	return ms * 1000 + (SYST_RVR - count) / (CORTEXM_CLOCK_HZ / 1000000);
+}
+
+static inline void HAL_Delay(uint32_t ms)
+{
+	uint32_t start = HAL_Millis();
+	while (HAL_Millis() - start < ms)
+		asm volatile("wfi");
+}
+
+static inline void HAL_StopwatchStart()
+{
+	s_cortexStopwatch = HAL_Micros();
+}
+
+static inline uint32_t HAL_StopwatchMicros()
+{
+	return HAL_Micros() - s_cortexStopwatch;
+}
+
+// Const data already stays in flash, and flash is in the same address space as RAM
+
+#define HAL_FLASH
+
+static inline void HAL_ReadFlash(void * pDest, const void * pFlash, size_t cb)
+{
+	memcpy(pDest, pFlash, cb);
+}
+
+static inline uint8_t HAL_ReadFlashByte(const uint8_t * pFlash)
+{
+	return *pFlash;
+}
+
+// QEMU starts every run from a fresh power-on, and there's no watchdog on the board
+
+#define HAL_NOINIT
+
+static inline uint8_t HAL_ResetCause()
+{
+	return RESET_POWER_ON;
+}
+
+static inline void HAL_WatchdogEnable()
+{
+}
+
+static inline void HAL_WatchdogReset()
+{
+}
+
+// One engine, on one core
+
+#define HAL_THREAD_LOCAL
+
+// Nothing here records a timeline
+
+static inline void HAL_TraceBegin(const char *, const char *, int = -1)
+{
+}
+
+static inline void HAL_TraceEnd(const char *, const char *)
+{
+}
+
+static inline void HAL_TraceInstant(const char *, const char *, int = -1)
+{
+}
+
+static inline int HAL_FreeMemory()
+{
+	return -1;
+}
+
+static inline void HAL_InitInputs()
+{
+}
+
+static inline uint8_t HAL_ReadInputs()
+{
+	return s_cortexInputs;
+}
+
+// The board always draws its frames
+
+static inline bool HAL_DrawLayers()
+{
+	return true;
+}
+
+static inline LEDOutput * HAL_CreateLEDOutput(uint16_t cPixels)
+{
+	return new CaptureOutput(cPixels);
+}
+
+static inline void HAL_LcdInit()
+{
+}
+
+static inline void HAL_LcdPrint(uint8_t, const char *)
+{
+}
+
+static inline void HAL_SerialBegin(unsigned long)
+{
+}
+
+static inline void HAL_SerialPrint(const char * psz)
+{
+	Semihost(SEMIHOST_SYS_WRITE0, psz);
+}
+
+static inline void HAL_SerialPrintln(const char * psz)
+{
+	Semihost(SEMIHOST_SYS_WRITE0, psz);
+	Semihost(SEMIHOST_SYS_WRITE0, "\n");
+}
+
+static inline int HAL_SerialRead()
+{
+	return -1;
+}
+
+static inline void HAL_EepromRead(uint16_t addr, void * pDest, uint16_t cb)
+{
+	memcpy(pDest, s_cortexEeprom + addr, cb);
+}
+
+static inline bool HAL_EepromReady()
+{
+	return true;
+}
+
+static inline void HAL_EepromWriteByte(uint16_t addr, uint8_t value)
+{
+	s_cortexEeprom[addr] = value;
+}
@@ -0,0 +1,418 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#ifdef HAL_HOST_WALL_STOPWATCH
+#include <chrono>
+#endif
+#ifdef HAL_HOST_RENDER_MODEL
+#include "LayerBlend.h"
+
+static inline void HAL_HostRenderSpan(uint16_t cPixels, BLEND_MODE mode);
+static inline void HAL_HostRenderClear(uint16_t cBytes);
+
+#define LED_RENDER_SPAN(cPixels, mode) HAL_HostRenderSpan(cPixels, mode)
+#define LED_RENDER_CLEAR(cBytes)       HAL_HostRenderClear(cBytes)
+#endif
+#include "LEDOutput.h"
+
+// HAL_Host
+//
+// Runs the engine on a desktop machine against a virtual clock.  Nothing here ever
+// waits: time only moves when the simulator advances it, or when the engine does
+// something that would take time on the real board, in which case the clock is
+// charged what that operation costs there.  So a simulated second of driving takes
+// as long as it takes to compute, and timing comes out the same on every run.
+//
+// The simulator drives the switches with HAL_HostSetInputs() and can read back the
+// LED frames and LCD text that the engine produced.
+//
+// A simulator can also have a timeline of the engine's work traced on the virtual
+// clock: HAL_HostSetTrace() hands every HAL_Trace call to a function that records
+// it (Host/ChromeTrace.h writes them out for a trace viewer).
+//
+// Define HAL_HOST_WALL_STOPWATCH to have the stopwatch measure real elapsed time on
+// this machine instead, for benchmarking what the host itself spends.
+//
+// Define HAL_HOST_RENDER_MODEL to also charge for drawing into the frame buffer: the
+// ATmega328P cycles that each span costs to set up and each pixel costs to blend, by
+// blend mode, and each byte costs to clear.  The figures are counted from what
+// avr-gcc makes of LayerBlend.h's loops, not measured, and they leave out the effects'
+// own arithmetic between spans.  It's off by default, so that the simulator's timing
+// stays what the golden frames and scenarios were written against.
+
+using std::min;
+using std::max;
+
+#define HOST_US_PER_PIXEL    30						// WS2812 wire time: 24 bits at 800KHz
+#define HOST_US_LATCH        50						// Reset/latch gap after each frame
+#define HOST_US_PER_LCD_CHAR 1100					// LiquidCrystal_I2C at 100KHz: six two-byte transfers per character
+#define HOST_US_PER_EEPROM   3400					// Each EEPROM byte written keeps the EEPROM busy this long
+#define HOST_SERIAL_RX_BYTES 64						// The Arduino core's receive buffer; bytes past it are lost
+
+#define HOST_CYCLES_PER_US         16				// ATmega328P at 16MHz
+#define HOST_CYCLES_PER_SPAN       120				// FillSpan's clipping, the color unpacked, the blend set up
+#define HOST_CYCLES_PER_CLEAR_BYTE 6				// avr-libc's memset
+
+struct HostState
+{
+	uint64_t micros;
+	uint64_t stopwatchStart;
+	uint8_t  inputs;
+	uint8_t  resetCause;
+	char     lcd[LCD_HEIGHT][LCD_WIDTH + 1];
+	uint8_t  eeprom[HAL_EEPROM_SIZE];
+	uint64_t eepromBusyUntil;
+	uint8_t  serialRx[HOST_SERIAL_RX_BYTES];
+	uint16_t serialRxHead;
+	uint16_t cSerialRx;
+	uint32_t renderCycles;							// Render cycles charged that don't yet make a whole microsecond
+};
+
+typedef void (*HostTraceFn)(char phase, const char * pszTrack, const char * pszName, int arg, uint64_t us);
+
+static thread_local HostState   s_host;				// Per thread, so each thread can run its own simulation
+static FILE *                   s_hostSerial;		// Where serial output goes; nullptr means stdout
+static thread_local HostTraceFn s_hostTrace;		// Where trace events go; nullptr means nowhere
+static thread_local bool        s_hostDrawing = true;	// Whether the engine draws its layers into frames
+
+// Tracing.  phase is Chrome's: 'B' begins a span on the track, 'E' ends the latest one,
+// 'i' is a moment.  arg is a number to show with the event, or -1 for none.  The
+// simulator can add its own events with HAL_HostTrace(), at any time it likes.
+
+static inline void HAL_HostSetTrace(HostTraceFn pfnTrace)
+{
+	s_hostTrace = pfnTrace;
+}
+
+static inline void HAL_HostTrace(char phase, const char * pszTrack, const char * pszName, int arg, uint64_t us)
+{
+	if (s_hostTrace)
+		s_hostTrace(phase, pszTrack, pszName, arg, us);
+}
+
+static inline void HAL_TraceBegin(const char * pszTrack, const char * pszName, int arg = -1)
+{
+	HAL_HostTrace('B', pszTrack, pszName, arg, s_host.micros);
+}
+
+static inline void HAL_TraceEnd(const char * pszTrack, const char * pszName)
+{
+	HAL_HostTrace('E', pszTrack, pszName, -1, s_host.micros);
+}
+
+static inline void HAL_TraceInstant(const char * pszTrack, const char * pszName, int arg = -1)
+{
+	HAL_HostTrace('i', pszTrack, pszName, arg, s_host.micros);
+}
+
+static inline void HAL_HostReset()
+{
+	memset(&s_host, 0, sizeof(s_host));
+	memset(s_host.eeprom, 0xFF, sizeof(s_host.eeprom));		// As it comes from the factory
+	s_host.resetCause = RESET_POWER_ON;
+}
+
+static inline void HAL_HostAdvanceMicros(uint64_t us)
+{
+	s_host.micros += us;
+}
+
+#ifdef HAL_HOST_RENDER_MODEL
+
+// Cycles per pixel for each BLEND_MODE: three stores, three compares, three saturating
+// adds, and three 8x16 multiplies, plus the loop around them
+
+static const uint8_t s_hostBlendCycles[] = { 12, 25, 32, 50 };
+
+static inline void HAL_HostChargeCycles(uint32_t cycles)
+{
+	cycles += s_host.renderCycles;
+	HAL_HostAdvanceMicros(cycles / HOST_CYCLES_PER_US);
+	s_host.renderCycles = cycles % HOST_CYCLES_PER_US;
+}
+
+static inline void HAL_HostRenderSpan(uint16_t cPixels, BLEND_MODE mode)
+{
+	HAL_HostChargeCycles(HOST_CYCLES_PER_SPAN + (uint32_t) cPixels * s_hostBlendCycles[mode]);
+}
+
+static inline void HAL_HostRenderClear(uint16_t cBytes)
+{
+	HAL_HostChargeCycles((uint32_t) cBytes * HOST_CYCLES_PER_CLEAR_BYTE);
+}
+
+#endif
+
+static inline uint64_t HAL_HostGetMicros()			// Full 64 bit virtual time, for the simulator
+{
+	return s_host.micros;
+}
+
+static inline void HAL_HostSetInputs(uint8_t inputs)
+{
+	s_host.inputs = inputs;
+}
+
+static inline const char * HAL_HostGetLcdRow(uint8_t row)
+{
+	return s_host.lcd[row];
+}
+
+static inline void HAL_HostSetSerialOutput(FILE * pFile)
+{
+	s_hostSerial = pFile;
+}
+
+// HAL_HostSerialInput
+//
+// Delivers bytes to the serial port as though they'd just arrived.  Like the real
+// receive buffer it holds HOST_SERIAL_RX_BYTES; returns how many fit, and the rest are
+// the sender's to try again.
+
+static inline size_t HAL_HostSerialInput(const uint8_t * pData, size_t cb)
+{
+	size_t cAccepted = min(cb, (size_t)(HOST_SERIAL_RX_BYTES - s_host.cSerialRx));
+	for (size_t i = 0; i < cAccepted; i++)
+		s_host.serialRx[(s_host.serialRxHead + s_host.cSerialRx++) % HOST_SERIAL_RX_BYTES] = pData[i];
+	return cAccepted;
+}
+
+static inline uint8_t * HAL_HostGetEeprom()
+{
+	return s_host.eeprom;
+}
+
+static inline void HAL_HostSaveState(HostState & state)		// The whole simulated board, for a snapshot
+{
+	state = s_host;
+}
+
+static inline void HAL_HostLoadState(const HostState & state)
+{
+	s_host = state;
+}
+
+static inline void HAL_HostSetResetCause(uint8_t cause)		// What the next setupEngine() is told
+{
+	s_host.resetCause = cause;
+}
+
+// Setting the clock isn't work done, so the stopwatch doesn't see the jump, just as
+// the AVR's hardware stopwatch doesn't
+
+static inline void HAL_SetVirtualMillis(uint32_t ms)
+{
+	uint64_t us = (uint64_t) ms * 1000;
+#ifndef HAL_HOST_WALL_STOPWATCH
+	s_host.stopwatchStart += us - s_host.micros;
+#endif
+	s_host.micros = us;
+}
+
+static inline void HAL_SetVirtualInputs(uint8_t inputs)
+{
+	s_host.inputs = inputs;
+}
+
+static inline uint32_t HAL_Millis()
+{
+	return (uint32_t)(s_host.micros / 1000);
+}
+
+static inline uint32_t HAL_Micros()
+{
+	return (uint32_t) s_host.micros;
+}
+
+static inline void HAL_Delay(uint32_t ms)
+{
+	HAL_TraceBegin("loop", "delay");
+	s_host.micros += (uint64_t) ms * 1000;
+	HAL_TraceEnd("loop", "delay");
+}
+
+#ifdef HAL_HOST_WALL_STOPWATCH
+
+static inline uint64_t HostWallMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void HAL_StopwatchStart()
+{
+	s_host.stopwatchStart = HostWallMicros();
+}
+
+static inline uint32_t HAL_StopwatchMicros()
+{
+	return (uint32_t)(HostWallMicros() - s_host.stopwatchStart);
+}
+
+#else
+
+static inline void HAL_StopwatchStart()
+{
+	s_host.stopwatchStart = s_host.micros;
+}
+
+static inline uint32_t HAL_StopwatchMicros()
+{
+	return (uint32_t)(s_host.micros - s_host.stopwatchStart);
+}
+
+#endif
+
+// Constant data is in the same address space as everything else
+
+#define HAL_FLASH
+
+static inline void HAL_ReadFlash(void * pDest, const void * pFlash, size_t cb)
+{
+	memcpy(pDest, pFlash, cb);
+}
+
+static inline uint8_t HAL_ReadFlashByte(const uint8_t * pFlash)
+{
+	return *pFlash;
+}
+
+// Nothing here is ever really reset, so all of memory survives, and the watchdog
+// never fires
+
+#define HAL_NOINIT
+
+// Like the virtual clock, the engine's globals are per thread, so each thread that
+// calls setupEngine() has an engine of its own
+
+#define HAL_THREAD_LOCAL thread_local
+
+static inline uint8_t HAL_ResetCause()
+{
+	return s_host.resetCause;
+}
+
+static inline void HAL_WatchdogEnable()
+{
+}
+
+static inline void HAL_WatchdogReset()
+{
+}
+
+static inline int HAL_FreeMemory()
+{
+	return -1;
+}
+
+static inline void HAL_InitInputs()
+{
+}
+
+static inline uint8_t HAL_ReadInputs()
+{
+	return s_host.inputs;
+}
+
+// A simulator that only wants the engine's decisions, and not the frames themselves,
+// can turn drawing off: every pass still runs and still commits, so the clock, the
+// governor and the frame skipping go exactly as they would, but no layer draws into
+// the frame.  Not under HAL_HOST_RENDER_MODEL, where drawing takes clock time.
+
+static inline void HAL_HostSetDrawing(bool drawing)
+{
+	s_hostDrawing = drawing;
+}
+
+static inline bool HAL_DrawLayers()
+{
+	return s_hostDrawing;
+}
+
+// HostLEDOutput
+//
+// Captures frames like CaptureOutput, but also charges the virtual clock for the time
+// the real strip takes to clock them out.
+
+class HostLEDOutput : public CaptureOutput
+{
+  public:
+
+	HostLEDOutput(uint16_t cPixels)
+		: CaptureOutput(cPixels)
+	{
+	}
+
+	virtual void Commit() override
+	{
+		HAL_TraceBegin("strip", "show", _cPixels);
+		CaptureOutput::Commit();
+		HAL_HostAdvanceMicros((uint64_t) _cPixels * HOST_US_PER_PIXEL + HOST_US_LATCH);
+		HAL_TraceEnd("strip", "show");
+	}
+};
+
+static inline LEDOutput * HAL_CreateLEDOutput(uint16_t cPixels)
+{
+	return new HostLEDOutput(cPixels);
+}
+
+static inline void HAL_LcdInit()
+{
+}
+
+static inline void HAL_LcdPrint(uint8_t row, const char * psz)
+{
+	size_t cch = min(strlen(psz), (size_t) LCD_WIDTH);
+	HAL_TraceBegin("lcd", "print", (int) cch);
+	memcpy(s_host.lcd[row], psz, cch);
+	s_host.lcd[row][cch] = '\0';
+	HAL_HostAdvanceMicros((uint64_t)(cch + 1) * HOST_US_PER_LCD_CHAR);		// +1 for setCursor
+	HAL_TraceEnd("lcd", "print");
+}
+
+static inline void HAL_SerialBegin(unsigned long)
+{
+}
+
+static inline void HAL_SerialPrint(const char * psz)
+{
+	fputs(psz, s_hostSerial ? s_hostSerial : stdout);
+}
+
+static inline void HAL_SerialPrintln(const char * psz)
+{
+	FILE * pFile = s_hostSerial ? s_hostSerial : stdout;
+	fputs(psz, pFile);
+	fputc('\n', pFile);
+}
+
+static inline int HAL_SerialRead()
+{
+	if (s_host.cSerialRx == 0)
+		return -1;
+
+	uint8_t b = s_host.serialRx[s_host.serialRxHead];
+	s_host.serialRxHead = (s_host.serialRxHead + 1) % HOST_SERIAL_RX_BYTES;
+	s_host.cSerialRx--;
+	return b;
+}
+
+static inline void HAL_EepromRead(uint16_t addr, void * pDest, uint16_t cb)
+{
+	memcpy(pDest, s_host.eeprom + addr, cb);
+}
+
+static inline bool HAL_EepromReady()
+{
+	return s_host.micros >= s_host.eepromBusyUntil;
+}
+
+static inline void HAL_EepromWriteByte(uint16_t addr, uint8_t value)
+{
+	if (s_host.eeprom[addr] == value)
+		return;
+	s_host.eeprom[addr]    = value;
+	s_host.eepromBusyUntil = s_host.micros + HOST_US_PER_EEPROM;
+}
@@ -0,0 +1,166 @@
+//+--------------------------------------------------------------------------
+//
+// BlackBoxDecode - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        BlackBoxDecode.cpp
+//
+// Description:
+//
+//   Turns black box dumps (see BlackBox.h) into a timeline.  Hand it the
+//   serial log captured after sending the dump command; everything that
+//   isn't a BB line is ignored, and every dump in the log is decoded.
+//
+//   The records only carry the low 16 bits of the millisecond clock, so
+//   times are rebuilt from the gaps between records, assuming none is over
+//   65 seconds.  Each BOOT record starts a new run, whose clock started
+//   again from zero.  A watchdog reset is followed by when the run before it
+//   was last seen, which is about where it hung.
+//
+//   Usage:  blackboxdecode [file.log]          (standard input if no file)
+//
+//   Build:  g++ -std=gnu++11 -O2 -o blackboxdecode BlackBoxDecode.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../BlackBox.h"
+
+// The layers in z-order, the order of pLayers in Engine.h
+
+static const char * s_layerNames[] = { "backup", "pattern", "brake", "left", "right", "hazard", "police", "sparkle" };
+
+static std::string InputNames(uint8_t inputs)
+{
+	static const char * s_names[] = { "LEFT", "RIGHT", "STOP", "BACKUP" };
+
+	std::string text;
+	for (int bit = 0; bit < 4; bit++)
+		if (inputs & (1 << bit))
+			text += std::string(text.empty() ? "" : " ") + s_names[bit];
+	return text.empty() ? "none" : text;
+}
+
+static std::string LayerNames(uint8_t layers)
+{
+	std::string text;
+	for (size_t bit = 0; bit < 8; bit++)
+	{
+		if (layers & (1 << bit))
+		{
+			text += text.empty() ? "" : " ";
+			text += bit < sizeof(s_layerNames) / sizeof(*s_layerNames) ? s_layerNames[bit] : "?";
+		}
+	}
+	return text.empty() ? "none" : text;
+}
+
+static std::string ResetNames(uint8_t cause)
+{
+	static const char * s_names[] = { "power-on", "reset pin", "brown-out", "WATCHDOG" };
+
+	std::string text;
+	for (int bit = 0; bit < 4; bit++)
+		if (cause & (1 << bit))
+			text += std::string(text.empty() ? "" : ", ") + s_names[bit];
+	return text.empty() ? "unknown (the bootloader cleared it)" : text;
+}
+
+static void Decode(const std::vector<BlackBoxRecord> & records)
+{
+	uint64_t ms       = 0;
+	uint16_t lastRaw  = 0;
+	int      run      = 0;
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		const BlackBoxRecord & record = records[i];
+
+		if (record.kind == BB_BOOT)
+		{
+			if (i > 0 && (record.value & RESET_WATCHDOG))
+				printf("  -- the watchdog fired: the loop was last seen at %.3fs, and hung within %ums of that\n",
+					   ms / 1000.0, (unsigned) HAL_WATCHDOG_MS);
+			ms = record.ms;
+			printf("  run %d\n", ++run);
+		}
+		else if (i == 0)
+		{
+			ms = record.ms;
+			printf("  run ? (began before the oldest record)\n");
+		}
+		else
+		{
+			ms += (uint16_t)(record.ms - lastRaw);
+		}
+		lastRaw = record.ms;
+
+		printf("    %9.3fs  ", ms / 1000.0);
+		switch (record.kind)
+		{
+			case BB_BOOT:        printf("boot      reset by %s\n", ResetNames(record.value).c_str()); break;
+			case BB_INPUTS:      printf("inputs    %s\n", InputNames(record.value).c_str()); break;
+			case BB_LATE_INPUTS: printf("inputs    %s (latched late, just before a commit)\n", InputNames(record.value).c_str()); break;
+			case BB_LAYERS:      printf("layers    %s\n", LayerNames(record.value).c_str()); break;
+			case BB_PASS:
+				printf("loop      ran until here, slowest pass %s%.1fms%s\n", record.value == 255 ? ">= " : "<= ",
+					   record.value * BLACK_BOX_PASS_UNIT_US / 1000.0,
+					   record.value * BLACK_BOX_PASS_UNIT_US > FRAME_BUDGET_US ? "  OVER BUDGET" : "");
+				break;
+			default:             printf("unknown   kind %u value %02x\n", (unsigned) record.kind, (unsigned) record.value); break;
+		}
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	FILE * pFile = argc > 1 ? fopen(argv[1], "r") : stdin;
+	if (!pFile)
+	{
+		fprintf(stderr, "can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	char                        szLine[256];
+	std::vector<BlackBoxRecord> records;
+	bool                        inDump = false;
+	int                         cDumps = 0;
+
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		unsigned a, b, c;
+		if (sscanf(szLine, "BB reset %x %u", &a, &b) == 2)
+		{
+			printf("board reset by %s, %u records kept\n", ResetNames((uint8_t) a).c_str(), b);
+		}
+		else if (sscanf(szLine, "BB begin %u", &a) == 1)
+		{
+			records.clear();
+			inDump = true;
+		}
+		else if (!strncmp(szLine, "BB end", 6) && inDump)
+		{
+			printf("dump %d: %zu records, oldest first\n", ++cDumps, records.size());
+			Decode(records);
+			inDump = false;
+		}
+		else if (inDump && sscanf(szLine, "BB %x %x %x", &a, &b, &c) == 3)
+		{
+			BlackBoxRecord record = { (uint16_t) a, (uint8_t) b, (uint8_t) c };
+			records.push_back(record);
+		}
+	}
+	if (pFile != stdin)
+		fclose(pFile);
+
+	if (inDump)
+		fprintf(stderr, "the last dump was cut off after %zu records\n", records.size());
+	if (cDumps == 0)
+	{
+		fprintf(stderr, "no black box dumps found\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,115 @@
+//+--------------------------------------------------------------------------
+//
+// BrakeSim - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        BrakeSim.cpp
+//
+// Description:
+//
+//   Runs the real lighting engine on a desktop machine through the host HAL,
+//   driving it through the demo drive on a virtual clock.  Prints the strip
+//   as a row of characters each time the frame changes, then the frame
+//   timing the engine would have had on the board.
+//
+//   -m writes every committed frame into a memory-mapped ring file (see
+//   Host/FrameRing.h) instead of printing the strip, for Host/FrameView.cpp
+//   or any other tool to tail while the simulation runs.  -r drives the
+//   demo drive that many times over, for a long soak.
+//
+//   Usage:  brakesim [-m frames.ring] [-r drives]
+//
+//   Build:  g++ -std=gnu++11 -O2 -o brakesim BrakeSim.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Engine.h"
+#include "DemoDrive.h"
+#include "FrameRing.h"
+
+static void WriteRingFrame(const uint8_t * pFrame, uint16_t, void * pContext)
+{
+	((FrameRingWriter *) pContext)->Write(pFrame, HAL_HostGetMicros(), HAL_ReadInputs());
+}
+
+int main(int argc, char * argv[])
+{
+	const char *    pszRing = nullptr;
+	int             cDrives = 1;
+	FrameRingWriter ring;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			pszRing = argv[++i];
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			cDrives = max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: brakesim [-m frames.ring] [-r drives]\n");
+			return 2;
+		}
+	}
+
+	HAL_HostReset();
+	setupEngine();
+
+	CaptureOutput * pCapture = (CaptureOutput *) pOutput;
+	char     szLast[NUMBER_USED_PIXELS + 1] = "";
+	uint64_t cFrames = 0, totalUs = 0, worstUs = 0;
+
+	if (pszRing)
+	{
+		if (!ring.Create(pszRing, pCapture->GetLength()))
+		{
+			fprintf(stderr, "%s: can't create\n", pszRing);
+			return 2;
+		}
+		pCapture->SetCommitCallback(WriteRingFrame, &ring);
+	}
+
+	for (size_t step = 0; step < ARRAYSIZE(g_demoDrive) * cDrives; step++)
+	{
+		const DriveStep & demo = g_demoDrive[step % ARRAYSIZE(g_demoDrive)];
+		HAL_HostSetInputs(demo.inputs);
+		uint64_t stepEnd = HAL_HostGetMicros() + (uint64_t) demo.durationMs * 1000;
+
+		while (HAL_HostGetMicros() < stepEnd)
+		{
+			uint64_t frameStart = HAL_HostGetMicros();
+			processAndDisplayInputs();
+			uint64_t frameUs = HAL_HostGetMicros() - frameStart;
+
+			cFrames++;
+			totalUs += frameUs;
+			worstUs  = max(worstUs, frameUs);
+
+			if (pszRing)
+			{
+				HAL_Delay(1);
+				continue;
+			}
+
+			char szFrame[NUMBER_USED_PIXELS + 1];
+			const uint8_t * pFrame = pCapture->GetCapturedFrame();
+			for (int i = 0; i < NUMBER_USED_PIXELS; i++)
+				szFrame[i] = FramePixelChar(pFrame + i * BYTES_PER_PIXEL);
+			szFrame[NUMBER_USED_PIXELS] = '\0';
+
+			if (strcmp(szFrame, szLast))
+			{
+				printf("%8.3f %s\n", frameStart / 1000.0, szFrame);
+				strcpy(szLast, szFrame);
+			}
+
+			HAL_Delay(1);
+		}
+	}
+
+	ring.Close();
+	printf("%llu frames, average %llu us, worst %llu us\n",
+		   (unsigned long long) cFrames, (unsigned long long)(totalUs / cFrames), (unsigned long long) worstUs);
+	return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include "../HAL.h"
+
+// ChromeTrace
+//
+// Writes the HAL_Trace events of host simulations to a file in the Chrome trace event
+// format (JSON), which chrome://tracing and ui.perfetto.dev both open.  Timestamps are
+// the virtual clock's, so the timeline shows where the modelled board time goes: the
+// strip's wire time, the LCD, the loop's delay, and the switches changing in between.
+// Drawing a layer costs no virtual time, so the draws show as zero-length spans at
+// the start of each frame.
+//
+// Each track (loop, layers, strip, lcd, inputs) gets a row of its own.  Each call to
+// ChromeTraceProcess() starts a new process in the viewer, so several runs can share
+// a file without their timelines overlapping.
+//
+//   ChromeTraceOpen("out.json");
+//   ChromeTraceProcess("parking.scn");
+//   ...run the engine...
+//   ChromeTraceClose();
+
+static const char * s_chromeTraceTracks[] = { "loop", "layers", "strip", "lcd", "inputs" };
+
+static FILE * s_pChromeTrace;
+static bool   s_chromeTraceFirst;
+static int    s_chromeTracePid;
+
+static void ChromeTraceMetadata(const char * pszKind, int tid, const char * pszArgs)
+{
+	fputs(s_chromeTraceFirst ? "\n" : ",\n", s_pChromeTrace);
+	fprintf(s_pChromeTrace, "{\"ph\":\"M\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"args\":{%s}}", pszKind, s_chromeTracePid, tid, pszArgs);
+	s_chromeTraceFirst = false;
+}
+
+static int ChromeTraceTrack(const char * pszTrack)
+{
+	for (size_t i = 0; i < sizeof(s_chromeTraceTracks) / sizeof(*s_chromeTraceTracks); i++)
+		if (!strcmp(pszTrack, s_chromeTraceTracks[i]))
+			return (int) i + 1;
+	return 0;
+}
+
+// The HostTraceFn handed to HAL_HostSetTrace()
+
+static void ChromeTraceEvent(char phase, const char * pszTrack, const char * pszName, int arg, uint64_t us)
+{
+	fputs(s_chromeTraceFirst ? "\n" : ",\n", s_pChromeTrace);
+	fprintf(s_pChromeTrace, "{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%llu",
+			phase, pszName, s_chromeTracePid, ChromeTraceTrack(pszTrack), (unsigned long long) us);
+	if (phase == 'i')
+		fputs(",\"s\":\"t\"", s_pChromeTrace);
+	if (arg >= 0)
+		fprintf(s_pChromeTrace, ",\"args\":{\"value\":%d}", arg);
+	fputc('}', s_pChromeTrace);
+	s_chromeTraceFirst = false;
+}
+
+static bool ChromeTraceOpen(const char * pszPath)
+{
+	s_pChromeTrace = fopen(pszPath, "w");
+	if (!s_pChromeTrace)
+		return false;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", s_pChromeTrace);
+	s_chromeTraceFirst = true;
+	s_chromeTracePid   = 0;
+	return true;
+}
+
+// ChromeTraceProcess
+//
+// Starts a new process, named for whatever is about to run, with a row for each track,
+// and traces everything from here on into it
+
+static void ChromeTraceProcess(const char * pszName)
+{
+	if (!s_pChromeTrace)
+		return;
+
+	char szArgs[80];
+
+	s_chromeTracePid++;
+	snprintf(szArgs, sizeof(szArgs), "\"name\":\"%s\"", pszName);
+	ChromeTraceMetadata("process_name", 0, szArgs);
+
+	for (size_t i = 0; i < sizeof(s_chromeTraceTracks) / sizeof(*s_chromeTraceTracks); i++)
+	{
+		snprintf(szArgs, sizeof(szArgs), "\"name\":\"%s\"", s_chromeTraceTracks[i]);
+		ChromeTraceMetadata("thread_name", (int) i + 1, szArgs);
+		snprintf(szArgs, sizeof(szArgs), "\"sort_index\":%d", (int) i + 1);
+		ChromeTraceMetadata("thread_sort_index", (int) i + 1, szArgs);
+	}
+
+	HAL_HostSetTrace(ChromeTraceEvent);
+}
+
+static void ChromeTraceClose()
+{
+	if (!s_pChromeTrace)
+		return;
+
+	HAL_HostSetTrace(nullptr);
+	fputs("\n]}\n", s_pChromeTrace);
+	fclose(s_pChromeTrace);
+	s_pChromeTrace = nullptr;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include "../HAL.h"
+
+// DemoDrive
+//
+// A short fixed drive that exercises every event, for the simulator builds to run
+// the engine through: each step holds a set of switches on for a while.
+
+struct DriveStep
+{
+	uint32_t durationMs;
+	uint8_t  inputs;
+};
+
+static const DriveStep g_demoDrive[] =
+{
+	{  500, 0 },
+	{ 2000, INPUT_STOP },
+	{ 2000, INPUT_LEFT_TURN },
+	{ 2000, INPUT_LEFT_TURN | INPUT_STOP },
+	{ 2000, INPUT_RIGHT_TURN },
+	{ 2000, INPUT_LEFT_TURN | INPUT_RIGHT_TURN },
+	{ 2000, INPUT_BACKUP },
+	{ 2000, INPUT_BACKUP | INPUT_STOP },
+	{ 2000, INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP },
+	{  500, 0 },
+};
@@ -0,0 +1,40 @@
+//+--------------------------------------------------------------------------
+//
+// EffectBench - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        EffectBench.cpp
+//
+// Description:
+//
+//   Runs the effect benchmark (EffectBenchmark.h) on the host, timed by the
+//   wall clock rather than the virtual one, so the numbers are what this
+//   machine actually spends.  The strip length is fixed at compile time,
+//   just as it is in the firmware; Tools/scaling_bench.py builds this at
+//   each length it measures.
+//
+//   Built with -DEFFECT_BENCH_MODELLED it times on the virtual clock
+//   instead, which charges the modelled wire time of each frame and the
+//   modelled AVR cycles of rendering it (HAL_HOST_RENDER_MODEL): a stand-in
+//   for the firmware's costs when there's no simavr to measure them
+//   (Tools/gen_cost_model.py --host).
+//
+//   Build:  g++ -std=gnu++11 -O2 -DTOTAL_STRIP_PIXELS=144 -o effectbench EffectBench.cpp
+//
+//---------------------------------------------------------------------------
+
+#ifdef EFFECT_BENCH_MODELLED
+#define HAL_HOST_RENDER_MODEL
+#else
+#define HAL_HOST_WALL_STOPWATCH
+#define EFFECT_BENCHMARK_FRAMES 10000				// The host is fast; use more frames for a steadier average
+#endif
+
+#include "../HAL.h"
+#include "../EffectBenchmark.h"
+
+int main()
+{
+	HAL_HostReset();
+	RunEffectBenchmark();
+	return 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <atomic>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../HAL.h"
+
+// FrameRing
+//
+// A ring of committed frames in a memory-mapped file.  A simulator writes each frame
+// into the next slot; viewers map the same file and read the slots where they lie,
+// with no pipe or socket in between and nothing for the simulator to wait on.  A
+// viewer can attach at any time and starts from whatever the ring holds.
+//
+// The file is a header followed by cSlots slots of slotBytes each:
+//
+//   header   magic "BLFRAMES", version, the geometry, and cWritten: how many frames
+//            have ever been written.  Frame n (counting from 1) is in slot
+//            (n - 1) % cSlots.
+//   slot     seq, the number of the frame in it, or 0 while it's being written;
+//            the virtual time in microseconds; the switches; then the GRB bytes.
+//
+// Nothing is ever locked.  The writer zeroes a slot's seq, fills the slot, and then
+// sets seq and cWritten.  A reader copies a frame out and then checks seq again: if
+// it changed, the writer lapped the reader in the middle of it and the frame is gone.
+// Slots are whole cache lines, so two frames never share one.
+
+#define FRAME_RING_MAGIC   "BLFRAMES"
+#define FRAME_RING_VERSION 1
+#define FRAME_RING_SLOTS   4096
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The ring's counters are shared between processes, so they can't take a lock");
+
+struct FrameRingHeader
+{
+	char                  magic[8];
+	uint32_t              version;
+	uint32_t              headerBytes;
+	uint32_t              slotBytes;
+	uint32_t              cSlots;
+	uint32_t              cPixels;
+	uint32_t              bytesPerPixel;
+	std::atomic<uint64_t> cWritten;
+	std::atomic<uint32_t> closed;				// Set when the writer is done; nothing more will come
+	uint32_t              reserved;
+};
+
+struct FrameRingSlot
+{
+	std::atomic<uint64_t> seq;
+	uint64_t              us;
+	uint8_t               inputs;
+	uint8_t               reserved[7];
+	uint8_t               grb[1];				// cPixels * bytesPerPixel of them
+};
+
+#define FRAME_RING_HEADER_BYTES ((sizeof(FrameRingHeader) + 63) & ~(size_t) 63)
+#define FRAME_RING_SLOT_BYTES(cPixels) ((offsetof(FrameRingSlot, grb) + (size_t)(cPixels) * BYTES_PER_PIXEL + 63) & ~(size_t) 63)
+
+// FramePixelChar
+//
+// One character per pixel, close enough to tell the effects apart, for printing a
+// frame as a row of text (GRB bytes)
+
+static char FramePixelChar(const uint8_t * p)
+{
+	uint8_t g = p[0], r = p[1], b = p[2];
+
+	if (r == 0 && g == 0 && b == 0)  return '.';
+	if (r > 200 && g > 200 && b > 200) return 'W';
+	if (b > r && b > g)              return 'B';
+	if (r > 200 && g > 20)           return 'A';
+	if (r > 200)                     return 'R';
+	if (r > 0)                       return 'r';
+	return '?';
+}
+
+// The mapping itself, shared by the writer and the reader
+
+class FrameRing
+{
+  protected:
+
+	uint8_t *         _pMap;
+	size_t            _cbMap;
+	FrameRingHeader * _pHeader;
+
+	FrameRingSlot * Slot(uint64_t seq)
+	{
+		return (FrameRingSlot *)(_pMap + _pHeader->headerBytes + (size_t)((seq - 1) % _pHeader->cSlots) * _pHeader->slotBytes);
+	}
+
+	bool Map(int fd, size_t cb, int prot)
+	{
+		void * p = mmap(nullptr, cb, prot, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+
+		_pMap    = (uint8_t *) p;
+		_cbMap   = cb;
+		_pHeader = (FrameRingHeader *) p;
+		return true;
+	}
+
+  public:
+
+	FrameRing()
+		: _pMap(nullptr),
+		  _cbMap(0),
+		  _pHeader(nullptr)
+	{
+	}
+
+	virtual ~FrameRing()
+	{
+		if (_pMap)
+			munmap(_pMap, _cbMap);
+	}
+
+	uint16_t GetPixelCount()
+	{
+		return (uint16_t) _pHeader->cPixels;
+	}
+
+	uint32_t GetSlotCount()
+	{
+		return _pHeader->cSlots;
+	}
+
+	uint64_t GetWrittenCount()
+	{
+		return _pHeader->cWritten.load(std::memory_order_acquire);
+	}
+
+	bool IsClosed()
+	{
+		return _pHeader->closed.load(std::memory_order_acquire) != 0;
+	}
+};
+
+// FrameRingWriter
+//
+// Creates (or empties) the file and writes frames into it.  Write() has the shape of a
+// CaptureOutput commit callback's work, so a simulator can hang it off the output.
+
+class FrameRingWriter : public FrameRing
+{
+  public:
+
+	bool Create(const char * pszPath, uint16_t cPixels, uint32_t cSlots = FRAME_RING_SLOTS)
+	{
+		size_t cb = FRAME_RING_HEADER_BYTES + (size_t) cSlots * FRAME_RING_SLOT_BYTES(cPixels);
+
+		int fd = open(pszPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		bool mapped = ftruncate(fd, (off_t) cb) == 0 && Map(fd, cb, PROT_READ | PROT_WRITE);
+		close(fd);
+		if (!mapped)
+			return false;
+
+		// The file starts out all zeros, which is every slot empty and nothing written.
+		// The magic goes in last, so a reader never sees a header that isn't finished.
+
+		_pHeader->version       = FRAME_RING_VERSION;
+		_pHeader->headerBytes   = FRAME_RING_HEADER_BYTES;
+		_pHeader->slotBytes     = FRAME_RING_SLOT_BYTES(cPixels);
+		_pHeader->cSlots        = cSlots;
+		_pHeader->cPixels       = cPixels;
+		_pHeader->bytesPerPixel = BYTES_PER_PIXEL;
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(_pHeader->magic, FRAME_RING_MAGIC, sizeof(_pHeader->magic));
+		return true;
+	}
+
+	void Write(const uint8_t * pFrame, uint64_t us, uint8_t inputs)
+	{
+		uint64_t        seq   = _pHeader->cWritten.load(std::memory_order_relaxed) + 1;
+		FrameRingSlot * pSlot = Slot(seq);
+
+		pSlot->seq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		pSlot->us     = us;
+		pSlot->inputs = inputs;
+		memcpy(pSlot->grb, pFrame, (size_t) _pHeader->cPixels * BYTES_PER_PIXEL);
+		pSlot->seq.store(seq, std::memory_order_release);
+		_pHeader->cWritten.store(seq, std::memory_order_release);
+	}
+
+	void Close()
+	{
+		if (_pHeader)
+			_pHeader->closed.store(1, std::memory_order_release);
+	}
+};
+
+// FrameRingReader
+//
+// Maps a ring some writer created, read only.
+
+class FrameRingReader : public FrameRing
+{
+  public:
+
+	bool Open(const char * pszPath)
+	{
+		int fd = open(pszPath, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		bool        mapped = fstat(fd, &st) == 0 && (size_t) st.st_size >= FRAME_RING_HEADER_BYTES && Map(fd, (size_t) st.st_size, PROT_READ);
+		close(fd);
+		if (!mapped)
+			return false;
+
+		return !memcmp(_pHeader->magic, FRAME_RING_MAGIC, sizeof(_pHeader->magic))
+			&& _pHeader->version == FRAME_RING_VERSION
+			&& _pHeader->bytesPerPixel == BYTES_PER_PIXEL
+			&& _pHeader->cSlots != 0
+			&& _pHeader->slotBytes >= FRAME_RING_SLOT_BYTES(_pHeader->cPixels)
+			&& (size_t) _pHeader->headerBytes + (size_t) _pHeader->cSlots * _pHeader->slotBytes <= _cbMap;
+	}
+
+	// Oldest frame the ring still holds; frames before it have been written over
+
+	uint64_t GetOldest()
+	{
+		uint64_t cWritten = GetWrittenCount();
+		return cWritten > _pHeader->cSlots ? cWritten - _pHeader->cSlots + 1 : 1;
+	}
+
+	// Read
+	//
+	// Copies frame seq, which has to have been written already, into pGrb
+	// (GetPixelCount() * BYTES_PER_PIXEL bytes).  Returns false if the writer has
+	// written over it since, or was in the middle of doing so.
+
+	bool Read(uint64_t seq, uint8_t * pGrb, uint64_t & us, uint8_t & inputs)
+	{
+		FrameRingSlot * pSlot = Slot(seq);
+
+		if (pSlot->seq.load(std::memory_order_acquire) != seq)
+			return false;
+		us     = pSlot->us;
+		inputs = pSlot->inputs;
+		memcpy(pGrb, pSlot->grb, (size_t) _pHeader->cPixels * BYTES_PER_PIXEL);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return pSlot->seq.load(std::memory_order_relaxed) == seq;
+	}
+};
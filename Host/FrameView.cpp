@@ -0,0 +1,117 @@
+//+--------------------------------------------------------------------------
+//
+// FrameView - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        FrameView.cpp
+//
+// Description:
+//
+//   Tails the frame ring a simulator is writing (brakesim -m, see
+//   Host/FrameRing.h) and prints the strip as a row of characters each
+//   time it changes, the same as brakesim does itself.  It can attach
+//   while the simulation is already running, and keeps following until
+//   the writer closes the ring.
+//
+//   It starts at the newest frame, or with -a at the oldest the ring still
+//   holds.  -c counts frames instead of printing them.  Frames the writer
+//   laps before they're read are reported as lost.
+//
+//   Usage:  frameview [-a] [-c] frames.ring
+//
+//   Build:  g++ -std=gnu++11 -O2 -o frameview FrameView.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "FrameRing.h"
+
+int main(int argc, char * argv[])
+{
+	const char * pszRing    = nullptr;
+	bool         fromOldest = false;
+	bool         countOnly  = false;
+	bool         badArgs    = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-a"))
+			fromOldest = true;
+		else if (!strcmp(argv[i], "-c"))
+			countOnly = true;
+		else if (argv[i][0] != '-' && !pszRing)
+			pszRing = argv[i];
+		else
+			badArgs = true;
+	}
+	if (badArgs || !pszRing)
+	{
+		fprintf(stderr, "usage: frameview [-a] [-c] frames.ring\n");
+		return 2;
+	}
+
+	FrameRingReader ring;
+	if (!ring.Open(pszRing))
+	{
+		fprintf(stderr, "%s: not a frame ring\n", pszRing);
+		return 2;
+	}
+
+	uint16_t             cPixels = ring.GetPixelCount();
+	std::vector<uint8_t> grb(cPixels * BYTES_PER_PIXEL);
+	std::string          line, last;
+	uint64_t             cRead = 0, cLost = 0;
+	uint64_t             next  = fromOldest ? ring.GetOldest() : max((uint64_t) 1, ring.GetWrittenCount());
+
+	for (;;)
+	{
+		// Closed is checked before the count, so that the last frames are still read
+		// after the writer finishes
+
+		bool     closed   = ring.IsClosed();
+		uint64_t cWritten = ring.GetWrittenCount();
+
+		if (next > cWritten)
+		{
+			if (closed)
+				break;
+			usleep(1000);
+			continue;
+		}
+
+		uint64_t oldest = ring.GetOldest();
+		if (next < oldest)
+		{
+			cLost += oldest - next;
+			next   = oldest;
+		}
+
+		uint64_t us;
+		uint8_t  inputs;
+		if (!ring.Read(next, grb.data(), us, inputs))
+		{
+			next++;
+			cLost++;
+			continue;
+		}
+		next++;
+		cRead++;
+
+		if (countOnly)
+			continue;
+
+		line.resize(cPixels);
+		for (uint16_t i = 0; i < cPixels; i++)
+			line[i] = FramePixelChar(&grb[i * BYTES_PER_PIXEL]);
+		if (line != last)
+		{
+			printf("%8.3f %x %s\n", us / 1000.0, inputs, line.c_str());
+			last = line;
+		}
+	}
+
+	printf("%llu frames read, %llu lost\n", (unsigned long long) cRead, (unsigned long long) cLost);
+	return 0;
+}
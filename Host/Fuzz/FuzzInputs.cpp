@@ -0,0 +1,135 @@
+//+--------------------------------------------------------------------------
+//
+// FuzzInputs - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        FuzzInputs.cpp
+//
+// Description:
+//
+//   libFuzzer target for the input arbitration.  Each input is a drive: a
+//   string of (hold time, switches) byte pairs fed through the real
+//   processAndDisplayInputs() on the host's virtual clock.  Every pass
+//   checks that:
+//
+//     - nothing writes outside the frame buffer (AddressSanitizer catches
+//       it: the host output's buffer is exactly the strip's size)
+//     - the pass fits in FRAME_BUDGET_US of modelled board time
+//     - once STOP is down without both turn signals (which brings up the
+//       police bar instead), the middle of the strip goes brake red within
+//       BRAKE_DEADLINE_US, and does so again after every press
+//
+//   A failed check aborts with a description, which libFuzzer reports as a
+//   crash and saves the input that caused it.
+//
+//   Build:  clang++ -std=gnu++11 -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_inputs FuzzInputs.cpp
+//           g++ -std=gnu++11 -g -O1 -fsanitize=address,undefined -DFUZZ_STANDALONE -o fuzz_inputs FuzzInputs.cpp
+//
+//   Tools/fuzz.sh builds, runs, and minimizes the corpus.
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../Engine.h"
+
+#define FUZZ_MS_PER_TICK        4					// Hold times are a byte of 4ms ticks, up to about a second
+#define FUZZ_MAX_DRIVE_MS       60000				// Longer inputs are cut off here
+
+struct FuzzState
+{
+	bool     brakeWanted;							// STOP is down and the brakes (not the light bar) should show
+	bool     brakePending;							// ...but they haven't shown red yet
+	uint64_t brakeSinceUs;
+};
+
+static FuzzState s_fuzz;
+
+static void FuzzFail(const char * pszWhat)
+{
+	fprintf(stderr, "INVARIANT FAILED at %.3fms: %s\n", HAL_HostGetMicros() / 1000.0, pszWhat);
+	abort();
+}
+
+static void FuzzCommitCallback(const uint8_t * pFrame, uint16_t, void *)
+{
+	const uint8_t * p = pFrame + (NUMBER_USED_PIXELS / 2) * BYTES_PER_PIXEL;
+	if (s_fuzz.brakePending && p[1] >= 128 && p[0] < 64 && p[2] < 64)
+		s_fuzz.brakePending = false;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+	HAL_HostSetSerialOutput(fopen("/dev/null", "w"));
+	return 0;
+}
+#define FUZZ_HAVE_INITIALIZE
+
+// RunFuzzPasses
+//
+// Runs the main loop until the virtual clock reaches untilUs, checking every pass.
+// Always runs at least one.
+
+static void RunFuzzPasses(uint64_t untilUs)
+{
+	do
+	{
+		uint64_t passStart = HAL_HostGetMicros();
+		processAndDisplayInputs();
+
+		if (HAL_HostGetMicros() - passStart > FRAME_BUDGET_US)
+			FuzzFail("a pass through the loop overran FRAME_BUDGET_US");
+		if (s_fuzz.brakePending && HAL_HostGetMicros() - s_fuzz.brakeSinceUs > BRAKE_DEADLINE_US)
+			FuzzFail("STOP is down but the brakes didn't show red in time");
+
+		HAL_Delay(1);
+	}
+	while (HAL_HostGetMicros() < untilUs);
+}
+
+// Each step's switches change at a moment on the drive's own timeline, which usually
+// falls in the middle of a pass; the engine sees the change when the next pass reads
+// the switches, and the brake deadline runs from the moment of the change, just as it
+// would from the pedal.  Steps shorter than a pass can come and go unseen.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * pData, size_t cb)
+{
+	HAL_HostReset();
+	setupEngine();
+	((CaptureOutput *) pOutput)->SetCommitCallback(FuzzCommitCallback, nullptr);
+	memset(&s_fuzz, 0, sizeof(s_fuzz));
+
+	uint64_t stepUs = 0;
+
+	for (size_t i = 0; i + 1 < cb && stepUs < (uint64_t) FUZZ_MAX_DRIVE_MS * 1000; i += 2)
+	{
+		if (HAL_HostGetMicros() < stepUs)
+			RunFuzzPasses(stepUs);
+
+		uint8_t inputs      = pData[i + 1] & (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP | INPUT_BACKUP);
+		bool    police      = (inputs & (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP)) == (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP);
+		bool    brakeWanted = (inputs & INPUT_STOP) && !police;
+
+		HAL_HostSetInputs(inputs);
+
+		if (brakeWanted && !s_fuzz.brakeWanted)
+		{
+			s_fuzz.brakePending = true;
+			s_fuzz.brakeSinceUs = stepUs;
+		}
+		else if (!brakeWanted)
+		{
+			s_fuzz.brakePending = false;
+		}
+		s_fuzz.brakeWanted = brakeWanted;
+
+		stepUs += (uint64_t) pData[i] * FUZZ_MS_PER_TICK * 1000;
+	}
+	RunFuzzPasses(stepUs);
+
+	shutdownEngine();
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include "StandaloneFuzzMain.h"
+#endif
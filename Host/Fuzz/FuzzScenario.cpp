@@ -0,0 +1,98 @@
+//+--------------------------------------------------------------------------
+//
+// FuzzScenario - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        FuzzScenario.cpp
+//
+// Description:
+//
+//   libFuzzer target for the scenario language (Host/Scenario.h), the one
+//   text protocol in the tree.  Each input is scenario text; the parser
+//   must either reject it with an error or produce a scenario that holds
+//   together:
+//
+//     - edges are in time order and each names exactly one switch
+//     - every assertion points at a line that exists, and pixel checks at
+//       a pixel on the strip
+//     - expanding jitter and bounce keeps the changes in time order
+//
+//   Scenarios short enough to run quickly are then run through the engine,
+//   so that whatever the parser lets through, the runner survives too.
+//
+//   Build:  clang++ -std=gnu++11 -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_scenario FuzzScenario.cpp
+//           g++ -std=gnu++11 -g -O1 -fsanitize=address,undefined -DFUZZ_STANDALONE -o fuzz_scenario FuzzScenario.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Scenario.h"
+
+#define FUZZ_MAX_RUN_US      5000000				// Only run scenarios this short...
+#define FUZZ_MAX_RUN_CHANGES 10000					// ...with no more switch changes than this
+
+static void FuzzFail(const char * pszWhat)
+{
+	fprintf(stderr, "INVARIANT FAILED: %s\n", pszWhat);
+	abort();
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+	HAL_HostSetSerialOutput(fopen("/dev/null", "w"));
+	return 0;
+}
+#define FUZZ_HAVE_INITIALIZE
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * pData, size_t cb)
+{
+	std::string text((const char *) pData, cb);
+	Scenario    scenario;
+	std::string error;
+
+	if (!ParseScenario(text.c_str(), scenario, error))
+	{
+		if (error.empty())
+			FuzzFail("rejected without saying why");
+		return 0;
+	}
+
+	int cLines = 1;
+	for (size_t i = 0; i < text.size() && text[i]; i++)
+		cLines += text[i] == '\n';
+
+	for (size_t i = 0; i < scenario.edges.size(); i++)
+	{
+		uint8_t input = scenario.edges[i].input;
+		if (input == 0 || (input & (input - 1)) || input > INPUT_BACKUP)
+			FuzzFail("an edge doesn't name exactly one switch");
+		if (i > 0 && scenario.edges[i].us < scenario.edges[i - 1].us)
+			FuzzFail("edges out of time order");
+	}
+
+	for (size_t i = 0; i < scenario.asserts.size(); i++)
+	{
+		const ScenarioAssert & check = scenario.asserts[i];
+		if (check.line < 1 || check.line > cLines)
+			FuzzFail("an assertion points at a line that doesn't exist");
+		if (check.kind == ASSERT_PIXEL && check.pixel >= NUMBER_USED_PIXELS)
+			FuzzFail("a pixel assertion is off the end of the strip");
+	}
+
+	uint64_t cChanges = scenario.edges.size() * ((uint64_t) scenario.bounceCount * 2 + 1);
+	if (scenario.endUs > FUZZ_MAX_RUN_US || cChanges > FUZZ_MAX_RUN_CHANGES)
+		return 0;
+
+	std::vector<ScenarioChange> changes = ExpandScenarioEdges(scenario, scenario.seed);
+	for (size_t i = 1; i < changes.size(); i++)
+		if (changes[i].us < changes[i - 1].us)
+			FuzzFail("expanded changes out of time order");
+
+	ScenarioResult result;
+	RunScenario(scenario, scenario.seed, result);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include "StandaloneFuzzMain.h"
+#endif
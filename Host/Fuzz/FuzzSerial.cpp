@@ -0,0 +1,126 @@
+//+--------------------------------------------------------------------------
+//
+// FuzzSerial - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        FuzzSerial.cpp
+//
+// Description:
+//
+//   libFuzzer target for the pattern upload protocol (PatternLoader.h) and
+//   the pattern player behind it (Pattern.h).  The first byte of each input
+//   is the switches to hold; the rest arrives on the serial port as fast as
+//   the receive buffer takes it, while the real loop runs.  Every pass
+//   checks that:
+//
+//     - nothing reads or writes outside the EEPROM or the frame buffer
+//       (AddressSanitizer: the host's EEPROM is exactly HAL_EEPROM_SIZE)
+//     - the pass fits in FRAME_BUDGET_US of modelled board time, upload or
+//       no upload
+//     - whenever a pattern is loaded, what's in EEPROM passes its crc and
+//       the verifier, so Draw() is only ever given a checked program, and
+//       none of its segments is longer than PATTERN_MAX_SEGMENT_MS, so the
+//       grow and fade math stays within 32 bits (corpus/serial/long_segment
+//       uploads one that is)
+//
+//   and once the input runs out, that the loader finishes or gives up.
+//
+//   Build:  clang++ -std=gnu++11 -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_serial FuzzSerial.cpp
+//           g++ -std=gnu++11 -g -O1 -fsanitize=address,undefined -DFUZZ_STANDALONE -o fuzz_serial FuzzSerial.cpp
+//
+//   The corpus starts from Patterns/ run through Tools/pattern.py frame.
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../Engine.h"
+
+#define FUZZ_SETTLE_MS   60000					// Time the loader gets to finish once the input's all sent
+#define FUZZ_DRAW_PASSES 100
+
+static void FuzzFail(const char * pszWhat)
+{
+	fprintf(stderr, "INVARIANT FAILED at %.3fms: %s\n", HAL_HostGetMicros() / 1000.0, pszWhat);
+	abort();
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***)
+{
+	HAL_HostSetSerialOutput(fopen("/dev/null", "w"));
+	return 0;
+}
+#define FUZZ_HAVE_INITIALIZE
+
+static void CheckLoadedPattern()
+{
+	if (!pPattern->IsLoaded())
+		return;
+
+	const uint8_t * pEeprom = HAL_HostGetEeprom();
+	uint16_t        length  = pEeprom[4] | (pEeprom[5] << 8);
+	uint16_t        crc     = 0xFFFF;
+	uint32_t        cycleMs;
+
+	if (pEeprom[0] != PATTERN_MAGIC0 || pEeprom[1] != PATTERN_MAGIC1 || length > PATTERN_MAX_BYTES)
+		FuzzFail("a pattern is loaded but the EEPROM header isn't one");
+	for (uint16_t i = 0; i < length; i++)
+		crc = PatternCrc16(crc, pEeprom[PATTERN_HEADER_BYTES + i]);
+	if (crc != (pEeprom[6] | (pEeprom[7] << 8)))
+		FuzzFail("a pattern is loaded but its crc doesn't match");
+	if (PatternVerify(length, &cycleMs) != PATTERN_OK || cycleMs != pPattern->GetCycleMs())
+		FuzzFail("a pattern is loaded that the verifier rejects");
+
+	for (uint16_t i = 0; i < length / PATTERN_INSTRUCTION_BYTES; i++)
+	{
+		PatternInstruction instruction;
+		ReadPatternInstruction(i, instruction);
+		if (instruction.op == PATTERN_OP_SEGMENT && instruction.DurationMs() > PATTERN_MAX_SEGMENT_MS)
+			FuzzFail("a pattern is loaded with a segment longer than PATTERN_MAX_SEGMENT_MS");
+	}
+}
+
+static void RunFuzzPass()
+{
+	uint64_t passStart = HAL_HostGetMicros();
+	processAndDisplayInputs();
+
+	if (HAL_HostGetMicros() - passStart > FRAME_BUDGET_US)
+		FuzzFail("a pass through the loop overran FRAME_BUDGET_US");
+	CheckLoadedPattern();
+
+	HAL_Delay(1);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * pData, size_t cb)
+{
+	if (cb < 1)
+		return 0;
+
+	HAL_HostReset();
+	setupEngine();
+	HAL_HostSetInputs(pData[0] & (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP | INPUT_BACKUP));
+
+	for (size_t i = 1; i < cb; )
+	{
+		i += HAL_HostSerialInput(pData + i, cb - i);
+		RunFuzzPass();
+	}
+
+	uint64_t settleUntil = HAL_HostGetMicros() + (uint64_t) FUZZ_SETTLE_MS * 1000;
+	while (pLoader->Busy())
+	{
+		if (HAL_HostGetMicros() > settleUntil)
+			FuzzFail("the loader never finished or gave up on an upload");
+		RunFuzzPass();
+	}
+
+	for (int i = 0; i < FUZZ_DRAW_PASSES; i++)		// Play whatever got loaded for a while
+		RunFuzzPass();
+
+	shutdownEngine();
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include "StandaloneFuzzMain.h"
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+// StandaloneFuzzMain
+//
+// A main() for the fuzz targets when libFuzzer isn't available (g++, or a machine
+// without clang).  It doesn't fuzz; it runs each file, or every file in each
+// directory, named on the command line through LLVMFuzzerTestOneInput() once.  Built
+// with -fsanitize=address,undefined that replays a corpus or a crash under the same
+// checks the fuzzer uses.  A fuzz target includes this at the bottom when built with
+// FUZZ_STANDALONE.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * pData, size_t cb);
+
+static int RunFuzzFile(const char * pszPath)
+{
+	FILE * pFile = fopen(pszPath, "rb");
+	if (!pFile)
+	{
+		fprintf(stderr, "can't open %s\n", pszPath);
+		return 1;
+	}
+
+	std::vector<uint8_t> data;
+	uint8_t              buf[4096];
+	size_t               cb;
+	while ((cb = fread(buf, 1, sizeof(buf), pFile)) > 0)
+		data.insert(data.end(), buf, buf + cb);
+	fclose(pFile);
+
+	LLVMFuzzerTestOneInput(data.data(), data.size());
+	return 0;
+}
+
+int main(int argc, char * argv[])
+{
+	int cRun = 0;
+
+#ifdef FUZZ_HAVE_INITIALIZE
+	LLVMFuzzerInitialize(&argc, &argv);
+#endif
+
+	for (int i = 1; i < argc; i++)
+	{
+		struct stat st;
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+		{
+			DIR * pDir = opendir(argv[i]);
+			while (struct dirent * pEntry = pDir ? readdir(pDir) : nullptr)
+			{
+				if (pEntry->d_name[0] == '.')
+					continue;
+				std::string path = std::string(argv[i]) + "/" + pEntry->d_name;
+				if (RunFuzzFile(path.c_str()))
+					return 1;
+				cRun++;
+			}
+			if (pDir)
+				closedir(pDir);
+		}
+		else
+		{
+			if (RunFuzzFile(argv[i]))
+				return 1;
+			cRun++;
+		}
+	}
+
+	fprintf(stderr, "%d input%s ran clean\n", cRun, cRun == 1 ? "" : "s");
+	return 0;
+}
@@ -0,0 +1,24 @@
+//+--------------------------------------------------------------------------
+//
+// GoldenFrames - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        GoldenFrames.cpp
+//
+// Description:
+//
+//   Host side of the cross-platform rendering check: prints the golden
+//   frame hashes for the demo drive.  See GoldenFrames.h.
+//
+//   Build:  g++ -std=gnu++11 -O2 -o goldenframes GoldenFrames.cpp
+//
+//---------------------------------------------------------------------------
+
+#include "../GoldenFrames.h"
+
+int main()
+{
+	HAL_HostReset();
+	setupEngine();
+	runGoldenFrames();
+	return 0;
+}
@@ -0,0 +1,149 @@
+//+--------------------------------------------------------------------------
+//
+// KernelBench - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        KernelBench.cpp
+//
+// Description:
+//
+//   Times the compositor's byte kernels (span fill in each blend mode, gamma,
+//   and brightness) at every SIMD level this CPU supports, on virtual strips
+//   from 10 thousand to a million pixels.  Before timing anything it checks
+//   that every level produces exactly the bytes the scalar firmware kernel
+//   does, over odd lengths that exercise the leftover tails.
+//
+//   Output is ns per pixel and millions of pixels per second.  If ns/pixel
+//   holds steady as the strip grows, the kernel scales linearly and the
+//   only thing a longer strip costs is more of the same work.
+//
+//   Usage:  kernelbench [maxPixels]
+//
+//   Build:  g++ -std=gnu++11 -O2 -o kernelbench KernelBench.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "SimdKernels.h"
+
+enum KERNEL
+{
+	KERNEL_REPLACE = 0,
+	KERNEL_MAX,
+	KERNEL_ADD,
+	KERNEL_ALPHA,
+	KERNEL_GAMMA,
+	KERNEL_BRIGHTNESS,
+	KERNEL_COUNT
+};
+
+static const char * s_kernelNames[KERNEL_COUNT] = { "replace", "max", "add", "alpha", "gamma", "brightness" };
+
+static const uint8_t s_color[BYTES_PER_PIXEL] = { 0x60, 0xFF, 0x00 };		// Amber, GRB
+
+static void RunKernel(KERNEL kernel, SIMD_LEVEL level, uint8_t * p, size_t cPixels)
+{
+	switch (kernel)
+	{
+		case KERNEL_REPLACE:    SimdFillSpan(level, p, cPixels, s_color, BLEND_REPLACE);     break;
+		case KERNEL_MAX:        SimdFillSpan(level, p, cPixels, s_color, BLEND_MAX);         break;
+		case KERNEL_ADD:        SimdFillSpan(level, p, cPixels, s_color, BLEND_ADD);         break;
+		case KERNEL_ALPHA:      SimdFillSpan(level, p, cPixels, s_color, BLEND_ALPHA, 100);  break;
+		case KERNEL_GAMMA:      SimdGammaSpan(level, p, cPixels * BYTES_PER_PIXEL);          break;
+		case KERNEL_BRIGHTNESS: SimdScaleSpan(level, p, cPixels * BYTES_PER_PIXEL, 180);     break;
+		default:                break;
+	}
+}
+
+static void FillRandom(std::vector<uint8_t> & buffer, uint32_t seed)
+{
+	for (size_t i = 0; i < buffer.size(); i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		buffer[i] = (uint8_t)(seed >> 24);
+	}
+}
+
+// Verify
+//
+// Runs every kernel at every level over random data, starting one byte off alignment,
+// and compares the result against the scalar kernel byte for byte.
+
+static bool Verify(SIMD_LEVEL maxLevel)
+{
+	static const size_t s_lengths[] = { 1, 15, 16, 17, 31, 32, 33, 47, 1001, 70000 };
+	bool ok = true;
+
+	for (size_t length : s_lengths)
+	{
+		std::vector<uint8_t> input(length * BYTES_PER_PIXEL + 1);
+		FillRandom(input, (uint32_t) length);
+
+		for (int kernel = 0; kernel < KERNEL_COUNT; kernel++)
+		{
+			std::vector<uint8_t> expected(input);
+			RunKernel((KERNEL) kernel, SIMD_SCALAR, &expected[1], length);
+
+			for (int level = SIMD_SCALAR + 1; level <= maxLevel; level++)
+			{
+				std::vector<uint8_t> actual(input);
+				RunKernel((KERNEL) kernel, (SIMD_LEVEL) level, &actual[1], length);
+				if (actual != expected)
+				{
+					fprintf(stderr, "MISMATCH: %s %s at %zu pixels\n", s_kernelNames[kernel], SimdLevelName((SIMD_LEVEL) level), length);
+					ok = false;
+				}
+			}
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char * argv[])
+{
+	size_t     maxPixels = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+	SIMD_LEVEL maxLevel  = SimdBestLevel();
+
+	if (!Verify(maxLevel))
+		return 1;
+	printf("All levels up to %s match the scalar kernels\n\n", SimdLevelName(maxLevel));
+
+	printf("%-10s %-7s", "kernel", "level");
+	for (size_t cPixels = 10000; cPixels <= maxPixels; cPixels *= 10)
+		printf(" %9zu px      ", cPixels);
+	printf("\n%-10s %-7s", "", "");
+	for (size_t cPixels = 10000; cPixels <= maxPixels; cPixels *= 10)
+		printf(" %7s %8s", "ns/px", "Mpx/s");
+	printf("\n");
+
+	for (int kernel = 0; kernel < KERNEL_COUNT; kernel++)
+	{
+		for (int level = SIMD_SCALAR; level <= maxLevel; level++)
+		{
+			printf("%-10s %-7s", s_kernelNames[kernel], SimdLevelName((SIMD_LEVEL) level));
+
+			for (size_t cPixels = 10000; cPixels <= maxPixels; cPixels *= 10)
+			{
+				// Run about 50 million pixels through each measurement so short strips
+				// are timed over many passes and long ones over a few
+
+				std::vector<uint8_t> buffer(cPixels * BYTES_PER_PIXEL);
+				FillRandom(buffer, 1);
+
+				size_t cPasses = 50000000 / cPixels;
+				auto   start   = std::chrono::steady_clock::now();
+				for (size_t pass = 0; pass < cPasses; pass++)
+					RunKernel((KERNEL) kernel, (SIMD_LEVEL) level, buffer.data(), cPixels);
+				double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+				double nsPerPixel = ns / ((double) cPasses * cPixels);
+				printf(" %7.3f %8.0f", nsPerPixel, 1000.0 / nsPerPixel);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
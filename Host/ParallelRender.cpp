@@ -0,0 +1,303 @@
+//+--------------------------------------------------------------------------
+//
+// ParallelRender - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        ParallelRender.cpp
+//
+// Description:
+//
+//   Renders a long simulated drive, a scenario (Host/Scenario.h) played
+//   over and over for hours, by splitting its timeline into chunks and
+//   rendering the chunks in parallel across cores.  Every pass is the real
+//   main loop, processAndDisplayInputs() a millisecond apart just as
+//   RunScenario() runs it, so the governor, the late latch and the frame
+//   skipping are all in what gets rendered.
+//
+//   Every effect draws purely from its start time and the time now, and
+//   nothing the loop decides depends on what the frames look like.  So one
+//   cheap pass runs the real loop down the whole timeline with drawing
+//   turned off (HAL_HostSetDrawing()) and keeps a snapshot (Snapshot.h) at
+//   the start of every chunk; then each thread, with an engine of its own,
+//   restores a chunk's snapshot and runs the loop through it with drawing on.
+//
+//   The whole drive is first run the plain way, in one thread from the
+//   start, and every frame the strip is sent in every parallel run is
+//   checked against it: when it was sent, and a hash of all of its bytes.
+//   The runs go from one thread up to -t, each timed against the sequential
+//   one.  The scenario's assertions aren't checked; ScenarioRunner does that.
+//
+//   Usage:  parallelrender [-h hours] [-c chunkMs] [-t threads] [-s seed] <scenario.scn>
+//
+//   Build:  g++ -std=gnu++11 -O2 -pthread -o parallelrender ParallelRender.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "Snapshot.h"
+#include "../GoldenFrames.h"
+#include "WorkStealingPool.h"
+
+#ifdef HAL_HOST_RENDER_MODEL
+#error "The keyframe pass doesn't draw, so under the render model its clock would run differently"
+#endif
+
+// The drive: the scenario's switch changes, played back to back until endUs
+
+struct Drive
+{
+	std::vector<ScenarioChange> changes;
+	uint64_t                    lengthUs;			// Of one play of the scenario
+	uint64_t                    endUs;
+};
+
+// Where a run has got to in the drive
+
+struct DriveCursor
+{
+	uint64_t baseUs;								// When this play of the scenario began
+	size_t   iChange;								// The next change of it not yet applied
+	uint8_t  inputs;
+};
+
+struct Keyframe
+{
+	DriveCursor  cursor;
+	HostSnapshot snapshot;
+};
+
+// A frame sent to the strip: when, and the hash of its bytes
+
+struct FrameRecord
+{
+	uint64_t us;
+	uint32_t hash;
+
+	bool operator==(const FrameRecord & other) const
+	{
+		return us == other.us && hash == other.hash;
+	}
+};
+
+static void RecordFrame(const uint8_t * pFrame, uint16_t cPixels, void * pContext)
+{
+	FrameRecord record = { HAL_HostGetMicros(), FrameHash(pFrame, cPixels * BYTES_PER_PIXEL) };
+	((std::vector<FrameRecord> *) pContext)->push_back(record);
+}
+
+// One pass of the loop, with every change up to now applied first
+
+static void StepDrive(const Drive & drive, DriveCursor & cursor)
+{
+	uint64_t now = HAL_HostGetMicros();
+	for (;;)
+	{
+		if (cursor.iChange == drive.changes.size())
+		{
+			if (now < cursor.baseUs + drive.lengthUs)
+				break;
+			cursor.baseUs += drive.lengthUs;		// On to the next play of the scenario
+			cursor.iChange = 0;
+			continue;
+		}
+
+		const ScenarioChange & change = drive.changes[cursor.iChange];
+		if (cursor.baseUs + change.us > now)
+			break;
+		if (change.down)
+			cursor.inputs |= change.input;
+		else
+			cursor.inputs &= ~change.input;
+		cursor.iChange++;
+	}
+	HAL_HostSetInputs(cursor.inputs);
+
+	processAndDisplayInputs();
+	HAL_Delay(1);
+}
+
+// The reference: the whole drive in order, on a fresh engine
+
+static void RenderSequential(const Drive & drive, std::vector<FrameRecord> & frames)
+{
+	DriveCursor cursor = { 0, 0, 0 };
+
+	HAL_HostReset();
+	setupEngine();
+	((CaptureOutput *) pOutput)->SetCommitCallback(RecordFrame, &frames);
+
+	while (HAL_HostGetMicros() < drive.endUs)
+		StepDrive(drive, cursor);
+
+	shutdownEngine();
+}
+
+// The snapshot at the start of every chunk, from the loop run with drawing off
+
+static void FindKeyframes(const Drive & drive, uint64_t chunkUs, std::vector<Keyframe> & keyframes)
+{
+	DriveCursor cursor = { 0, 0, 0 };
+	uint64_t    nextUs = 0;
+
+	HAL_HostReset();
+	HAL_HostSetDrawing(false);
+	setupEngine();
+
+	while (HAL_HostGetMicros() < drive.endUs)
+	{
+		if (HAL_HostGetMicros() >= nextUs)
+		{
+			keyframes.emplace_back();
+			keyframes.back().cursor = cursor;
+			TakeSnapshot(keyframes.back().snapshot);
+			nextUs = HAL_HostGetMicros() + chunkUs;
+		}
+		StepDrive(drive, cursor);
+	}
+
+	shutdownEngine();
+	HAL_HostSetDrawing(true);
+}
+
+// Brings up this thread's engine the first time it's needed
+
+static void EnsureEngine()
+{
+	static thread_local bool t_ready = false;
+	if (!t_ready)
+	{
+		HAL_HostReset();
+		setupEngine();
+		t_ready = true;
+	}
+}
+
+// RenderChunk
+//
+// Runs the loop on this thread's engine from a chunk's snapshot up to where the next
+// chunk begins, keeping every frame it sends
+
+static void RenderChunk(const Drive & drive, const Keyframe & keyframe, uint64_t untilUs, std::vector<FrameRecord> & frames)
+{
+	DriveCursor cursor = keyframe.cursor;
+
+	EnsureEngine();
+	RestoreSnapshot(keyframe.snapshot);
+	((CaptureOutput *) pOutput)->SetCommitCallback(RecordFrame, &frames);
+
+	while (HAL_HostGetMicros() < untilUs)
+		StepDrive(drive, cursor);
+
+	((CaptureOutput *) pOutput)->SetCommitCallback(nullptr, nullptr);
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char * argv[])
+{
+	double       hours    = 10;
+	uint32_t     chunkMs  = 60000;
+	size_t       cThreads = std::thread::hardware_concurrency();
+	uint32_t     seed     = 0;
+	const char * pszPath  = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-h") && i + 1 < argc)
+			hours = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			chunkMs = (uint32_t) max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			cThreads = (size_t) max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			seed = (uint32_t) strtoul(argv[++i], nullptr, 0);
+		else if (argv[i][0] != '-' && !pszPath)
+			pszPath = argv[i];
+		else
+			pszPath = nullptr, argc = 0;
+	}
+	if (!pszPath)
+	{
+		fprintf(stderr, "usage: parallelrender [-h hours] [-c chunkMs] [-t threads] [-s seed] <scenario.scn>\n");
+		return 2;
+	}
+
+	// The virtual clock is 32 bits of milliseconds, which is about 49 days
+
+	if (hours <= 0 || hours > 24 * 49)
+	{
+		fprintf(stderr, "hours must be more than 0 and at most %d\n", 24 * 49);
+		return 2;
+	}
+
+	Scenario    scenario;
+	std::string error;
+	if (!LoadScenario(pszPath, scenario, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 2;
+	}
+
+	Drive drive;
+	drive.changes  = ExpandScenarioEdges(scenario, seed ? seed : scenario.seed);
+	drive.lengthUs = max(scenario.endUs, (uint64_t) 1000);
+	drive.endUs    = (uint64_t)(hours * 3600e6);
+
+	HAL_HostSetSerialOutput(fopen("/dev/null", "w"));
+
+	printf("%s played for %.2f hours, %u pixels, in chunks of %ums\n",
+		   scenario.name.c_str(), hours, (unsigned) TOTAL_STRIP_PIXELS, (unsigned) chunkMs);
+
+	std::vector<FrameRecord> expected;
+	auto   start      = std::chrono::steady_clock::now();
+	std::thread([&] { RenderSequential(drive, expected); }).join();
+	double sequential = SecondsSince(start);
+
+	printf("sequential        %8.3fs  %10.0f frames/s  (%zu frames)\n", sequential, expected.size() / sequential, expected.size());
+
+	bool failed = false;
+	for (size_t t = 1; t <= cThreads; t = (t == cThreads) ? t + 1 : min(t * 2, cThreads))
+	{
+		std::vector<Keyframe> keyframes;
+
+		start = std::chrono::steady_clock::now();
+		std::thread([&] { FindKeyframes(drive, (uint64_t) chunkMs * 1000, keyframes); }).join();
+		double keyframeSeconds = SecondsSince(start);
+
+		std::vector<std::vector<FrameRecord>> chunks(keyframes.size());
+		{
+			WorkStealingPool pool(t);
+			for (size_t c = 0; c < keyframes.size(); c++)
+			{
+				uint64_t untilUs = c + 1 < keyframes.size() ? keyframes[c + 1].snapshot.host.micros : drive.endUs;
+				pool.Submit([&drive, &keyframes, &chunks, c, untilUs] { RenderChunk(drive, keyframes[c], untilUs, chunks[c]); });
+			}
+			pool.Wait();
+		}
+		double seconds = SecondsSince(start);
+
+		std::vector<FrameRecord> frames;
+		for (const std::vector<FrameRecord> & chunk : chunks)
+			frames.insert(frames.end(), chunk.begin(), chunk.end());
+
+		size_t cMismatched = max(frames.size(), expected.size()) - min(frames.size(), expected.size());
+		for (size_t f = 0; f < min(frames.size(), expected.size()); f++)
+			if (!(frames[f] == expected[f]))
+				cMismatched++;
+		failed |= cMismatched != 0;
+
+		printf("%2zu thread%s        %8.3fs  %10.0f frames/s  speedup %5.2f  (keyframes %.3fs)  %s\n",
+			   t, t == 1 ? " " : "s", seconds, frames.size() / seconds, sequential / seconds, keyframeSeconds,
+			   cMismatched ? "MISMATCH" : "identical");
+		if (cMismatched)
+			printf("   %zu frames differ from the sequential run (%zu sent, %zu expected)\n", cMismatched, frames.size(), expected.size());
+	}
+
+	return failed ? 1 : 0;
+}
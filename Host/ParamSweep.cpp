@@ -0,0 +1,266 @@
+//+--------------------------------------------------------------------------
+//
+// ParamSweep - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        ParamSweep.cpp
+//
+// Description:
+//
+//   Tunes effect timings without flashing anything.  For each effect it
+//   builds a grid of timing combinations, renders every one of them on its
+//   own virtual clock from the moment the event begins, and measures:
+//
+//     lit_pixel_s     Sum over the run of lit pixels times seconds lit
+//     first_light_ms  Time from Begin() until the first pixel lights
+//     flicker_hz      Dark-to-bright transitions per lit pixel per second
+//
+//   Combinations run in parallel on a work-stealing pool across all cores.
+//   Results go to stdout as CSV, timing of the sweep itself to stderr.
+//
+//   Usage:  paramsweep [signal|brake|police|backup|all] [-t threads]
+//                      [-d durationMs] [-s stepMs]
+//
+//   Build:  g++ -std=gnu++11 -O2 -pthread -o paramsweep ParamSweep.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../LightingEvents.h"
+#include "WorkStealingPool.h"
+
+struct SweepResult
+{
+	std::string effect;
+	std::string params;
+	double      litPixelSeconds;
+	long        firstLightMs;							// -1 if it never lit
+	double      flickerHz;
+};
+
+struct SweepOptions
+{
+	uint32_t durationMs;
+	uint32_t stepMs;
+};
+
+// Simulate
+//
+// Runs one event from Begin() for the length of the run, a frame every stepMs, and
+// measures what it drew.  A pixel counts as bright once its channels sum to half of
+// one full channel, so the brake strobe's dim half reads as dark.
+
+static void Simulate(LightingEvent * pEvent, CaptureOutput & output, const SweepOptions & options, SweepResult & result)
+{
+	const uint16_t cPixels = output.GetLength();
+	std::vector<uint8_t> bright(cPixels, 0);
+	std::vector<uint8_t> everLit(cPixels, 0);
+
+	uint64_t litPixelMs = 0;
+	uint64_t cRising    = 0;
+	long     firstLight = -1;
+
+	HAL_HostReset();
+	pEvent->Begin();
+
+	for (uint32_t t = 0; t < options.durationMs; t += options.stepMs)
+	{
+		HAL_SetVirtualMillis(t);
+		output.Clear();
+		pEvent->Draw();
+
+		const uint8_t * p    = output.GetPixels();
+		uint32_t        cLit = 0;
+
+		for (uint16_t i = 0; i < cPixels; i++, p += BYTES_PER_PIXEL)
+		{
+			unsigned luminance = p[0] + p[1] + p[2];
+			uint8_t  isBright  = luminance >= 128;
+
+			if (luminance)
+			{
+				cLit++;
+				everLit[i] = 1;
+			}
+			if (isBright && !bright[i])
+				cRising++;
+			bright[i] = isBright;
+		}
+
+		if (cLit && firstLight < 0)
+			firstLight = t;
+		litPixelMs += (uint64_t) cLit * options.stepMs;
+	}
+
+	uint32_t cEverLit = 0;
+	for (uint16_t i = 0; i < cPixels; i++)
+		cEverLit += everLit[i];
+
+	result.litPixelSeconds = litPixelMs / 1000.0;
+	result.firstLightMs    = firstLight;
+	result.flickerHz       = cEverLit ? cRising / (double) cEverLit / (options.durationMs / 1000.0) : 0.0;
+}
+
+// Each Sweep function adds a task per combination in its grid.  Every task owns its
+// own output, event, and timing, and writes only the result it's handed, so tasks
+// share nothing.
+
+typedef std::function<void(SweepResult &)> SweepTask;
+
+static void SweepSignal(std::vector<SweepTask> & tasks, const SweepOptions & options)
+{
+	for (uint32_t bloom = 200; bloom <= 1000; bloom += 100)
+	 for (uint32_t hold = 100; hold <= 500; hold += 50)
+	  for (uint32_t fade = 25; fade <= 250; fade += 25)
+	   for (uint32_t off = 100; off <= 500; off += 100)
+	   {
+		   tasks.push_back([=](SweepResult & result)
+		   {
+			   SignalTiming  timing = { bloom, hold, fade, off, g_signalTiming.bloomCurve, g_signalTiming.fadeCurve };
+			   CaptureOutput output(NUMBER_USED_PIXELS);
+			   SignalEvent   event(&output, SignalEvent::LEFT_TURN, timing);
+			   char          szParams[80];
+
+			   snprintf(szParams, sizeof(szParams), "bloom=%u hold=%u fade=%u off=%u", bloom, hold, fade, off);
+			   result.effect = "signal";
+			   result.params = szParams;
+			   Simulate(&event, output, options, result);
+		   });
+	   }
+}
+
+static void SweepBrake(std::vector<SweepTask> & tasks, const SweepOptions & options)
+{
+	for (uint32_t strobe = 0; strobe <= 1000; strobe += 100)
+	 for (uint32_t start = 0; start <= 500; start += 50)
+	  for (uint32_t bloom = 100; bloom <= 1000; bloom += 100)
+	   for (uint32_t on = 20; on <= 40; on += 10)
+	    for (uint32_t off = 10; off <= 30; off += 10)
+		{
+			tasks.push_back([=](SweepResult & result)
+			{
+				BrakeTiming   timing = { strobe, start, bloom, on, off, g_brakeTiming.strobeDimAlpha, g_brakeTiming.bloomCurve };
+				CaptureOutput output(NUMBER_USED_PIXELS);
+				BrakingEvent  event(&output, timing);
+				char          szParams[80];
+
+				snprintf(szParams, sizeof(szParams), "strobe=%u start=%u bloom=%u on=%u off=%u", strobe, start, bloom, on, off);
+				result.effect = "brake";
+				result.params = szParams;
+				Simulate(&event, output, options, result);
+			});
+		}
+}
+
+// The police table has long steps (200ms) and short flashes (20ms); sweep each kind
+
+static void SweepPolice(std::vector<SweepTask> & tasks, const SweepOptions & options)
+{
+	const size_t cStates = ARRAYSIZE(g_policeBarStates);
+
+	for (uint32_t longStep = 100; longStep <= 400; longStep += 25)
+	 for (uint32_t shortStep = 10; shortStep <= 60; shortStep += 5)
+	 {
+		 tasks.push_back([=](SweepResult & result)
+		 {
+			 PoliceLightBarState states[cStates];
+			 for (size_t row = 0; row < cStates; row++)
+			 {
+				 states[row] = g_policeBarStates[row];
+				 states[row].duration = states[row].duration >= 100 ? longStep : shortStep;
+			 }
+
+			 CaptureOutput  output(NUMBER_USED_PIXELS);
+			 PoliceLightBar event(&output, states, cStates);
+			 char           szParams[80];
+
+			 snprintf(szParams, sizeof(szParams), "long=%u short=%u", longStep, shortStep);
+			 result.effect = "police";
+			 result.params = szParams;
+			 Simulate(&event, output, options, result);
+		 });
+	 }
+}
+
+static void SweepBackup(std::vector<SweepTask> & tasks, const SweepOptions & options)
+{
+	for (uint32_t bloom = 50; bloom <= 1000; bloom += 50)
+	{
+		tasks.push_back([=](SweepResult & result)
+		{
+			BackupTiming  timing = { bloom, g_backupTiming.bloomCurve };
+			CaptureOutput output(NUMBER_USED_PIXELS);
+			BackupEvent   event(&output, timing);
+			char          szParams[80];
+
+			snprintf(szParams, sizeof(szParams), "bloom=%u", bloom);
+			result.effect = "backup";
+			result.params = szParams;
+			Simulate(&event, output, options, result);
+		});
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const char * pszEffect = "all";
+	size_t       cThreads  = std::thread::hardware_concurrency();
+	SweepOptions options   = { 4000, 1 };
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			cThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			options.durationMs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			options.stepMs = atoi(argv[++i]);
+		else if (argv[i][0] != '-')
+			pszEffect = argv[i];
+		else
+		{
+			fprintf(stderr, "usage: paramsweep [signal|brake|police|backup|all] [-t threads] [-d durationMs] [-s stepMs]\n");
+			return 1;
+		}
+	}
+	if (options.stepMs == 0)
+		options.stepMs = 1;
+
+	std::vector<SweepTask> tasks;
+	bool                   all = !strcmp(pszEffect, "all");
+
+	if (all || !strcmp(pszEffect, "signal")) SweepSignal(tasks, options);
+	if (all || !strcmp(pszEffect, "brake"))  SweepBrake(tasks, options);
+	if (all || !strcmp(pszEffect, "police")) SweepPolice(tasks, options);
+	if (all || !strcmp(pszEffect, "backup")) SweepBackup(tasks, options);
+
+	// Every result has its slot before the first task runs, so the vector never changes
+	// while the workers are writing into it
+
+	std::vector<SweepResult> results(tasks.size());
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		WorkStealingPool pool(cThreads);
+		for (size_t i = 0; i < tasks.size(); i++)
+			pool.Submit([&tasks, &results, i] { tasks[i](results[i]); });
+
+		pool.Wait();
+		cThreads = pool.GetThreadCount();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("effect,params,lit_pixel_s,first_light_ms,flicker_hz\n");
+	for (const SweepResult & result : results)
+		printf("%s,\"%s\",%.3f,%ld,%.3f\n", result.effect.c_str(), result.params.c_str(),
+			   result.litPixelSeconds, result.firstLightMs, result.flickerHz);
+
+	fprintf(stderr, "%zu combinations of %u ms each on %zu threads in %.2f s\n",
+			results.size(), (unsigned) options.durationMs, cThreads, seconds);
+	return 0;
+}
@@ -0,0 +1,846 @@
+#pragma once
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "../Engine.h"
+
+// Scenario
+//
+// A simulated drive written as text, run against the real engine through the host
+// HAL, with assertions on what the strip shows and on how the engine performed.
+// Statements are separated by semicolons or newlines, and # starts a comment:
+//
+//   0ms STOP down; 350ms LEFT down; 1200ms LEFT up; 2s STOP up
+//
+// Switch edges:     <time> LEFT|RIGHT|STOP|BACKUP down|up
+// End of the drive: <time> end          (default: one second after the last statement)
+// Options:          jitter <time>       each edge moves by up to this much either way
+//                   bounce <n> <time>   each edge chatters n times within this window
+//                   seed <n>            seeds jitter and bounce (default 1)
+// Frame checks:     <time> assert pixel <i> <color>     color is a COLOR_ name
+//                   <time> assert lit <op> <n>            without the prefix, or 0xRRGGBB
+//                   <time> assert lcd "<text>"          the top line starts with text
+// Drive metrics:    assert <metric> <op> <value>
+//
+// Times are <n>us, <n>ms or <n>s.  Operators are < <= == != >= >.  Frame checks look
+// at what the strip is showing at that moment.
+//
+// Pixels and counts can be given relative to the strip, so that a scenario reads the
+// same on every vehicle profile: a pixel is a number, "mid", "last", or <n>% of the
+// way from the first pixel to the last; a count of lit pixels is a number, "all", or
+// <n>% of the strip, rounded up.  The scenarios in Scenarios/ only use these.  Their
+// times are still those of the default profile's effect timings, so a profile with
+// other timings can fail a frame check there that its geometry would pass.
+//
+// The metrics, checked once the drive is over, are:
+//
+//   brake_latency   worst time from STOP going down until the middle of the strip
+//                   shows brake red
+//   missed_brakes   times STOP went down and came back up before the strip went red
+//   worst_frame     longest pass through processAndDisplayInputs()
+//   avg_frame       average pass through processAndDisplayInputs()
+//   frames          passes through processAndDisplayInputs()
+//   dropped_inputs  pulses on a switch that began and ended between two reads of
+//                   the switches, so that the engine never saw them
+//
+// Scenarios live in Scenarios/ and are run by Host/ScenarioRunner.cpp.
+
+enum SCENARIO_ASSERT
+{
+	ASSERT_PIXEL = 0,
+	ASSERT_LIT,
+	ASSERT_LCD,
+	ASSERT_METRIC
+};
+
+enum SCENARIO_METRIC
+{
+	METRIC_BRAKE_LATENCY = 0,
+	METRIC_MISSED_BRAKES,
+	METRIC_WORST_FRAME,
+	METRIC_AVERAGE_FRAME,
+	METRIC_FRAMES,
+	METRIC_DROPPED_INPUTS,
+	METRIC_COUNT
+};
+
+enum SCENARIO_COMPARE
+{
+	COMPARE_LT = 0,
+	COMPARE_LE,
+	COMPARE_EQ,
+	COMPARE_NE,
+	COMPARE_GE,
+	COMPARE_GT
+};
+
+static const char * s_metricNames[METRIC_COUNT]  = { "brake_latency", "missed_brakes", "worst_frame", "avg_frame", "frames", "dropped_inputs" };
+static const bool   s_metricIsTime[METRIC_COUNT] = { true, false, true, true, false, false };
+static const char * s_compareNames[]             = { "<", "<=", "==", "!=", ">=", ">" };
+
+struct ScenarioEdge
+{
+	uint64_t us;
+	uint8_t  input;
+	bool     down;
+	bool     chatter;								// Part of a switch's bounce, not a real press or release
+};
+
+struct ScenarioAssert
+{
+	int              line;
+	uint64_t         us;
+	SCENARIO_ASSERT  kind;
+	SCENARIO_COMPARE compare;
+	SCENARIO_METRIC  metric;
+	uint16_t         pixel;
+	uint32_t         color;							// Packed RGB, for ASSERT_PIXEL
+	int64_t          value;							// Microseconds for time metrics
+	std::string      text;
+};
+
+struct Scenario
+{
+	std::string                 name;
+	std::vector<ScenarioEdge>   edges;
+	std::vector<ScenarioAssert> asserts;
+	uint64_t                    endUs;
+	uint64_t                    jitterUs;
+	uint32_t                    bounceCount;
+	uint64_t                    bounceUs;
+	uint32_t                    seed;
+};
+
+struct ScenarioDrop
+{
+	uint64_t us;									// When the pulse that was never seen began
+	uint64_t lengthUs;
+	uint8_t  input;
+	bool     down;									// A press, or a release
+};
+
+struct ScenarioResult
+{
+	bool                     passed;
+	uint64_t                 metrics[METRIC_COUNT];
+	std::vector<std::string> failures;
+
+	uint64_t                 worstBrakeAtUs;		// When the press with the worst latency began
+	uint32_t                 cBrakePresses;
+	std::vector<uint32_t>    frameUs;				// Every pass through the loop, in order
+	std::vector<ScenarioDrop> drops;
+};
+
+// Parsing
+
+static bool ParseScenarioTime(const std::string & token, uint64_t & us)
+{
+	char *   pszEnd;
+	uint64_t n = strtoull(token.c_str(), &pszEnd, 10);
+
+	if (pszEnd == token.c_str())
+		return false;
+	if (!strcmp(pszEnd, "us"))
+		us = n;
+	else if (!strcmp(pszEnd, "ms"))
+		us = n * 1000;
+	else if (!strcmp(pszEnd, "s"))
+		us = n * 1000000;
+	else
+		return false;
+	return true;
+}
+
+static bool ParseScenarioNumber(const std::string & token, int64_t & value)
+{
+	char * pszEnd;
+	value = strtoll(token.c_str(), &pszEnd, 0);
+	return pszEnd != token.c_str() && *pszEnd == '\0';
+}
+
+// A pixel of the used strip, as a number or relative to the strip
+
+static bool ParseScenarioPixel(const std::string & token, int64_t & pixel)
+{
+	int64_t percent;
+	if (token == "mid")
+		pixel = NUMBER_USED_PIXELS / 2;
+	else if (token == "last")
+		pixel = NUMBER_USED_PIXELS - 1;
+	else if (token.size() > 1 && token.back() == '%' && ParseScenarioNumber(token.substr(0, token.size() - 1), percent) && percent >= 0 && percent <= 100)
+		pixel = (NUMBER_USED_PIXELS - 1) * percent / 100;
+	else if (!ParseScenarioNumber(token, pixel))
+		return false;
+	return pixel >= 0 && pixel < NUMBER_USED_PIXELS;
+}
+
+// A count of pixels, as a number or relative to the strip
+
+static bool ParseScenarioCount(const std::string & token, int64_t & count)
+{
+	int64_t percent;
+	if (token == "all")
+		count = NUMBER_USED_PIXELS;
+	else if (token.size() > 1 && token.back() == '%' && ParseScenarioNumber(token.substr(0, token.size() - 1), percent) && percent >= 0 && percent <= 100)
+		count = (NUMBER_USED_PIXELS * percent + 99) / 100;
+	else
+		return ParseScenarioNumber(token, count);
+	return true;
+}
+
+static bool ParseScenarioColor(const std::string & token, uint32_t & color)
+{
+	static const struct { const char * name; uint32_t color; } s_colors[] =
+	{
+		{ "BLACK",    COLOR_BLACK    },
+		{ "WHITE",    COLOR_WHITE    },
+		{ "RED",      COLOR_RED      },
+		{ "DARK_RED", COLOR_DARK_RED },
+		{ "BLUE",     COLOR_BLUE     },
+		{ "AMBER",    COLOR_AMBER    },
+		{ "GREEN",    COLOR_GREEN    },
+		{ "PURPLE",   COLOR_PURPLE   },
+		{ "YELLOW",   COLOR_YELLOW   },
+	};
+
+	for (size_t i = 0; i < ARRAYSIZE(s_colors); i++)
+	{
+		if (!strcasecmp(token.c_str(), s_colors[i].name))
+		{
+			color = s_colors[i].color;
+			return true;
+		}
+	}
+
+	int64_t value;
+	if (!strncasecmp(token.c_str(), "0x", 2) && ParseScenarioNumber(token, value) && value >= 0 && value <= 0xFFFFFF)
+	{
+		color = (uint32_t) value;
+		return true;
+	}
+	return false;
+}
+
+static bool ParseScenarioCompare(const std::string & token, SCENARIO_COMPARE & compare)
+{
+	for (size_t i = 0; i < ARRAYSIZE(s_compareNames); i++)
+	{
+		if (token == s_compareNames[i])
+		{
+			compare = (SCENARIO_COMPARE) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ParseScenarioInput(const std::string & token, uint8_t & input)
+{
+	static const struct { const char * name; uint8_t input; } s_inputs[] =
+	{
+		{ "LEFT",   INPUT_LEFT_TURN  },
+		{ "RIGHT",  INPUT_RIGHT_TURN },
+		{ "STOP",   INPUT_STOP       },
+		{ "BACKUP", INPUT_BACKUP     },
+	};
+
+	for (size_t i = 0; i < ARRAYSIZE(s_inputs); i++)
+	{
+		if (!strcasecmp(token.c_str(), s_inputs[i].name))
+		{
+			input = s_inputs[i].input;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Splits a statement into words, keeping a double-quoted string as one word (without
+// its quotes).  Returns false on an unterminated string.
+
+static bool TokenizeScenarioStatement(const std::string & statement, std::vector<std::string> & tokens)
+{
+	size_t i = 0;
+	while (i < statement.size())
+	{
+		if (isspace((unsigned char) statement[i]))
+		{
+			i++;
+		}
+		else if (statement[i] == '"')
+		{
+			size_t close = statement.find('"', i + 1);
+			if (close == std::string::npos)
+				return false;
+			tokens.push_back(statement.substr(i + 1, close - i - 1));
+			i = close + 1;
+		}
+		else
+		{
+			size_t start = i;
+			while (i < statement.size() && !isspace((unsigned char) statement[i]))
+				i++;
+			tokens.push_back(statement.substr(start, i - start));
+		}
+	}
+	return true;
+}
+
+static bool ParseScenarioStatement(const std::vector<std::string> & tokens, int line, Scenario & scenario, uint64_t & lastUs, std::string & error)
+{
+	size_t   i     = 0;
+	bool     timed = ParseScenarioTime(tokens[0], lastUs);
+	uint64_t us    = lastUs;
+
+	if (timed)
+		i++;
+	if (i >= tokens.size())
+	{
+		error = "expected a command after the time";
+		return false;
+	}
+
+	const std::string & command = tokens[i++];
+	size_t              cArgs   = tokens.size() - i;
+	uint8_t             input;
+
+	if (ParseScenarioInput(command, input))
+	{
+		if (!timed || cArgs != 1 || (tokens[i] != "down" && tokens[i] != "up"))
+		{
+			error = "expected <time> " + command + " down|up";
+			return false;
+		}
+		ScenarioEdge edge = { us, input, tokens[i] == "down", false };
+		scenario.edges.push_back(edge);
+		return true;
+	}
+
+	if (command == "end")
+	{
+		if (!timed || cArgs != 0)
+		{
+			error = "expected <time> end";
+			return false;
+		}
+		scenario.endUs = us;
+		return true;
+	}
+
+	if (command == "jitter")
+	{
+		if (cArgs != 1 || !ParseScenarioTime(tokens[i], scenario.jitterUs))
+		{
+			error = "expected jitter <time>";
+			return false;
+		}
+		return true;
+	}
+
+	if (command == "bounce")
+	{
+		int64_t count;
+		if (cArgs != 2 || !ParseScenarioNumber(tokens[i], count) || count < 0 || count > 100 || !ParseScenarioTime(tokens[i + 1], scenario.bounceUs))
+		{
+			error = "expected bounce <0..100> <time>";
+			return false;
+		}
+		scenario.bounceCount = (uint32_t) count;
+		return true;
+	}
+
+	if (command == "seed")
+	{
+		int64_t seed;
+		if (cArgs != 1 || !ParseScenarioNumber(tokens[i], seed))
+		{
+			error = "expected seed <n>";
+			return false;
+		}
+		scenario.seed = (uint32_t) seed;
+		return true;
+	}
+
+	if (command != "assert" || cArgs == 0)
+	{
+		error = "unknown command '" + command + "'";
+		return false;
+	}
+
+	ScenarioAssert check;
+	check.line    = line;
+	check.us      = us;
+	check.compare = COMPARE_EQ;
+	check.metric  = METRIC_FRAMES;
+	check.pixel   = 0;
+	check.color   = 0;
+	check.value   = 0;
+
+	const std::string & what = tokens[i++];
+	cArgs--;
+
+	if (what == "pixel" || what == "lit" || what == "lcd")
+	{
+		if (!timed)
+		{
+			error = "assert " + what + " needs a time";
+			return false;
+		}
+
+		int64_t value;
+		if (what == "pixel")
+		{
+			check.kind = ASSERT_PIXEL;
+			if (cArgs != 2 || !ParseScenarioPixel(tokens[i], value) || !ParseScenarioColor(tokens[i + 1], check.color))
+			{
+				error = "expected assert pixel <0.." + std::to_string(NUMBER_USED_PIXELS - 1) + "|mid|last|<n>%> <color>";
+				return false;
+			}
+			check.pixel = (uint16_t) value;
+		}
+		else if (what == "lit")
+		{
+			check.kind = ASSERT_LIT;
+			if (cArgs != 2 || !ParseScenarioCompare(tokens[i], check.compare) || !ParseScenarioCount(tokens[i + 1], check.value))
+			{
+				error = "expected assert lit <op> <n|all|<n>%>";
+				return false;
+			}
+		}
+		else
+		{
+			check.kind = ASSERT_LCD;
+			if (cArgs != 1)
+			{
+				error = "expected assert lcd \"<text>\"";
+				return false;
+			}
+			check.text = tokens[i];
+		}
+		scenario.asserts.push_back(check);
+		return true;
+	}
+
+	int metric = 0;
+	while (metric < METRIC_COUNT && what != s_metricNames[metric])
+		metric++;
+	if (metric == METRIC_COUNT)
+	{
+		error = "unknown assertion '" + what + "'";
+		return false;
+	}
+
+	check.kind   = ASSERT_METRIC;
+	check.metric = (SCENARIO_METRIC) metric;
+
+	bool ok = !timed && cArgs == 2 && ParseScenarioCompare(tokens[i], check.compare);
+	if (ok && s_metricIsTime[metric])
+	{
+		uint64_t value;
+		ok = ParseScenarioTime(tokens[i + 1], value);
+		check.value = (int64_t) value;
+	}
+	else if (ok)
+	{
+		ok = ParseScenarioNumber(tokens[i + 1], check.value);
+	}
+
+	if (!ok)
+	{
+		error = "expected assert " + what + " <op> <value>, with no time";
+		return false;
+	}
+	scenario.asserts.push_back(check);
+	return true;
+}
+
+// ParseScenario
+//
+// Parses scenario text into a Scenario.  On failure returns false with the offending
+// line number in the error.
+
+static bool ParseScenario(const char * pszText, Scenario & scenario, std::string & error)
+{
+	scenario.edges.clear();
+	scenario.asserts.clear();
+	scenario.endUs       = 0;
+	scenario.jitterUs    = 0;
+	scenario.bounceCount = 0;
+	scenario.bounceUs    = 0;
+	scenario.seed        = 1;
+
+	uint64_t lastUs = 0;
+	uint64_t maxUs  = 0;
+	int      line   = 1;
+
+	for (const char * p = pszText; *p; )
+	{
+		// One statement runs to the next semicolon or newline; a comment runs to the
+		// end of the line
+
+		size_t      cch       = strcspn(p, ";\n#");
+		std::string statement(p, cch);
+		p += cch;
+		if (*p == '#')
+			p += strcspn(p, "\n");
+
+		std::vector<std::string> tokens;
+		if (!TokenizeScenarioStatement(statement, tokens))
+		{
+			error = "line " + std::to_string(line) + ": unterminated string";
+			return false;
+		}
+		if (!tokens.empty())
+		{
+			std::string statementError;
+			if (!ParseScenarioStatement(tokens, line, scenario, lastUs, statementError))
+			{
+				error = "line " + std::to_string(line) + ": " + statementError;
+				return false;
+			}
+			maxUs = max(maxUs, lastUs);
+		}
+
+		if (*p == '\n')
+			line++;
+		if (*p)
+			p++;
+	}
+
+	if (scenario.endUs == 0)
+		scenario.endUs = maxUs + 1000000;
+
+	std::stable_sort(scenario.edges.begin(), scenario.edges.end(),
+					 [](const ScenarioEdge & a, const ScenarioEdge & b) { return a.us < b.us; });
+	return true;
+}
+
+static inline bool LoadScenario(const char * pszPath, Scenario & scenario, std::string & error)
+{
+	FILE * pFile = fopen(pszPath, "rb");
+	if (!pFile)
+	{
+		error = std::string("can't open ") + pszPath;
+		return false;
+	}
+
+	std::string text;
+	char        buf[4096];
+	size_t      cb;
+	while ((cb = fread(buf, 1, sizeof(buf), pFile)) > 0)
+		text.append(buf, cb);
+	fclose(pFile);
+
+	const char * pszName = strrchr(pszPath, '/');
+	scenario.name = pszName ? pszName + 1 : pszPath;
+	return ParseScenario(text.c_str(), scenario, error);
+}
+
+// Running
+
+static bool CompareScenarioValue(int64_t actual, SCENARIO_COMPARE compare, int64_t expected)
+{
+	switch (compare)
+	{
+		case COMPARE_LT: return actual <  expected;
+		case COMPARE_LE: return actual <= expected;
+		case COMPARE_EQ: return actual == expected;
+		case COMPARE_NE: return actual != expected;
+		case COMPARE_GE: return actual >= expected;
+		case COMPARE_GT: return actual >  expected;
+	}
+	return false;
+}
+
+// The strip shows brake red when its middle pixel is mostly red (GRB order)
+
+static bool IsBrakeRed(const uint8_t * pFrame)
+{
+	const uint8_t * p = pFrame + (NUMBER_USED_PIXELS / 2) * BYTES_PER_PIXEL;
+	return p[1] >= 128 && p[0] < 64 && p[2] < 64;
+}
+
+struct ScenarioRunState
+{
+	bool     brakePending;
+	uint64_t brakeDownUs;
+	uint64_t worstBrakeUs;
+	uint64_t worstBrakeAtUs;
+	uint32_t cMissedBrakes;
+	uint32_t cBrakePresses;
+};
+
+static void ScenarioCommitCallback(const uint8_t * pFrame, uint16_t, void * pContext)
+{
+	ScenarioRunState * pState = (ScenarioRunState *) pContext;
+	if (pState->brakePending && IsBrakeRed(pFrame))
+	{
+		uint64_t latencyUs = HAL_HostGetMicros() - pState->brakeDownUs;
+		if (latencyUs > pState->worstBrakeUs)
+		{
+			pState->worstBrakeUs   = latencyUs;
+			pState->worstBrakeAtUs = pState->brakeDownUs;
+		}
+		pState->brakePending = false;
+		HAL_HostTrace('i', "inputs", "brake red", (int) latencyUs, HAL_HostGetMicros());
+	}
+}
+
+// What a switch change is called in a trace: the edge itself, or a bounce around it
+
+static const char * ScenarioTraceName(uint8_t input, bool down, bool edge)
+{
+	static const char * s_names[][3] =
+	{
+		{ "LEFT off",   "LEFT on",   "LEFT bounce"   },
+		{ "RIGHT off",  "RIGHT on",  "RIGHT bounce"  },
+		{ "STOP off",   "STOP on",   "STOP bounce"   },
+		{ "BACKUP off", "BACKUP on", "BACKUP bounce" },
+	};
+
+	size_t iInput = 0;
+	while (iInput + 1 < ARRAYSIZE(s_names) && !(input & (1 << iInput)))
+		iInput++;
+	return s_names[iInput][edge ? (down ? 1 : 0) : 2];
+}
+
+// ExpandScenarioEdges
+//
+// Turns the scenario's clean edges into what the switches actually do: each edge is
+// moved by jitter, then followed by bounce pairs (off and back on again, or the
+// reverse) at random moments inside the bounce window.  Returns the changes in time
+// order; the first change of each edge is flagged as the edge itself.
+
+struct ScenarioChange
+{
+	uint64_t us;
+	uint8_t  input;
+	bool     down;
+	bool     edge;
+};
+
+static std::vector<ScenarioChange> ExpandScenarioEdges(const Scenario & scenario, uint32_t seed)
+{
+	std::mt19937                 random(seed);
+	std::vector<ScenarioChange>  changes;
+
+	for (const ScenarioEdge & edge : scenario.edges)
+	{
+		int64_t us = (int64_t) edge.us;
+		if (scenario.jitterUs)
+			us += std::uniform_int_distribution<int64_t>(-(int64_t) scenario.jitterUs, (int64_t) scenario.jitterUs)(random);
+		us = max(us, (int64_t) 0);
+
+		ScenarioChange change = { (uint64_t) us, edge.input, edge.down, !edge.chatter };
+		changes.push_back(change);
+
+		if (scenario.bounceCount && scenario.bounceUs)
+		{
+			std::vector<uint64_t> offsets;
+			std::uniform_int_distribution<uint64_t> within(1, scenario.bounceUs);
+			for (uint32_t i = 0; i < scenario.bounceCount * 2; i++)
+				offsets.push_back(within(random));
+			std::sort(offsets.begin(), offsets.end());
+
+			for (size_t i = 0; i < offsets.size(); i++)
+			{
+				ScenarioChange bounce = { (uint64_t) us + offsets[i], edge.input, (i & 1) ? edge.down : !edge.down, false };
+				changes.push_back(bounce);
+			}
+		}
+	}
+
+	std::stable_sort(changes.begin(), changes.end(),
+					 [](const ScenarioChange & a, const ScenarioChange & b) { return a.us < b.us; });
+	return changes;
+}
+
+static void FailScenario(ScenarioResult & result, int line, const char * pszFormat, ...) __attribute__((format(printf, 3, 4)));
+
+static void FailScenario(ScenarioResult & result, int line, const char * pszFormat, ...)
+{
+	char szBuf[256];
+	int  cch = snprintf(szBuf, sizeof(szBuf), "line %d: ", line);
+
+	va_list args;
+	va_start(args, pszFormat);
+	vsnprintf(szBuf + cch, sizeof(szBuf) - cch, pszFormat, args);
+	va_end(args);
+
+	result.failures.push_back(szBuf);
+	result.passed = false;
+}
+
+static void CheckScenarioFrame(const ScenarioAssert & check, const uint8_t * pFrame, ScenarioResult & result)
+{
+	double ms = check.us / 1000.0;
+
+	if (check.kind == ASSERT_PIXEL)
+	{
+		const uint8_t * p     = pFrame + check.pixel * BYTES_PER_PIXEL;
+		uint32_t        color = PACK_RGB(p[1], p[0], p[2]);
+		if (color != check.color)
+			FailScenario(result, check.line, "at %.0fms pixel %u is 0x%06lX, expected 0x%06lX",
+						 ms, (unsigned) check.pixel, (unsigned long) color, (unsigned long) check.color);
+	}
+	else if (check.kind == ASSERT_LIT)
+	{
+		int64_t cLit = 0;
+		for (uint16_t i = 0; i < NUMBER_USED_PIXELS; i++)
+			cLit += (pFrame[i * 3] | pFrame[i * 3 + 1] | pFrame[i * 3 + 2]) != 0;
+		if (!CompareScenarioValue(cLit, check.compare, check.value))
+			FailScenario(result, check.line, "at %.0fms %lld pixels lit, expected %s %lld",
+						 ms, (long long) cLit, s_compareNames[check.compare], (long long) check.value);
+	}
+	else if (check.kind == ASSERT_LCD)
+	{
+		const char * pszRow = HAL_HostGetLcdRow(0);
+		if (strncmp(pszRow, check.text.c_str(), check.text.size()))
+			FailScenario(result, check.line, "at %.0fms LCD reads \"%s\", expected \"%s\"", ms, pszRow, check.text.c_str());
+	}
+}
+
+// RunScenario
+//
+// Runs the engine from scratch through the scenario, a pass of the main loop every
+// millisecond of virtual time just as loop() does, and checks every assertion.
+
+static inline void RunScenario(const Scenario & scenario, uint32_t seed, ScenarioResult & result)
+{
+	std::vector<ScenarioChange> changes = ExpandScenarioEdges(scenario, seed);
+	ScenarioRunState            state   = { false, 0, 0, 0, 0, 0 };
+
+	result.passed = true;
+	result.failures.clear();
+	result.frameUs.clear();
+	result.drops.clear();
+	memset(result.metrics, 0, sizeof(result.metrics));
+
+	HAL_HostReset();
+	setupEngine();
+
+	CaptureOutput * pCapture = (CaptureOutput *) pOutput;
+	pCapture->SetCommitCallback(ScenarioCommitCallback, &state);
+
+	std::vector<bool> checked(scenario.asserts.size(), false);
+	size_t            iChange = 0;
+	uint8_t           inputs  = 0;
+	uint64_t          totalUs = 0;
+
+	while (HAL_HostGetMicros() < scenario.endUs)
+	{
+		uint64_t now = HAL_HostGetMicros();
+
+		// Frame checks see the strip as it is right now, before this pass changes it
+
+		for (size_t i = 0; i < scenario.asserts.size(); i++)
+		{
+			if (!checked[i] && scenario.asserts[i].kind != ASSERT_METRIC && scenario.asserts[i].us <= now)
+			{
+				CheckScenarioFrame(scenario.asserts[i], pCapture->GetCapturedFrame(), result);
+				checked[i] = true;
+			}
+		}
+
+		// Apply every change up to now.  Any pulse that both began and ended in this
+		// batch happened entirely between two reads of the switches and was dropped.
+		// If a switch ends the batch changed, its first change is the one the engine
+		// sees and the pulses are what follow it.
+
+		const uint8_t before = inputs;
+		size_t        iBatch = iChange;
+		for (; iChange < changes.size() && changes[iChange].us <= now; iChange++)
+		{
+			const ScenarioChange & change = changes[iChange];
+			if (change.down)
+				inputs |= change.input;
+			else
+				inputs &= ~change.input;
+			HAL_HostTrace('i', "inputs", ScenarioTraceName(change.input, change.down, change.edge), inputs, change.us);
+
+			if (change.edge && change.input == INPUT_STOP)
+			{
+				if (change.down && !state.brakePending)
+				{
+					state.brakePending = true;
+					state.brakeDownUs  = change.us;
+					state.cBrakePresses++;
+				}
+				else if (!change.down && state.brakePending)
+				{
+					state.brakePending = false;
+					state.cMissedBrakes++;
+				}
+			}
+		}
+		HAL_HostSetInputs(inputs);
+
+		for (uint8_t bit = 1; bit <= INPUT_BACKUP; bit <<= 1)
+		{
+			// Collect this switch's real transitions in the batch, skipping changes to
+			// the level it was already at
+
+			std::vector<const ScenarioChange *> toggles;
+			bool level = (before & bit) != 0;
+			for (size_t i = iBatch; i < iChange; i++)
+			{
+				if (changes[i].input == bit && changes[i].down != level)
+				{
+					toggles.push_back(&changes[i]);
+					level = changes[i].down;
+				}
+			}
+
+			for (size_t i = toggles.size() & 1; i + 1 < toggles.size(); i += 2)
+			{
+				ScenarioDrop drop = { toggles[i]->us, toggles[i + 1]->us - toggles[i]->us, bit, toggles[i]->down };
+				result.drops.push_back(drop);
+				HAL_HostTrace('i', "inputs", "dropped", (int) drop.lengthUs, drop.us);
+			}
+		}
+
+		processAndDisplayInputs();
+
+		uint64_t frameUs = HAL_HostGetMicros() - now;
+		result.frameUs.push_back((uint32_t) frameUs);
+		totalUs += frameUs;
+		result.metrics[METRIC_FRAMES]++;
+		result.metrics[METRIC_WORST_FRAME] = max(result.metrics[METRIC_WORST_FRAME], frameUs);
+
+		HAL_Delay(1);
+	}
+
+	result.metrics[METRIC_BRAKE_LATENCY] = state.worstBrakeUs;
+	result.metrics[METRIC_MISSED_BRAKES] = state.cMissedBrakes + (state.brakePending ? 1 : 0);
+	result.metrics[METRIC_AVERAGE_FRAME] = result.metrics[METRIC_FRAMES] ? totalUs / result.metrics[METRIC_FRAMES] : 0;
+	result.metrics[METRIC_DROPPED_INPUTS] = result.drops.size();
+	result.worstBrakeAtUs                = state.worstBrakeAtUs;
+	result.cBrakePresses                 = state.cBrakePresses;
+
+	for (size_t i = 0; i < scenario.asserts.size(); i++)
+	{
+		const ScenarioAssert & check = scenario.asserts[i];
+		if (check.kind == ASSERT_METRIC)
+		{
+			int64_t actual = (int64_t) result.metrics[check.metric];
+			if (!CompareScenarioValue(actual, check.compare, check.value))
+				FailScenario(result, check.line, "%s is %lld%s, expected %s %lld%s", s_metricNames[check.metric],
+							 (long long) actual, s_metricIsTime[check.metric] ? "us" : "",
+							 s_compareNames[check.compare], (long long) check.value, s_metricIsTime[check.metric] ? "us" : "");
+		}
+		else if (!checked[i])
+		{
+			FailScenario(result, check.line, "the drive ended before %.0fms", check.us / 1000.0);
+		}
+	}
+
+	shutdownEngine();
+}
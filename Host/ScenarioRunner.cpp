@@ -0,0 +1,161 @@
+//+--------------------------------------------------------------------------
+//
+// ScenarioRunner - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        ScenarioRunner.cpp
+//
+// Description:
+//
+//   Runs scenario files (see Host/Scenario.h for the format) against the
+//   real engine on the host and reports each one's assertions and metrics.
+//   Exits non-zero if any assertion fails, so the drive cycles in
+//   Scenarios/ work as a regression suite:
+//
+//       scenario ../Scenarios/*.scn
+//
+//   With -r each scenario is run that many times, with a different seed
+//   for its jitter and bounce each time, and the wall-clock time spent is
+//   reported, which makes the same files a performance workload.
+//
+//   -q leaves out the timing, -v shows the engine's serial output.
+//
+//   -t writes a timeline of the first run of each scenario, on the virtual
+//   clock, as a Chrome trace: open it in ui.perfetto.dev or chrome://tracing
+//   to see each pass, layer draw, strip show, and LCD print against the
+//   switch edges and when the brake light came on.
+//
+//   Usage:  scenario [-r runs] [-s seed] [-t trace.json] [-q] [-v] file.scn ...
+//
+//   Build:  g++ -std=gnu++11 -O2 -o scenario ScenarioRunner.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "Scenario.h"
+#include "ChromeTrace.h"
+
+int main(int argc, char * argv[])
+{
+	int      cRuns     = 1;
+	bool     haveSeed  = false;
+	uint32_t seed      = 0;
+	bool     quiet     = false;
+	bool     verbose   = false;
+	const char * pszTrace = nullptr;
+	int      cFailed   = 0;
+	int      cFiles    = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			cRuns = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+		{
+			seed     = (uint32_t) strtoul(argv[++i], nullptr, 0);
+			haveSeed = true;
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			pszTrace = argv[++i];
+		else if (!strcmp(argv[i], "-q"))
+			quiet = true;
+		else if (!strcmp(argv[i], "-v"))
+			verbose = true;
+		else if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: scenario [-r runs] [-s seed] [-t trace.json] [-q] [-v] file.scn ...\n");
+			return 2;
+		}
+	}
+
+	// The engine's serial output (startup banner, governor changes) would otherwise be
+	// mixed into the report, so it goes to stderr with -v and nowhere without
+
+	HAL_HostSetSerialOutput(verbose ? stderr : fopen("/dev/null", "w"));
+
+	if (pszTrace && !ChromeTraceOpen(pszTrace))
+	{
+		fprintf(stderr, "%s: can't write\n", pszTrace);
+		return 2;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "-s") || !strcmp(argv[i], "-t"))
+				i++;
+			continue;
+		}
+
+		Scenario    scenario;
+		std::string error;
+		cFiles++;
+
+		if (!LoadScenario(argv[i], scenario, error))
+		{
+			fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+			cFailed++;
+			continue;
+		}
+
+		uint64_t worst[METRIC_COUNT] = { 0 };
+		uint64_t cFrames = 0;
+		bool     passed  = true;
+		auto     start   = std::chrono::steady_clock::now();
+
+		for (int run = 0; run < cRuns; run++)
+		{
+			ScenarioResult result;
+			uint32_t       runSeed = (haveSeed ? seed : scenario.seed) + run;
+
+			// Only the first run is traced; the rest would just be drawn over it
+
+			if (run == 0)
+				ChromeTraceProcess(scenario.name.c_str());
+			else if (run == 1)
+				HAL_HostSetTrace(nullptr);
+
+			RunScenario(scenario, runSeed, result);
+
+			for (int m = 0; m < METRIC_COUNT; m++)
+				worst[m] = max(worst[m], result.metrics[m]);
+			cFrames += result.metrics[METRIC_FRAMES];
+
+			if (!result.passed)
+			{
+				passed = false;
+				for (const std::string & failure : result.failures)
+					fprintf(stderr, "%s (seed %u): %s\n", scenario.name.c_str(), (unsigned) runSeed, failure.c_str());
+			}
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if (!passed)
+			cFailed++;
+
+		printf("%-4s %-28s brake %5.1fms  missed %llu  dropped %llu  worst %6.2fms  avg %6.2fms",
+			   passed ? "PASS" : "FAIL", scenario.name.c_str(),
+			   worst[METRIC_BRAKE_LATENCY] / 1000.0, (unsigned long long) worst[METRIC_MISSED_BRAKES],
+			   (unsigned long long) worst[METRIC_DROPPED_INPUTS],
+			   worst[METRIC_WORST_FRAME] / 1000.0, worst[METRIC_AVERAGE_FRAME] / 1000.0);
+		if (!quiet)
+			printf("  %d run%s, %llu frames in %.2fms (%.0f frames/s)",
+				   cRuns, cRuns == 1 ? "" : "s", (unsigned long long) cFrames, seconds * 1000.0, seconds > 0 ? cFrames / seconds : 0.0);
+		printf("\n");
+	}
+
+	ChromeTraceClose();
+
+	if (cFiles == 0)
+	{
+		fprintf(stderr, "usage: scenario [-r runs] [-s seed] [-t trace.json] [-q] [-v] file.scn ...\n");
+		return 2;
+	}
+
+	printf("%d of %d scenarios passed\n", cFiles - cFailed, cFiles);
+	return cFailed ? 1 : 0;
+}
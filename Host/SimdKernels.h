@@ -0,0 +1,347 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "../LayerBlend.h"
+
+// SimdKernels
+//
+// Host-only versions of the compositor's byte kernels for strips far longer than any
+// AVR will ever drive: span fill and blend (every BLEND_MODE), gamma, and brightness.
+// Each comes in three flavors - the scalar firmware kernel, SSE2, and AVX2 - and all
+// three produce byte-identical output, so a result measured on a million-pixel virtual
+// strip says something about the same algorithm that runs on the car.
+//
+// A solid color repeats every 3 bytes and a vector is 16 or 32 bytes, so the SIMD fill
+// and blend loops work in blocks of 48 or 96 bytes (16 or 32 pixels) using three
+// pre-rotated copies of the color.  Whatever is left over at the end of a span goes to
+// the scalar kernel.
+//
+// The SSE2 and AVX2 paths are compiled with per-function target attributes so that the
+// file builds without -mavx2, and SimdBestLevel() picks one at run time.
+
+enum SIMD_LEVEL
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_LEVEL_COUNT
+};
+
+static const char * SimdLevelName(SIMD_LEVEL level)
+{
+	static const char * s_names[SIMD_LEVEL_COUNT] = { "scalar", "sse2", "avx2" };
+	return level < SIMD_LEVEL_COUNT ? s_names[level] : "?";
+}
+
+// GammaSpan
+//
+// A cheap gamma of 2: (x * x + x) >> 8, which maps 0 to 0 and 255 to 255 and keeps
+// every intermediate within 16 unsigned bits so the vector versions can match it.
+
+static inline void GammaSpan(uint8_t * p, size_t cBytes)
+{
+	for (uint8_t * pEnd = p + cBytes; p < pEnd; p++)
+		*p = (uint8_t)(((unsigned) *p * *p + *p) >> 8);
+}
+
+// The firmware kernels count in 16 bits, so long spans are fed to them in pieces.
+// Blend pieces are a whole number of pixels, which keeps the color in phase.
+
+static inline void ScalarFillSpan(uint8_t * pDst, size_t cPixels, const uint8_t * pSrc, BLEND_MODE mode, uint8_t alpha)
+{
+	while (cPixels)
+	{
+		uint16_t cChunk = cPixels > 0xFFFF ? 0xFFFF : (uint16_t) cPixels;
+		BlendFillSpan(pDst, cChunk, pSrc, mode, alpha);
+		pDst    += (size_t) cChunk * BYTES_PER_PIXEL;
+		cPixels -= cChunk;
+	}
+}
+
+static inline void ScalarScaleSpan(uint8_t * p, size_t cBytes, uint8_t brightness)
+{
+	while (cBytes)
+	{
+		uint16_t cChunk = cBytes > 0xFFFF ? 0xFFFF : (uint16_t) cBytes;
+		ScaleSpan(p, cChunk, brightness);
+		p      += cChunk;
+		cBytes -= cChunk;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_SIMD_KERNELS
+#include <immintrin.h>
+
+// SSE2
+
+__attribute__((target("sse2")))
+static void Sse2FillSpan(uint8_t * pDst, size_t cPixels, const uint8_t * pSrc, BLEND_MODE mode, uint8_t alpha)
+{
+	uint8_t pattern[48];
+	for (int i = 0; i < 48; i++)
+		pattern[i] = pSrc[i % BYTES_PER_PIXEL];
+
+	const __m128i zero = _mm_setzero_si128();
+	__m128i src[3];
+	for (int k = 0; k < 3; k++)
+		src[k] = _mm_loadu_si128((const __m128i *)(pattern + 16 * k));
+
+	size_t    cBlocks = cPixels / 16;
+	uint8_t * p       = pDst;
+
+	switch (mode)
+	{
+		case BLEND_REPLACE:
+			for (size_t b = 0; b < cBlocks; b++, p += 48)
+				for (int k = 0; k < 3; k++)
+					_mm_storeu_si128((__m128i *)(p + 16 * k), src[k]);
+			break;
+
+		case BLEND_MAX:
+			for (size_t b = 0; b < cBlocks; b++, p += 48)
+				for (int k = 0; k < 3; k++)
+				{
+					__m128i d = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+					_mm_storeu_si128((__m128i *)(p + 16 * k), _mm_max_epu8(d, src[k]));
+				}
+			break;
+
+		case BLEND_ADD:
+			for (size_t b = 0; b < cBlocks; b++, p += 48)
+				for (int k = 0; k < 3; k++)
+				{
+					__m128i d = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+					_mm_storeu_si128((__m128i *)(p + 16 * k), _mm_adds_epu8(d, src[k]));
+				}
+			break;
+
+		case BLEND_ALPHA:
+		{
+			uint16_t a   = alpha + (alpha >> 7);
+			__m128i  vA  = _mm_set1_epi16((short) a);
+			__m128i  inv = _mm_set1_epi16((short)(256 - a));
+			__m128i  srcLo[3], srcHi[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				srcLo[k] = _mm_mullo_epi16(_mm_unpacklo_epi8(src[k], zero), vA);
+				srcHi[k] = _mm_mullo_epi16(_mm_unpackhi_epi8(src[k], zero), vA);
+			}
+
+			for (size_t b = 0; b < cBlocks; b++, p += 48)
+				for (int k = 0; k < 3; k++)
+				{
+					__m128i d  = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+					__m128i lo = _mm_srli_epi16(_mm_add_epi16(srcLo[k], _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv)), 8);
+					__m128i hi = _mm_srli_epi16(_mm_add_epi16(srcHi[k], _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv)), 8);
+					_mm_storeu_si128((__m128i *)(p + 16 * k), _mm_packus_epi16(lo, hi));
+				}
+			break;
+		}
+	}
+
+	ScalarFillSpan(p, cPixels - cBlocks * 16, pSrc, mode, alpha);
+}
+
+__attribute__((target("sse2")))
+static void Sse2GammaSpan(uint8_t * p, size_t cBytes)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint8_t *     pEnd = p + (cBytes & ~(size_t) 15);
+
+	for (; p < pEnd; p += 16)
+	{
+		__m128i d  = _mm_loadu_si128((const __m128i *) p);
+		__m128i lo = _mm_unpacklo_epi8(d, zero);
+		__m128i hi = _mm_unpackhi_epi8(d, zero);
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, lo), lo), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, hi), hi), 8);
+		_mm_storeu_si128((__m128i *) p, _mm_packus_epi16(lo, hi));
+	}
+	GammaSpan(p, cBytes & 15);
+}
+
+__attribute__((target("sse2")))
+static void Sse2ScaleSpan(uint8_t * p, size_t cBytes, uint8_t brightness)
+{
+	const __m128i zero  = _mm_setzero_si128();
+	const __m128i scale = _mm_set1_epi16((short)(brightness + 1));
+	uint8_t *     pEnd  = p + (cBytes & ~(size_t) 15);
+
+	for (; p < pEnd; p += 16)
+	{
+		__m128i d  = _mm_loadu_si128((const __m128i *) p);
+		__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), scale), 8);
+		__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), scale), 8);
+		_mm_storeu_si128((__m128i *) p, _mm_packus_epi16(lo, hi));
+	}
+	ScalarScaleSpan(p, cBytes & 15, brightness);
+}
+
+// AVX2
+//
+// The 256-bit unpack and pack instructions work within each 128-bit half, so the
+// widened halves come back in the same order they went out and nothing needs a
+// cross-lane shuffle.
+
+__attribute__((target("avx2")))
+static void Avx2FillSpan(uint8_t * pDst, size_t cPixels, const uint8_t * pSrc, BLEND_MODE mode, uint8_t alpha)
+{
+	uint8_t pattern[96];
+	for (int i = 0; i < 96; i++)
+		pattern[i] = pSrc[i % BYTES_PER_PIXEL];
+
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i src[3];
+	for (int k = 0; k < 3; k++)
+		src[k] = _mm256_loadu_si256((const __m256i *)(pattern + 32 * k));
+
+	size_t    cBlocks = cPixels / 32;
+	uint8_t * p       = pDst;
+
+	switch (mode)
+	{
+		case BLEND_REPLACE:
+			for (size_t b = 0; b < cBlocks; b++, p += 96)
+				for (int k = 0; k < 3; k++)
+					_mm256_storeu_si256((__m256i *)(p + 32 * k), src[k]);
+			break;
+
+		case BLEND_MAX:
+			for (size_t b = 0; b < cBlocks; b++, p += 96)
+				for (int k = 0; k < 3; k++)
+				{
+					__m256i d = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+					_mm256_storeu_si256((__m256i *)(p + 32 * k), _mm256_max_epu8(d, src[k]));
+				}
+			break;
+
+		case BLEND_ADD:
+			for (size_t b = 0; b < cBlocks; b++, p += 96)
+				for (int k = 0; k < 3; k++)
+				{
+					__m256i d = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+					_mm256_storeu_si256((__m256i *)(p + 32 * k), _mm256_adds_epu8(d, src[k]));
+				}
+			break;
+
+		case BLEND_ALPHA:
+		{
+			uint16_t a   = alpha + (alpha >> 7);
+			__m256i  vA  = _mm256_set1_epi16((short) a);
+			__m256i  inv = _mm256_set1_epi16((short)(256 - a));
+			__m256i  srcLo[3], srcHi[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				srcLo[k] = _mm256_mullo_epi16(_mm256_unpacklo_epi8(src[k], zero), vA);
+				srcHi[k] = _mm256_mullo_epi16(_mm256_unpackhi_epi8(src[k], zero), vA);
+			}
+
+			for (size_t b = 0; b < cBlocks; b++, p += 96)
+				for (int k = 0; k < 3; k++)
+				{
+					__m256i d  = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+					__m256i lo = _mm256_srli_epi16(_mm256_add_epi16(srcLo[k], _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inv)), 8);
+					__m256i hi = _mm256_srli_epi16(_mm256_add_epi16(srcHi[k], _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inv)), 8);
+					_mm256_storeu_si256((__m256i *)(p + 32 * k), _mm256_packus_epi16(lo, hi));
+				}
+			break;
+		}
+	}
+
+	ScalarFillSpan(p, cPixels - cBlocks * 32, pSrc, mode, alpha);
+}
+
+__attribute__((target("avx2")))
+static void Avx2GammaSpan(uint8_t * p, size_t cBytes)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	uint8_t *     pEnd = p + (cBytes & ~(size_t) 31);
+
+	for (; p < pEnd; p += 32)
+	{
+		__m256i d  = _mm256_loadu_si256((const __m256i *) p);
+		__m256i lo = _mm256_unpacklo_epi8(d, zero);
+		__m256i hi = _mm256_unpackhi_epi8(d, zero);
+		lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, lo), lo), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, hi), hi), 8);
+		_mm256_storeu_si256((__m256i *) p, _mm256_packus_epi16(lo, hi));
+	}
+	GammaSpan(p, cBytes & 31);
+}
+
+__attribute__((target("avx2")))
+static void Avx2ScaleSpan(uint8_t * p, size_t cBytes, uint8_t brightness)
+{
+	const __m256i zero  = _mm256_setzero_si256();
+	const __m256i scale = _mm256_set1_epi16((short)(brightness + 1));
+	uint8_t *     pEnd  = p + (cBytes & ~(size_t) 31);
+
+	for (; p < pEnd; p += 32)
+	{
+		__m256i d  = _mm256_loadu_si256((const __m256i *) p);
+		__m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), scale), 8);
+		__m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), scale), 8);
+		_mm256_storeu_si256((__m256i *) p, _mm256_packus_epi16(lo, hi));
+	}
+	ScalarScaleSpan(p, cBytes & 31, brightness);
+}
+
+#endif // x86
+
+// SimdBestLevel
+//
+// The widest level this CPU can run.
+
+static SIMD_LEVEL SimdBestLevel()
+{
+#ifdef HAVE_SIMD_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+// Dispatchers.  Asking for a level the build doesn't have falls back to scalar.
+
+static void SimdFillSpan(SIMD_LEVEL level, uint8_t * pDst, size_t cPixels, const uint8_t * pSrc, BLEND_MODE mode, uint8_t alpha = 255)
+{
+	switch (level)
+	{
+#ifdef HAVE_SIMD_KERNELS
+		case SIMD_SSE2: Sse2FillSpan(pDst, cPixels, pSrc, mode, alpha); return;
+		case SIMD_AVX2: Avx2FillSpan(pDst, cPixels, pSrc, mode, alpha); return;
+#endif
+		default:        ScalarFillSpan(pDst, cPixels, pSrc, mode, alpha); return;
+	}
+}
+
+static void SimdGammaSpan(SIMD_LEVEL level, uint8_t * p, size_t cBytes)
+{
+	switch (level)
+	{
+#ifdef HAVE_SIMD_KERNELS
+		case SIMD_SSE2: Sse2GammaSpan(p, cBytes); return;
+		case SIMD_AVX2: Avx2GammaSpan(p, cBytes); return;
+#endif
+		default:        GammaSpan(p, cBytes); return;
+	}
+}
+
+static void SimdScaleSpan(SIMD_LEVEL level, uint8_t * p, size_t cBytes, uint8_t brightness)
+{
+	switch (level)
+	{
+#ifdef HAVE_SIMD_KERNELS
+		case SIMD_SSE2: Sse2ScaleSpan(p, cBytes, brightness); return;
+		case SIMD_AVX2: Avx2ScaleSpan(p, cBytes, brightness); return;
+#endif
+		default:        ScalarScaleSpan(p, cBytes, brightness); return;
+	}
+}
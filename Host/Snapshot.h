@@ -0,0 +1,148 @@
+#pragma once
+#include <vector>
+#include "Scenario.h"
+
+// Snapshot
+//
+// The whole simulation at one moment: the simulated board (clock, switches, LCD,
+// EEPROM, serial) and the engine (EngineSnapshot in Engine.h), plus the frame that's
+// on the strip.  Restoring one puts the simulation back exactly where it was, so
+// stepping on from it gives the same frames, to the byte, as having run there from
+// the start.
+
+struct HostSnapshot
+{
+	HostState      host;
+	EngineSnapshot engine;
+	uint8_t        strip[TOTAL_STRIP_PIXELS * BYTES_PER_PIXEL];
+	unsigned long  cFrames;
+};
+
+static void TakeSnapshot(HostSnapshot & snapshot)
+{
+	CaptureOutput * pCapture = (CaptureOutput *) pOutput;
+
+	HAL_HostSaveState(snapshot.host);
+	snapshotEngine(snapshot.engine);
+	memcpy(snapshot.strip, pCapture->GetCapturedFrame(), pCapture->GetLength() * BYTES_PER_PIXEL);
+	snapshot.cFrames = pCapture->GetFrameCount();
+}
+
+static void RestoreSnapshot(const HostSnapshot & snapshot)
+{
+	CaptureOutput * pCapture = (CaptureOutput *) pOutput;
+
+	HAL_HostLoadState(snapshot.host);				// First, for the EEPROM the pattern is loaded from
+	restoreEngine(snapshot.engine);
+	pCapture->RestoreCapture(snapshot.strip, snapshot.cFrames);
+}
+
+// ReplaySeeker
+//
+// Runs a scenario through the engine just as RunScenario() does, a pass of the loop
+// every millisecond, and keeps a snapshot every checkpointMs on the way.  Seek() then
+// goes to any moment of the drive by restoring the last checkpoint before it and
+// stepping on from there, which takes at most checkpointMs of simulation instead of
+// everything since the start.
+//
+// The seeker brings up the engine on this thread; shutdownEngine() when done with it.
+
+class ReplaySeeker
+{
+	struct Checkpoint
+	{
+		size_t       iChange;						// The next change the replay hasn't applied
+		uint8_t      inputs;
+		HostSnapshot snapshot;
+	};
+
+	std::vector<ScenarioChange> _changes;
+	std::vector<Checkpoint>     _checkpoints;
+	size_t                      _iChange;
+	uint8_t                     _inputs;
+
+	void TakeCheckpoint()
+	{
+		_checkpoints.emplace_back();
+		_checkpoints.back().iChange = _iChange;
+		_checkpoints.back().inputs  = _inputs;
+		TakeSnapshot(_checkpoints.back().snapshot);
+	}
+
+  public:
+
+	ReplaySeeker()
+		: _iChange(0),
+		  _inputs(0)
+	{
+	}
+
+	size_t GetCheckpointCount()
+	{
+		return _checkpoints.size();
+	}
+
+	// One pass of the loop, with every change up to now applied first
+
+	void Step()
+	{
+		uint64_t now = HAL_HostGetMicros();
+		for (; _iChange < _changes.size() && _changes[_iChange].us <= now; _iChange++)
+		{
+			if (_changes[_iChange].down)
+				_inputs |= _changes[_iChange].input;
+			else
+				_inputs &= ~_changes[_iChange].input;
+		}
+		HAL_HostSetInputs(_inputs);
+
+		processAndDisplayInputs();
+		HAL_Delay(1);
+	}
+
+	// Record
+	//
+	// Runs the whole scenario from a fresh engine, taking the checkpoints
+
+	void Record(const Scenario & scenario, uint32_t seed, uint32_t checkpointMs)
+	{
+		_changes      = ExpandScenarioEdges(scenario, seed);
+		_checkpoints.clear();
+		_iChange      = 0;
+		_inputs       = 0;
+
+		HAL_HostReset();
+		setupEngine();
+
+		uint64_t nextUs = 0;
+		while (HAL_HostGetMicros() < scenario.endUs)
+		{
+			if (HAL_HostGetMicros() >= nextUs)
+			{
+				TakeCheckpoint();
+				nextUs = HAL_HostGetMicros() + (uint64_t) checkpointMs * 1000;
+			}
+			Step();
+		}
+	}
+
+	// Seek
+	//
+	// Leaves the simulation at the first pass that starts at or after us.  Only after
+	// Record(), which always takes a checkpoint at the start.
+
+	void Seek(uint64_t us)
+	{
+		size_t i = _checkpoints.size();
+		while (i > 1 && _checkpoints[i - 1].snapshot.host.micros > us)
+			i--;
+
+		const Checkpoint & checkpoint = _checkpoints[i - 1];
+		RestoreSnapshot(checkpoint.snapshot);
+		_iChange = checkpoint.iChange;
+		_inputs  = checkpoint.inputs;
+
+		while (HAL_HostGetMicros() < us)
+			Step();
+	}
+};
@@ -0,0 +1,320 @@
+//+--------------------------------------------------------------------------
+//
+// TraceReplay - (c) 2018 Dave Plummer.  Public domain not for highway use.
+//
+// File:        TraceReplay.cpp
+//
+// Description:
+//
+//   Replays switch traces recorded on the car (see InputTrace.h) through
+//   the real engine on the host, every edge at exactly the time it was
+//   recorded, and reports how the engine handled that drive:
+//
+//     frames    how long each pass of the main loop took
+//     dropped   pulses that came and went between two reads of the
+//               switches, so the engine never saw them
+//     brake     every STOP press and the worst time from the pedal to red
+//               in the middle of the strip
+//
+//   The replay is deterministic, so a complaint from the field reproduces
+//   the same way every time on a dev box.  A trace is the serial log from
+//   a RECORD_INPUT_TRACE build; every line that isn't a T line is ignored.
+//
+//   -a seeks to a moment of the drive, in seconds, and shows the next -n
+//   passes from there: the switches, the LCD, and the strip.  The drive is
+//   replayed once keeping a snapshot of the simulation every -k ms (see
+//   Host/Snapshot.h), and each seek starts from the nearest one before it,
+//   so looking at minute 47 of a long trace doesn't mean simulating the 47
+//   minutes before it every time.  -a can be given more than once.
+//
+//   Usage:  tracereplay [-v] [-a seconds]... [-n passes] [-k checkpointMs] file.trace ...
+//
+//   Build:  g++ -std=gnu++11 -O2 -o tracereplay TraceReplay.cpp
+//
+//---------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "Snapshot.h"
+#include "FrameRing.h"
+
+#define TRACE_DROPS_SHOWN 10						// Without -v, list only this many dropped pulses
+#define TRACE_BOUNCE_US   10000						// Changes closer together than this are one burst of chatter
+
+static const char * InputName(uint8_t input)
+{
+	switch (input)
+	{
+		case INPUT_LEFT_TURN:  return "LEFT";
+		case INPUT_RIGHT_TURN: return "RIGHT";
+		case INPUT_STOP:       return "STOP";
+		case INPUT_BACKUP:     return "BACKUP";
+	}
+	return "?";
+}
+
+// LoadTrace
+//
+// Turns a recorded trace into a scenario: one edge for every input bit that changes
+// between consecutive records.  The recorder's micros() wraps every 71 minutes, so a
+// timestamp that goes backwards is taken to have wrapped.  Time is rebased so that the
+// first record is at zero.
+//
+// Edges on a switch that come within TRACE_BOUNCE_US of each other are one burst.  A
+// burst that leaves the switch changed is a real press or release, dated from its
+// first edge; everything else in it is chatter.  That keeps a bouncing brake switch
+// from counting as a string of separate presses.
+
+static bool LoadTrace(const char * pszPath, Scenario & scenario, uint32_t & cRecords, uint32_t & cLost, std::string & error)
+{
+	FILE * pFile = fopen(pszPath, "r");
+	if (!pFile)
+	{
+		error = std::string("can't open ") + pszPath;
+		return false;
+	}
+
+	scenario.edges.clear();
+	scenario.asserts.clear();
+	scenario.jitterUs    = 0;
+	scenario.bounceCount = 0;
+	scenario.bounceUs    = 0;
+	scenario.seed        = 0;
+
+	const char * pszName = strrchr(pszPath, '/');
+	scenario.name = pszName ? pszName + 1 : pszPath;
+
+	char     szLine[256];
+	uint64_t base     = 0;
+	uint64_t wrap     = 0;
+	uint32_t lastRaw  = 0;
+	uint64_t lastUs   = 0;
+	uint8_t  inputs   = 0;
+	int      line     = 0;
+
+	cRecords = 0;
+	cLost    = 0;
+
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		line++;
+
+		unsigned long raw, value;
+		if (sscanf(szLine, "T overflow %lu", &value) == 1)
+		{
+			cLost += value;
+			continue;
+		}
+		if (sscanf(szLine, "T %lu %lx", &raw, &value) != 2)
+			continue;
+		if (value > 0x0F)
+		{
+			fclose(pFile);
+			error = "line " + std::to_string(line) + ": inputs out of range";
+			return false;
+		}
+
+		if (cRecords > 0 && raw < lastRaw)
+			wrap += 1ULL << 32;
+		lastRaw = (uint32_t) raw;
+
+		uint64_t us = wrap + raw;
+		if (cRecords == 0)
+			base = us;
+		us -= base;
+
+		// The first record is the state when recording started, which the replay
+		// starts in too: it goes in as edges at time zero
+
+		uint8_t changed = inputs ^ (uint8_t) value;
+		for (uint8_t bit = 1; bit <= INPUT_BACKUP; bit <<= 1)
+		{
+			if (changed & bit)
+			{
+				ScenarioEdge edge = { us, bit, (value & bit) != 0, false };
+				scenario.edges.push_back(edge);
+			}
+		}
+
+		inputs = (uint8_t) value;
+		lastUs = us;
+		cRecords++;
+	}
+	fclose(pFile);
+
+	if (cRecords == 0)
+	{
+		error = "no trace records";
+		return false;
+	}
+
+	for (uint8_t bit = 1; bit <= INPUT_BACKUP; bit <<= 1)
+	{
+		std::vector<ScenarioEdge *> burst;
+		for (size_t i = 0; i <= scenario.edges.size(); i++)
+		{
+			ScenarioEdge * pEdge = i < scenario.edges.size() ? &scenario.edges[i] : nullptr;
+			if (pEdge && pEdge->input != bit)
+				continue;
+
+			if (!burst.empty() && (!pEdge || pEdge->us - burst.back()->us >= TRACE_BOUNCE_US))
+			{
+				for (size_t j = 0; j < burst.size(); j++)
+					burst[j]->chatter = (j > 0) || (burst.size() % 2 == 0);
+				burst.clear();
+			}
+			if (pEdge)
+				burst.push_back(pEdge);
+		}
+	}
+
+	scenario.endUs = lastUs + 1000000;				// Let the last change play out
+	return true;
+}
+
+// SeekTrace
+//
+// Replays the trace keeping checkpoints, then shows the passes from each moment asked
+// for
+
+static void SeekTrace(const Scenario & scenario, const std::vector<double> & seekSeconds, int cPasses, uint32_t checkpointMs)
+{
+	ReplaySeeker seeker;
+
+	auto start = std::chrono::steady_clock::now();
+	seeker.Record(scenario, 0, checkpointMs);
+	double recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("  seek     %zu checkpoints every %ums, taken in %.1fms\n", seeker.GetCheckpointCount(), (unsigned) checkpointMs, recordMs);
+
+	CaptureOutput * pCapture = (CaptureOutput *) pOutput;
+	char            szStrip[NUMBER_USED_PIXELS + 1];
+
+	for (double seconds : seekSeconds)
+	{
+		start = std::chrono::steady_clock::now();
+		seeker.Seek((uint64_t)(seconds * 1e6));
+		double seekMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		printf("           %.6fs, in %.2fms\n", seconds, seekMs);
+		for (int pass = 0; pass < cPasses; pass++)
+		{
+			uint64_t us = HAL_HostGetMicros();
+			seeker.Step();
+
+			const uint8_t * pFrame = pCapture->GetCapturedFrame();
+			for (int i = 0; i < NUMBER_USED_PIXELS; i++)
+				szStrip[i] = FramePixelChar(pFrame + i * BYTES_PER_PIXEL);
+			szStrip[NUMBER_USED_PIXELS] = '\0';
+
+			printf("           %10.6fs %x %-*s %s\n", us / 1e6, HAL_ReadInputs(), LCD_WIDTH, HAL_HostGetLcdRow(0), szStrip);
+		}
+	}
+
+	shutdownEngine();
+}
+
+static double Percentile(std::vector<uint32_t> sorted, double fraction)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+int main(int argc, char * argv[])
+{
+	bool                verbose      = false;
+	int                 cFiles       = 0;
+	int                 cPasses      = 1;
+	uint32_t            checkpointMs = 1000;
+	std::vector<double> seekSeconds;
+
+	HAL_HostSetSerialOutput(fopen("/dev/null", "w"));
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-v"))
+		{
+			verbose = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-a") && i + 1 < argc)
+		{
+			seekSeconds.push_back(max(0.0, atof(argv[++i])));
+			continue;
+		}
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			cPasses = max(1, atoi(argv[++i]));
+			continue;
+		}
+		if (!strcmp(argv[i], "-k") && i + 1 < argc)
+		{
+			checkpointMs = (uint32_t) max(1, atoi(argv[++i]));
+			continue;
+		}
+
+		Scenario    scenario;
+		std::string error;
+		uint32_t    cRecords, cLost;
+		cFiles++;
+
+		if (!LoadTrace(argv[i], scenario, cRecords, cLost, error))
+		{
+			fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+			return 1;
+		}
+
+		ScenarioResult result;
+		RunScenario(scenario, 0, result);
+
+		std::vector<uint32_t> sorted(result.frameUs);
+		std::sort(sorted.begin(), sorted.end());
+		size_t cOverBudget = sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), (uint32_t) FRAME_BUDGET_US);
+
+		printf("%s: %.2fs of driving, %u records, %u edges",
+			   scenario.name.c_str(), scenario.endUs / 1e6, (unsigned) cRecords, (unsigned) scenario.edges.size());
+		if (cLost)
+			printf(", %u LOST to recorder overflow", (unsigned) cLost);
+		printf("\n");
+
+		printf("  frames   %llu  avg %.2fms  p50 %.2fms  p99 %.2fms  worst %.2fms  over %.0fms budget %zu\n",
+			   (unsigned long long) result.metrics[METRIC_FRAMES],
+			   result.metrics[METRIC_AVERAGE_FRAME] / 1000.0,
+			   Percentile(sorted, 0.50) / 1000.0,
+			   Percentile(sorted, 0.99) / 1000.0,
+			   result.metrics[METRIC_WORST_FRAME] / 1000.0,
+			   FRAME_BUDGET_US / 1000.0, cOverBudget);
+
+		printf("  dropped  %zu pulse%s never seen\n", result.drops.size(), result.drops.size() == 1 ? "" : "s");
+		for (size_t d = 0; d < result.drops.size() && (verbose || d < TRACE_DROPS_SHOWN); d++)
+		{
+			const ScenarioDrop & drop = result.drops[d];
+			printf("           %10.6fs  %-6s %-7s for %.3fms\n",
+				   drop.us / 1e6, InputName(drop.input), drop.down ? "press" : "release", drop.lengthUs / 1000.0);
+		}
+		if (!verbose && result.drops.size() > TRACE_DROPS_SHOWN)
+			printf("           ... %zu more (-v lists them all)\n", result.drops.size() - TRACE_DROPS_SHOWN);
+
+		printf("  brake    %u press%s  worst latency %.2fms",
+			   (unsigned) result.cBrakePresses, result.cBrakePresses == 1 ? "" : "es",
+			   result.metrics[METRIC_BRAKE_LATENCY] / 1000.0);
+		if (result.metrics[METRIC_BRAKE_LATENCY])
+			printf(" (press at %.6fs)", result.worstBrakeAtUs / 1e6);
+		printf("  missed %llu\n", (unsigned long long) result.metrics[METRIC_MISSED_BRAKES]);
+
+		if (!seekSeconds.empty())
+			SeekTrace(scenario, seekSeconds, cPasses, checkpointMs);
+	}
+
+	if (cFiles == 0)
+	{
+		fprintf(stderr, "usage: tracereplay [-v] [-a seconds]... [-n passes] [-k checkpointMs] file.trace ...\n");
+		return 2;
+	}
+	return 0;
+}
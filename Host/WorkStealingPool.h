@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// WorkStealingPool
+//
+// A fixed set of worker threads, one per core by default, each with its own deque of
+// tasks.  A worker takes work from the back of its own deque and, when that runs dry,
+// steals from the front of someone else's, so a worker that drew a run of cheap tasks
+// helps out the ones that drew expensive ones instead of sitting idle.
+//
+// Tasks are handed out round robin as they're submitted.  Wait() blocks until every
+// task submitted so far has finished.
+
+class WorkStealingPool
+{
+	struct Worker
+	{
+		std::mutex                         lock;
+		std::deque<std::function<void()>>  tasks;
+	};
+
+	std::vector<std::unique_ptr<Worker>>   _workers;
+	std::vector<std::thread>               _threads;
+	std::atomic<size_t>                    _cPending;
+	std::atomic<bool>                      _stopping;
+	std::atomic<size_t>                    _nextWorker;
+	std::mutex                             _idleLock;
+	std::condition_variable                _idle;			// Signalled when the last pending task finishes
+	std::condition_variable                _work;			// Signalled when a task is submitted
+
+	bool TryPop(size_t iWorker, std::function<void()> & task)
+	{
+		Worker & own = *_workers[iWorker];
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < _workers.size(); i++)
+		{
+			Worker & victim = *_workers[(iWorker + i) % _workers.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Run(size_t iWorker)
+	{
+		std::function<void()> task;
+
+		while (!_stopping)
+		{
+			if (TryPop(iWorker, task))
+			{
+				task();
+				if (--_cPending == 0)
+				{
+					std::lock_guard<std::mutex> guard(_idleLock);
+					_idle.notify_all();
+				}
+			}
+			else
+			{
+				std::unique_lock<std::mutex> guard(_idleLock);
+				_work.wait_for(guard, std::chrono::milliseconds(1));
+			}
+		}
+	}
+
+  public:
+
+	WorkStealingPool(size_t cThreads = std::thread::hardware_concurrency())
+		: _cPending(0), _stopping(false), _nextWorker(0)
+	{
+		if (cThreads == 0)
+			cThreads = 1;
+
+		for (size_t i = 0; i < cThreads; i++)
+			_workers.emplace_back(new Worker);
+		for (size_t i = 0; i < cThreads; i++)
+			_threads.emplace_back(&WorkStealingPool::Run, this, i);
+	}
+
+	~WorkStealingPool()
+	{
+		_stopping = true;
+		_work.notify_all();
+		for (auto & thread : _threads)
+			thread.join();
+	}
+
+	size_t GetThreadCount()
+	{
+		return _threads.size();
+	}
+
+	void Submit(std::function<void()> task)
+	{
+		Worker & worker = *_workers[_nextWorker++ % _workers.size()];
+		_cPending++;
+		{
+			std::lock_guard<std::mutex> guard(worker.lock);
+			worker.tasks.push_back(std::move(task));
+		}
+		_work.notify_one();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> guard(_idleLock);
+		_idle.wait(guard, [this] { return _cPending == 0; });
+	}
+};
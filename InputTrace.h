@@ -0,0 +1,120 @@
+#pragma once
+#include <stdio.h>
+#include "HAL.h"
+
+// InputTrace
+//
+// Records every edge on the four switch inputs, with its time, for replay in the host
+// simulator (Host/TraceReplay.cpp).  The main loop only looks at the switches once a
+// frame, so it can't see a short pulse that comes and goes between two looks; the
+// recorder doesn't depend on the loop at all.  A pin change interrupt on PORTD
+// timestamps each edge into a small ring, and the loop drains the ring to Serial:
+//
+//   T <micros> <inputs>       inputs are the INPUT_ bits in hex
+//   T overflow <count>        edges lost because the ring filled up
+//
+// The first line after InputTraceBegin() is the switch state at that moment.  Capture
+// the serial log on a drive and hand it to tracereplay as is; it ignores everything
+// that isn't a T line.
+//
+// The LED drivers run with interrupts off, so an edge that arrives during show() is
+// timestamped when show() finishes, up to 4.3ms late on 144 pixels, and a switch that
+// changes twice during one show() is seen as a single edge.
+
+#if defined(ARDUINO) && defined(__AVR__) && !defined(HAL_VIRTUAL_CLOCK)
+
+#define INPUT_TRACE_RING 32							// Power of two
+
+struct InputTraceEntry
+{
+	uint32_t us;
+	uint8_t  inputs;
+};
+
+static volatile InputTraceEntry s_traceRing[INPUT_TRACE_RING];
+static volatile uint8_t         s_traceHead;		// Written by the ISR
+static volatile uint8_t         s_traceTail;		// Written by the loop
+static volatile uint8_t         s_traceOverflow;
+static volatile uint8_t         s_traceLast;
+
+static inline void InputTraceRecord(uint8_t inputs)
+{
+	uint8_t next = (s_traceHead + 1) & (INPUT_TRACE_RING - 1);
+	if (next == s_traceTail)
+	{
+		s_traceOverflow++;
+		return;
+	}
+	s_traceRing[s_traceHead].us     = micros();
+	s_traceRing[s_traceHead].inputs = inputs;
+	s_traceHead = next;
+}
+
+ISR(PCINT2_vect)
+{
+	uint8_t inputs = HAL_ReadInputs();
+	if (inputs != s_traceLast)						// Ignore changes on the other PORTD pins
+	{
+		s_traceLast = inputs;
+		InputTraceRecord(inputs);
+	}
+}
+
+// InputTraceBegin
+//
+// Call after HAL_InitInputs() has set up the pins
+
+static void InputTraceBegin()
+{
+	uint8_t oldSREG = SREG;
+	cli();
+	s_traceLast = HAL_ReadInputs();
+	InputTraceRecord(s_traceLast);
+	PCMSK2 |= _BV(LEFT_TURN_PIN) | _BV(RIGHT_TURN_PIN) | _BV(STOP_PIN) | _BV(BACKUP_PIN);
+	PCICR  |= _BV(PCIE2);
+	SREG = oldSREG;
+}
+
+// InputTraceDrain
+//
+// Sends whatever the ISR has recorded since the last call.  Call once per loop.
+
+static void InputTraceDrain()
+{
+	char szBuf[24];
+
+	while (s_traceTail != s_traceHead)
+	{
+		uint8_t  tail   = s_traceTail;
+		uint32_t us     = s_traceRing[tail].us;
+		uint8_t  inputs = s_traceRing[tail].inputs;
+		s_traceTail = (tail + 1) & (INPUT_TRACE_RING - 1);
+
+		snprintf(szBuf, sizeof(szBuf), "T %lu %x", (unsigned long) us, (unsigned) inputs);
+		HAL_SerialPrintln(szBuf);
+	}
+
+	if (s_traceOverflow)
+	{
+		uint8_t oldSREG = SREG;
+		cli();
+		uint8_t cLost = s_traceOverflow;
+		s_traceOverflow = 0;
+		SREG = oldSREG;
+
+		snprintf(szBuf, sizeof(szBuf), "T overflow %u", (unsigned) cLost);
+		HAL_SerialPrintln(szBuf);
+	}
+}
+
+#else
+
+static inline void InputTraceBegin()
+{
+}
+
+static inline void InputTraceDrain()
+{
+}
+
+#endif
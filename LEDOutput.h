@@ -0,0 +1,347 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "LayerBlend.h"
+
+// LEDOutput
+//
+// Everything the lighting engine needs from whatever is actually driving the LEDs:
+// a frame buffer to write spans into, a way to commit the finished frame to the
+// strip, a brightness, and a length.  Derived classes supply the buffer (in whatever
+// channel order their hardware wants) and implement Commit() and SetBrightness().
+//
+// Frames are always composed at full scale.  Backends that can't scale on the way
+// out scale the buffer just before sending it, which is safe because the engine
+// composes the whole frame from scratch before every commit.
+//
+// A host build can have the virtual clock charged for what the board would spend
+// writing the frame buffer (HAL_HOST_RENDER_MODEL in HAL_Host.h); everywhere else
+// these cost nothing.
+
+#ifndef LED_RENDER_SPAN
+#define LED_RENDER_SPAN(cPixels, mode)
+#endif
+#ifndef LED_RENDER_CLEAR
+#define LED_RENDER_CLEAR(cBytes)
+#endif
+
+class LEDOutput
+{
+  protected:
+
+	uint8_t  * _pPixels;							// Frame buffer, BYTES_PER_PIXEL bytes per pixel
+	uint16_t   _cPixels;
+	uint8_t    _brightness;
+	uint8_t    _offsetR;							// Where each channel lives within a pixel
+	uint8_t    _offsetG;
+	uint8_t    _offsetB;
+
+	LEDOutput(uint16_t cPixels, uint8_t offsetR, uint8_t offsetG, uint8_t offsetB)
+	{
+		_pPixels    = nullptr;
+		_cPixels    = cPixels;
+		_brightness = 255;
+		_offsetR    = offsetR;
+		_offsetG    = offsetG;
+		_offsetB    = offsetB;
+	}
+
+  public:
+
+	virtual ~LEDOutput()
+	{
+	}
+
+	uint16_t GetLength()
+	{
+		return _cPixels;
+	}
+
+	uint8_t GetBrightness()
+	{
+		return _brightness;
+	}
+
+	uint8_t * GetPixels()
+	{
+		return _pPixels;
+	}
+
+	// WriteSpan
+	//
+	// Blends count pixels of a packed 0x00RRGGBB color into the frame starting at first.
+	// The caller is responsible for keeping the span within GetLength().
+
+	void WriteSpan(uint16_t first, uint16_t count, uint32_t color, BLEND_MODE mode, uint8_t alpha = 255)
+	{
+		uint8_t src[BYTES_PER_PIXEL];
+		src[_offsetR] = (uint8_t)(color >> 16);
+		src[_offsetG] = (uint8_t)(color >>  8);
+		src[_offsetB] = (uint8_t)(color);
+
+		BlendFillSpan(_pPixels + first * BYTES_PER_PIXEL, count, src, mode, alpha);
+		LED_RENDER_SPAN(count, mode);
+	}
+
+	void Clear()
+	{
+		memset(_pPixels, 0, _cPixels * BYTES_PER_PIXEL);
+		LED_RENDER_CLEAR(_cPixels * BYTES_PER_PIXEL);
+	}
+
+	virtual void SetBrightness(uint8_t brightness)
+	{
+		_brightness = brightness;
+	}
+
+	virtual void Commit() = 0;						// Send the frame buffer to the LEDs
+};
+
+// NeoPixelOutput
+//
+// Drives the strip through the Adafruit_NeoPixel library, composing straight into its
+// pixel buffer.  The library's own brightness is left at 255 since it only applies to
+// setPixelColor(), which we bypass; we scale the buffer ourselves on commit instead.
+
+#ifdef ADAFRUIT_NEOPIXEL_H
+
+class NeoPixelOutput : public LEDOutput
+{
+	Adafruit_NeoPixel * _pStrip;
+
+  public:
+
+	NeoPixelOutput(uint16_t cPixels, uint8_t pin)
+		: LEDOutput(cPixels, 1, 0, 2)				// NEO_GRB
+	{
+		_pStrip  = new Adafruit_NeoPixel(cPixels, pin, NEO_GRB + NEO_KHZ800);
+		_pStrip->begin();
+		_pPixels = _pStrip->getPixels();
+		_cPixels = _pStrip->numPixels();			// Zero if there wasn't room for the buffer
+	}
+
+	virtual ~NeoPixelOutput()
+	{
+		delete _pStrip;
+	}
+
+	virtual void Commit() override
+	{
+		if (_brightness != 255)
+			ScaleSpan(_pPixels, _cPixels * BYTES_PER_PIXEL, _brightness);
+		_pStrip->show();
+	}
+};
+
+#endif
+
+// FastLEDOutput
+//
+// Drives the strip through FastLED.  Its CRGB array is our frame buffer (RGB order in
+// memory; FastLED reorders to GRB on the wire) and FastLED applies brightness itself
+// as it sends.  Only built when the sketch defines USE_FASTLED before including us.
+
+#ifdef USE_FASTLED
+#include <FastLED.h>
+
+template <uint8_t DATA_PIN>
+class FastLEDOutput : public LEDOutput
+{
+	CRGB * _pLeds;
+
+  public:
+
+	FastLEDOutput(uint16_t cPixels)
+		: LEDOutput(cPixels, 0, 1, 2)
+	{
+		_pLeds   = new CRGB[cPixels];
+		_pPixels = (uint8_t *) _pLeds;
+		FastLED.addLeds<WS2812B, DATA_PIN, GRB>(_pLeds, cPixels);
+	}
+
+	virtual ~FastLEDOutput()
+	{
+		delete [] _pLeds;
+	}
+
+	virtual void SetBrightness(uint8_t brightness) override
+	{
+		LEDOutput::SetBrightness(brightness);
+		FastLED.setBrightness(brightness);
+	}
+
+	virtual void Commit() override
+	{
+		FastLED.show();
+	}
+};
+
+#endif
+
+// BitBangOutput
+//
+// Our own WS2812 driver for a 16MHz AVR: no library, just the frame buffer clocked
+// out of one PORTD pin by hand.  Each bit is exactly 20 cycles (1.25us); the line
+// goes high at cycle 0, drops at cycle 6 for a zero or at cycle 13 for a one.
+// Interrupts are off for the whole frame, which for 144 pixels is about 4.3ms, so
+// millis() loses that much time per frame just as it does with the Adafruit driver.
+
+#if defined(__AVR__) && (F_CPU == 16000000L)
+#define HAVE_BITBANG_OUTPUT
+
+template <uint8_t PORTD_BIT>
+class BitBangOutput : public LEDOutput
+{
+  public:
+
+	BitBangOutput(uint16_t cPixels)
+		: LEDOutput(cPixels, 1, 0, 2)
+	{
+		_pPixels = new uint8_t[cPixels * BYTES_PER_PIXEL];
+		Clear();
+		DDRD  |= _BV(PORTD_BIT);
+		PORTD &= ~_BV(PORTD_BIT);
+	}
+
+	virtual ~BitBangOutput()
+	{
+		delete [] _pPixels;
+	}
+
+	// The loop counts bytes down before it loads the next one, so it never reads past
+	// the buffer, and it needs at least one byte to send
+
+	virtual void Commit() override
+	{
+		if (_cPixels == 0)
+			return;
+
+		if (_brightness != 255)
+			ScaleSpan(_pPixels, _cPixels * BYTES_PER_PIXEL, _brightness);
+
+		const uint8_t * p      = _pPixels;
+		uint16_t        cBytes = _cPixels * BYTES_PER_PIXEL;
+		uint8_t         byte   = *p++;
+		uint8_t         bit    = 8;
+		uint8_t         next;
+
+		uint8_t oldSREG = SREG;
+		cli();
+		uint8_t hi = PORTD |  _BV(PORTD_BIT);
+		uint8_t lo = PORTD & ~_BV(PORTD_BIT);
+
+		asm volatile(
+			"bitloop%=:                     \n\t"
+			"out  %[port], %[hi]            \n\t"	// 0      Rising edge
+			"mov  %[next], %[lo]            \n\t"	// 1
+			"sbrc %[byte], 7                \n\t"	// 2      Skip unless bit is a one
+			"mov  %[next], %[hi]            \n\t"	// 3
+			"nop                            \n\t"	// 4
+			"nop                            \n\t"	// 5
+			"out  %[port], %[next]          \n\t"	// 6      Zero bits fall here
+			"lsl  %[byte]                   \n\t"	// 7
+			"nop                            \n\t"	// 8
+			"rjmp .+0                       \n\t"	// 9-10
+			"rjmp .+0                       \n\t"	// 11-12
+			"out  %[port], %[lo]            \n\t"	// 13     One bits fall here
+			"dec  %[bit]                    \n\t"	// 14
+			"breq nextbyte%=                \n\t"	// 15
+			"rjmp .+0                       \n\t"	// 16-17
+			"rjmp bitloop%=                 \n\t"	// 18-19
+			"nextbyte%=:                    \n\t"	// 17     (breq taken)
+			"sbiw %[count], 1               \n\t"	// 17-18
+			"breq done%=                    \n\t"	// 19     That was the last byte
+			"ld   %[byte], %a[ptr]+         \n\t"	// 20-21  Low a few cycles longer between
+			"ldi  %[bit], 8                 \n\t"	// 22       bytes, well within spec
+			"rjmp bitloop%=                 \n\t"	// 23-24
+			"done%=:                        \n\t"
+			: [ptr]   "+e" (p),
+			  [count] "+w" (cBytes),
+			  [byte]  "+r" (byte),
+			  [bit]   "+d" (bit),
+			  [next]  "=&r" (next)
+			: [port]  "I" (_SFR_IO_ADDR(PORTD)),
+			  [hi]    "r" (hi),
+			  [lo]    "r" (lo)
+		);
+
+		SREG = oldSREG;
+		delayMicroseconds(50);						// Latch
+	}
+};
+
+#endif
+
+// CaptureOutput
+//
+// Drives no hardware at all.  Each commit copies the frame, with brightness applied,
+// into a capture buffer and counts it, and optionally hands it to a callback.  Used
+// to benchmark the engine without the cost of the wire and to look at frames on a
+// host.
+
+class CaptureOutput : public LEDOutput
+{
+  public:
+
+	typedef void (*CommitCallback)(const uint8_t * pFrame, uint16_t cPixels, void * pContext);
+
+  private:
+
+	uint8_t      * _pCapture;
+	unsigned long  _cFrames;
+	CommitCallback _pfnCallback;
+	void         * _pContext;
+
+  public:
+
+	CaptureOutput(uint16_t cPixels)					// GRB, the same as the real strip
+		: LEDOutput(cPixels, 1, 0, 2)
+	{
+		_pPixels     = new uint8_t[cPixels * BYTES_PER_PIXEL];
+		_pCapture    = new uint8_t[cPixels * BYTES_PER_PIXEL];
+		_cFrames     = 0;
+		_pfnCallback = nullptr;
+		_pContext    = nullptr;
+		Clear();
+		memset(_pCapture, 0, cPixels * BYTES_PER_PIXEL);
+	}
+
+	virtual ~CaptureOutput()
+	{
+		delete [] _pPixels;
+		delete [] _pCapture;
+	}
+
+	void SetCommitCallback(CommitCallback pfnCallback, void * pContext)
+	{
+		_pfnCallback = pfnCallback;
+		_pContext    = pContext;
+	}
+
+	const uint8_t * GetCapturedFrame()
+	{
+		return _pCapture;
+	}
+
+	unsigned long GetFrameCount()
+	{
+		return _cFrames;
+	}
+
+	void RestoreCapture(const uint8_t * pFrame, unsigned long cFrames)	// Puts back a frame and count saved earlier
+	{
+		memcpy(_pCapture, pFrame, _cPixels * BYTES_PER_PIXEL);
+		_cFrames = cFrames;
+	}
+
+	virtual void Commit() override
+	{
+		memcpy(_pCapture, _pPixels, _cPixels * BYTES_PER_PIXEL);
+		if (_brightness != 255)
+			ScaleSpan(_pCapture, _cPixels * BYTES_PER_PIXEL, _brightness);
+		_cFrames++;
+
+		if (_pfnCallback)
+			_pfnCallback(_pCapture, _cPixels, _pContext);
+	}
+};
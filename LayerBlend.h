@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+
+// LayerBlend
+//
+// Each LightingEvent is a layer in the frame.  Rather than poking pixels one at a
+// time (where whoever draws last simply wins), layers hand whole spans of a solid
+// color to these kernels, which blend them into the output's raw pixel buffer using
+// the layer's blend mode.  Every effect we have is made of solid spans, so the cost
+// of a frame is a handful of tight byte loops no matter how many layers overlap.
+//
+// The kernels don't care about channel order; the caller passes the source color
+// already laid out in whatever order its buffer uses (GRB, RGB, ...).
+
+#define BYTES_PER_PIXEL 3
+
+// BLEND_MODE
+//
+//   BLEND_REPLACE  - Span overwrites whatever is beneath it
+//   BLEND_MAX      - Per-channel maximum, so overlapping lights never dim each other
+//   BLEND_ADD      - Per-channel add, saturating at 255
+//   BLEND_ALPHA    - Span drawn over what's beneath it at a 0-255 opacity
+
+enum BLEND_MODE : uint8_t
+{
+	BLEND_REPLACE = 0,
+	BLEND_MAX,
+	BLEND_ADD,
+	BLEND_ALPHA
+};
+
+// BlendFillSpan
+//
+// Blends cPixels pixels of a single color into the buffer at pDst.  pSrc holds that
+// color's three bytes in buffer order.  The mode is resolved once per span so each
+// inner loop is nothing but byte math.
+//
+// Alpha uses (src * a + dst * (256 - a)) >> 8, with 255 promoted to 256 so that a
+// fully opaque span is exact.  Every intermediate fits in 16 bits.
+
+static inline void BlendFillSpan(uint8_t * pDst, uint16_t cPixels, const uint8_t * pSrc, BLEND_MODE mode, uint8_t alpha = 255)
+{
+	const uint8_t src[BYTES_PER_PIXEL] = { pSrc[0], pSrc[1], pSrc[2] };
+
+	uint8_t * pEnd = pDst + cPixels * BYTES_PER_PIXEL;
+
+	switch (mode)
+	{
+		case BLEND_REPLACE:
+			for (; pDst < pEnd; pDst += BYTES_PER_PIXEL)
+			{
+				pDst[0] = src[0];
+				pDst[1] = src[1];
+				pDst[2] = src[2];
+			}
+			break;
+
+		case BLEND_MAX:
+			for (; pDst < pEnd; pDst += BYTES_PER_PIXEL)
+			{
+				if (pDst[0] < src[0]) pDst[0] = src[0];
+				if (pDst[1] < src[1]) pDst[1] = src[1];
+				if (pDst[2] < src[2]) pDst[2] = src[2];
+			}
+			break;
+
+		case BLEND_ADD:
+			for (; pDst < pEnd; pDst += BYTES_PER_PIXEL)
+			{
+				pDst[0] = (pDst[0] > (uint8_t)(255 - src[0])) ? 255 : pDst[0] + src[0];
+				pDst[1] = (pDst[1] > (uint8_t)(255 - src[1])) ? 255 : pDst[1] + src[1];
+				pDst[2] = (pDst[2] > (uint8_t)(255 - src[2])) ? 255 : pDst[2] + src[2];
+			}
+			break;
+
+		case BLEND_ALPHA:
+		{
+			uint16_t a    = alpha + (alpha >> 7);
+			uint16_t inv  = 256 - a;
+			uint16_t srcA[BYTES_PER_PIXEL] = { (uint16_t)(src[0] * a), (uint16_t)(src[1] * a), (uint16_t)(src[2] * a) };
+
+			for (; pDst < pEnd; pDst += BYTES_PER_PIXEL)
+			{
+				pDst[0] = (uint8_t)((srcA[0] + pDst[0] * inv) >> 8);
+				pDst[1] = (uint8_t)((srcA[1] + pDst[1] * inv) >> 8);
+				pDst[2] = (uint8_t)((srcA[2] + pDst[2] * inv) >> 8);
+			}
+			break;
+		}
+	}
+}
+
+// ScaleSpan
+//
+// Scales cBytes bytes by brightness the same way Adafruit_NeoPixel does, so that 255
+// leaves the buffer untouched and 0 turns it black.
+
+static inline void ScaleSpan(uint8_t * p, uint16_t cBytes, uint8_t brightness)
+{
+	uint16_t scale = brightness + 1;
+	for (uint8_t * pEnd = p + cBytes; p < pEnd; p++)
+		*p = (uint8_t)((*p * scale) >> 8);
+}
@@ -1,5 +1,7 @@
 #pragma once
-#include <Adafruit_NeoPixel.h>
+#include "HAL.h"
+#include "LEDOutput.h"
+#include "Easing.h"
 
 #ifndef ARRAYSIZE
 #define ARRAYSIZE(x) (sizeof(x)/sizeof(*x))
@@ -16,28 +18,71 @@
 // event starts (like braking), and Update keeps track of the currentr
 // state.  Draw() actually renders the current state of the effect to
 // the light strip.
+//
+// All effect math is done in integer milliseconds and pixels, never floating point.
+// The AVR's float is 32 bits and a host's is usually wider, so float math could put
+// a pixel boundary in a different place on each; integer math renders the same frame
+// for the same time on every platform, which is what lets the host builds stand in
+// for the firmware.
+//
+// Draw() doesn't show() anything itself.  Each frame the main loop clears the output,
+// has every event draw its layer bottom to top, and then commits the composed frame
+// once.  Layers draw with FillSpan(), which blends using the event's blend mode.
+
+#define EVENT_NO_CHANGE 0x7FFFFFFFUL						// From MsUntilChange(): what's drawn stays as it is
 
 class LightingEvent
 {
-	unsigned long       _eventStart;
+	uint32_t            _eventStart;
 	bool                _active;
+	BLEND_MODE          _blendMode;
 
   protected:
 
-	Adafruit_NeoPixel * _pStrip;
+	LEDOutput         * _pOutput;
+
+	// FillSpan
+	//
+	// Blends count pixels of color into the frame starting at pixel first, clipped
+	// to the used part of the strip.
+
+	void FillSpan(int first, int count, uint32_t color, BLEND_MODE mode, uint8_t alpha = 255)
+	{
+		if (first < 0)
+		{
+			count += first;
+			first = 0;
+		}
+		if (first + count > NUMBER_USED_PIXELS)
+			count = NUMBER_USED_PIXELS - first;
+		if (count <= 0)
+			return;
+
+		_pOutput->WriteSpan(first, count, color, mode, alpha);
+	}
+
+	void FillSpan(int first, int count, uint32_t color)
+	{
+		FillSpan(first, count, color, _blendMode);
+	}
 
   public:
 
-	LightingEvent(Adafruit_NeoPixel * pStrip)  
+	LightingEvent(LEDOutput * pOutput)  
 	{
-		_pStrip = pStrip;
+		_pOutput = pOutput;
 		_eventStart = 0;
 		_active = false;
+		_blendMode = BLEND_REPLACE;
+	}
+
+	virtual ~LightingEvent()
+	{
 	}
 	
-	float TimeElapsedTotal()						// Total time event has been running in fractional seconds
+	uint32_t TimeElapsedMs()						// Total time event has been running in ms
 	{
-		return (millis() - _eventStart) / 1000.0f;
+		return HAL_Millis() - _eventStart;
 	}
 
 	bool GetActive()
@@ -45,30 +90,174 @@ class LightingEvent
 		return _active;
 	}
 
+	BLEND_MODE GetBlendMode()
+	{
+		return _blendMode;
+	}
+
+	void SetBlendMode(BLEND_MODE mode)
+	{
+		_blendMode = mode;
+	}
+
+	virtual bool IsSafetyCritical()					// Safety-critical events are always drawn at full frame rate
+	{
+		return false;
+	}
+
+	// MsUntilChange
+	//
+	// How long from now until Draw() would draw something different from what it
+	// draws now, so the engine can leave a frame on the strip until some layer of it
+	// goes stale.  0 means the layer is changing all the time.  Saying sooner than the
+	// truth only costs a redundant frame, so an event that doesn't know says 0.
+
+	virtual uint32_t MsUntilChange()
+	{
+		return _active ? 0 : EVENT_NO_CHANGE;
+	}
+
+	uint32_t GetStartMs()
+	{
+		return _eventStart;
+	}
+
 	virtual void Begin()    
 	{
 		_active = true;
-		_eventStart = millis();
+		_eventStart = HAL_Millis();
 	};
 
+	void BeginAt(uint32_t startMs)					// As though Begin() had been called at startMs
+	{
+		Begin();
+		_eventStart = startMs;
+	}
+
 	virtual void End()      
 	{
-		_active = false;
-		for (int i = 0; i < NUMBER_USED_PIXELS; i++)
-			_pStrip->setPixelColor(i, COLOR_BLACK);
-		_pStrip->show();
+		_active = false;								// Frame is cleared every loop, so nothing to erase
 	};
 
 	virtual void Draw()    = 0;
 };
 
+// Effect timings
+//
+// Each effect's timings live in a small struct that the effect is handed when it's
+// created.  The firmware always uses the defaults below, or the vehicle profile's
+// (see Config.h); the host tools build their own to try out other values.  All times
+// are in ms.  Each bloom and fade also has an easing curve (see Easing.h), linear
+// unless the vehicle profile picks another.
+
+struct BackupTiming
+{
+	uint32_t     bloomTime;
+	EASING_CURVE bloomCurve;
+};
+
+struct BrakeTiming
+{
+	uint32_t     strobeDuration;
+	uint32_t     bloomStartPermille;					// How wide the bloom starts, in 1/1000ths of the strip
+	uint32_t     bloomTime;
+	uint32_t     strobeOnTime;
+	uint32_t     strobeOffTime;
+	uint8_t      strobeDimAlpha;
+	EASING_CURVE bloomCurve;
+};
+
+struct SignalTiming
+{
+	uint32_t     bloomTime;
+	uint32_t     holdTime;
+	uint32_t     fadeTime;
+	uint32_t     offTime;
+	EASING_CURVE bloomCurve;
+	EASING_CURVE fadeCurve;
+};
+
+#ifndef VEHICLE_BACKUP_TIMING
+#define VEHICLE_BACKUP_TIMING { 250, EASE_LINEAR }
+#endif
+#ifndef VEHICLE_BRAKE_TIMING
+#define VEHICLE_BRAKE_TIMING  { 500, 100, 500, 30, 20, 64, EASE_LINEAR }
+#endif
+#ifndef VEHICLE_SIGNAL_TIMING
+#define VEHICLE_SIGNAL_TIMING { 500, 250, 125, 250, EASE_LINEAR, EASE_LINEAR }
+#endif
+
+static constexpr BackupTiming g_backupTiming = VEHICLE_BACKUP_TIMING;
+static constexpr BrakeTiming  g_brakeTiming  = VEHICLE_BRAKE_TIMING;
+static constexpr SignalTiming g_signalTiming = VEHICLE_SIGNAL_TIMING;
+
+// SignalPhases
+//
+// Where each phase of the turn signal's cycle starts, in ms from the start of the
+// cycle: the running sums of its SignalTiming.  Blooming starts at 0.
+
+struct SignalPhases
+{
+	uint32_t holdStart;
+	uint32_t fadeStart;
+	uint32_t offStart;
+	uint32_t cycleTime;
+};
+
+constexpr SignalPhases MakeSignalPhases(const SignalTiming & t)
+{
+	return SignalPhases { t.bloomTime,
+						  t.bloomTime + t.holdTime,
+						  t.bloomTime + t.holdTime + t.fadeTime,
+						  t.bloomTime + t.holdTime + t.fadeTime + t.offTime };
+}
+
+// Timing checks
+//
+// The effects divide by some of their times and take others modulo, so a zero in the
+// wrong place is a crash rather than an odd-looking animation.  These say whether an
+// effect can run a set of timings.  The firmware's are checked at compile time below;
+// a tool that makes up its own can call them at run time.
+
+constexpr bool ValidBackupTiming(const BackupTiming & t)
+{
+	return t.bloomTime > 0;
+}
+
+constexpr bool ValidBrakeTiming(const BrakeTiming & t)
+{
+	return t.bloomStartPermille <= 1000
+		&& (t.strobeDuration == 0 || (t.bloomTime > 0 && t.strobeOnTime + t.strobeOffTime > 0));
+}
+
+constexpr bool ValidSignalPhases(const SignalPhases & p)		// In order, and no sum wrapped
+{
+	return p.holdStart > 0 && p.holdStart <= p.fadeStart && p.fadeStart <= p.offStart && p.offStart <= p.cycleTime;
+}
+
+constexpr bool ValidSignalTiming(const SignalTiming & t)
+{
+	return ValidSignalPhases(MakeSignalPhases(t));
+}
+
+static_assert(ValidBackupTiming(g_backupTiming), "g_backupTiming: the bloom needs a non-zero time");
+static_assert(ValidBrakeTiming(g_brakeTiming),   "g_brakeTiming: zero bloom or strobe cycle, or the bloom starts wider than the strip");
+static_assert(ValidSignalTiming(g_signalTiming), "g_signalTiming: zero bloom time, or the phases don't fit in 32 bits");
+
+static_assert(NUMBER_USED_PIXELS <= TOTAL_STRIP_PIXELS, "NUMBER_USED_PIXELS is longer than the strip");
+static_assert(NUMBER_TURN_PIXELS > 0 && 2 * NUMBER_TURN_PIXELS <= NUMBER_USED_PIXELS, "The turn zones must fit on the strip without overlapping");
+
 class BackupEvent : public LightingEvent
 {
-	const float BLOOM_TIME = 0.25f;
+	const BackupTiming & _timing;
+	const uint32_t       _bloomStep;
 
   public:
 
-	BackupEvent(Adafruit_NeoPixel * pStrip) : LightingEvent(pStrip)
+	BackupEvent(LEDOutput * pOutput, const BackupTiming & timing = g_backupTiming) 
+		: LightingEvent(pOutput),
+		  _timing(timing),
+		  _bloomStep(EasePhaseStep(timing.bloomTime))
 	{
 	}
 
@@ -80,73 +269,99 @@ class BackupEvent : public LightingEvent
 		// The backup light illuminates the whole strip in white.  It quickly "blooms"
 		// out from the center to fill the strip.
 
-		float fPercentComplete = min(TimeElapsedTotal() / BLOOM_TIME, 1.0f);
-		int cLEDs  = NUMBER_USED_PIXELS * fPercentComplete;
+		int cLEDs  = EaseCount(_timing.bloomCurve, NUMBER_USED_PIXELS, TimeElapsedMs(), _timing.bloomTime, _bloomStep);
 		int iFirst = (NUMBER_USED_PIXELS / 2) - (cLEDs / 2);
 		int iLast  = (NUMBER_USED_PIXELS / 2) + (cLEDs / 2);
 		
-		for (int i = 0; i < NUMBER_USED_PIXELS; i++)
-		{
-			if (i < iFirst || i > iLast)
-				_pStrip->setPixelColor(i, COLOR_BLACK);
-			else
-				_pStrip->setPixelColor(i, COLOR_WHITE);
-		}
-		_pStrip->show();
+		FillSpan(iFirst, iLast - iFirst + 1, COLOR_WHITE);
+	}
+
+	// The span grows a pixel at each end whenever cLEDs / 2 goes up one, which it does
+	// once timeElapsed reaches ceil(2 * (cLEDs / 2 + 1) * bloomTime / NUMBER_USED_PIXELS).
+	// After the bloom it's the whole strip from then on.  An eased bloom isn't worked
+	// out ahead; it's redrawn every frame until it's done.
+
+	virtual uint32_t MsUntilChange() override
+	{
+		uint32_t timeElapsed = TimeElapsedMs();
+		if (false == GetActive() || timeElapsed >= _timing.bloomTime)
+			return EVENT_NO_CHANGE;
+		if (_timing.bloomCurve != EASE_LINEAR)
+			return 0;
+
+		uint32_t cHalf    = (uint32_t) NUMBER_USED_PIXELS * timeElapsed / _timing.bloomTime / 2;
+		uint32_t nextGrow = (2 * (cHalf + 1) * _timing.bloomTime + NUMBER_USED_PIXELS - 1) / NUMBER_USED_PIXELS;
+		return min(nextGrow, _timing.bloomTime) - timeElapsed;
 	}
 };
 
 class BrakingEvent : public LightingEvent
 {
-	const float BRAKE_STROBE_DURATION = 0.5f;
-	const float BLOOM_START_SIZE      = 0.10;
-	const float BLOOM_TIME            = 0.50;
+	const BrakeTiming & _timing;
+	const uint32_t      _strobeCycleTime;
+	const uint32_t      _bloomStep;
 
   public:
 
-	BrakingEvent(Adafruit_NeoPixel * pStrip) : LightingEvent(pStrip)
+	BrakingEvent(LEDOutput * pOutput, const BrakeTiming & timing = g_brakeTiming) 
+		: LightingEvent(pOutput),
+		  _timing(timing),
+		  _strobeCycleTime(timing.strobeOnTime + timing.strobeOffTime),
+		  _bloomStep(EasePhaseStep(timing.bloomTime))
+	{
+	}
+
+	virtual bool IsSafetyCritical() override
 	{
+		return true;
 	}
 	
 	// BrakingEvent::Draw
 	//
-	// The strobe flash happens too fast to wait for the loop pump system, so we do a full 50ms
-	// cycle of it here (30 on, 20 off).  That way it is crisp and accurate but we still never
-	// block the system for more than 50ms, which is sort of a limit I've set
+	// For the first half second the brake light strobes on a 50ms cycle (30 bright, 20 dim)
+	// while it blooms out from the center.  We work out the strobe phase from the time rather
+	// than delay() through it here, so the strobe composes with the other layers and never
+	// blocks the loop.  The dim half is red laid over the frame at quarter opacity.
+	//
+	// The linear bloom grows at the full strip per bloomTime from its starting width,
+	// as it always has, so it's full a little before bloomTime; an eased bloom goes
+	// from the starting width to full over exactly bloomTime.
 
 	virtual void Draw() override
 	{
 		if (false == GetActive())
 			return;
 
-		if (TimeElapsedTotal() < BRAKE_STROBE_DURATION)
+		uint32_t timeElapsed = TimeElapsedMs();
+
+		if (timeElapsed < _timing.strobeDuration)
 		{
-			float timeElapsed = TimeElapsedTotal();
-			float pctComplete = min(1.0f, (timeElapsed / BLOOM_TIME) + BLOOM_START_SIZE);
-			float unusedEachEnd = (1.0f - pctComplete) * NUMBER_USED_PIXELS / 2;
-
-			for (uint16_t i = unusedEachEnd; i < NUMBER_USED_PIXELS - unusedEachEnd; i++)
-				_pStrip->setPixelColor(i, COLOR_RED);
-			_pStrip->show();
-			
-			delay(30);
-
-			timeElapsed = TimeElapsedTotal();
-			pctComplete = min(1.0f, (timeElapsed / BLOOM_TIME) + BLOOM_START_SIZE);
-			unusedEachEnd = (1.0f - pctComplete) * NUMBER_USED_PIXELS / 2;
-
-			for (uint16_t i = unusedEachEnd; i < NUMBER_USED_PIXELS - unusedEachEnd; i++)
-				_pStrip->setPixelColor(i, COLOR_DARK_RED);
-			_pStrip->show();
-			
-			delay(20);
+			uint32_t permilleComplete;
+			if (_timing.bloomCurve == EASE_LINEAR)
+				permilleComplete = min((uint32_t) 1000, timeElapsed * 1000 / _timing.bloomTime + _timing.bloomStartPermille);
+			else
+				permilleComplete = _timing.bloomStartPermille + EaseCount(_timing.bloomCurve, 1000 - _timing.bloomStartPermille,
+																		  timeElapsed, _timing.bloomTime, _bloomStep);
+			int      unusedEachEnd    = (1000 - permilleComplete) * NUMBER_USED_PIXELS / 2000;
 
+			uint32_t strobePosition = timeElapsed % _strobeCycleTime;
+			if (strobePosition < _timing.strobeOnTime)
+				FillSpan(unusedEachEnd, NUMBER_USED_PIXELS - 2 * unusedEachEnd, COLOR_RED);
+			else
+				FillSpan(unusedEachEnd, NUMBER_USED_PIXELS - 2 * unusedEachEnd, COLOR_RED, BLEND_ALPHA, _timing.strobeDimAlpha);
 			return;
 		}
-		for (uint16_t i = 0; i < NUMBER_USED_PIXELS; i++)
-			_pStrip->setPixelColor(i, COLOR_RED);
-		_pStrip->show();
-		
+		FillSpan(0, NUMBER_USED_PIXELS, COLOR_RED);
+	}
+
+	// The strobe widens every few ms, so it's drawn every frame; after it the brake is
+	// solid red for as long as it's held
+
+	virtual uint32_t MsUntilChange() override
+	{
+		if (false == GetActive())
+			return EVENT_NO_CHANGE;
+		return TimeElapsedMs() < _timing.strobeDuration ? 0 : EVENT_NO_CHANGE;
 	}
 };
 
@@ -168,95 +383,100 @@ class SignalEvent : public LightingEvent
 
   private:
 
-	const float SequentialBloomStart = 0.00f;
-	const float SequentialBloomTime  = 0.50f;
-
-	const float SequentialHoldStart  = SequentialBloomStart + SequentialBloomTime;
-	const float SequentialHoldTime   = 0.25f;
-
-	const float SequentialFadeStart  = SequentialHoldStart + SequentialHoldTime;
-	const float SequentialFadeTime   = 0.125f;
-
-	const float SequentialOffStart   = SequentialFadeStart + SequentialFadeTime;
-	const float SequentialOffTime    = 0.25f;
+	const SignalTiming & _timing;
+	const SignalPhases   _phases;
+	const uint32_t       _bloomStep;
+	const uint32_t       _fadeStep;
 
-	const float SequentialCycleTime  = SequentialOffStart + SequentialOffTime;
-
-	// SetTurnLED
+	// SetTurnSpan
 	//
-	// Depending on which way the signal is turning, light up it's LED on the correct
-	// end of the light strip
+	// Depending on which way the signal is turning, light up a span of LEDs on the correct
+	// end of the light strip.  Offsets count inwards from the end, so the right turn
+	// mirrors the span onto the other end of the strip.
 
-	void SetTurnLED(int i, uint32_t color)
+	void SetTurnSpan(int first, int count, uint32_t color)
 	{
 		if (_style == LEFT_TURN || _style == HAZARD)
-			_pStrip->setPixelColor(i, color);
+			FillSpan(first, count, color);
 
 		if (_style == RIGHT_TURN || _style == HAZARD)
-			_pStrip->setPixelColor(NUMBER_USED_PIXELS - 1 - i, color);
+			FillSpan(NUMBER_USED_PIXELS - first - count, count, color);
 	}
 
 	SIGNAL_STYLE _style;
 
   public:
 
-	SignalEvent(Adafruit_NeoPixel * pStrip) 
-		: LightingEvent(pStrip)
+	SignalEvent(LEDOutput * pOutput) 
+		: LightingEvent(pOutput),
+		  _timing(g_signalTiming),
+		  _phases(MakeSignalPhases(g_signalTiming)),
+		  _bloomStep(EasePhaseStep(g_signalTiming.bloomTime)),
+		  _fadeStep(EasePhaseStep(g_signalTiming.fadeTime))
 	{
 	}
 
-	SignalEvent(Adafruit_NeoPixel * pStrip, SIGNAL_STYLE style) 
-		: LightingEvent(pStrip),
+	SignalEvent(LEDOutput * pOutput, SIGNAL_STYLE style, const SignalTiming & timing = g_signalTiming) 
+		: LightingEvent(pOutput),
+		  _timing(timing),
+		  _phases(MakeSignalPhases(timing)),
+		  _bloomStep(EasePhaseStep(timing.bloomTime)),
+		  _fadeStep(EasePhaseStep(timing.fadeTime)),
 		  _style(style)
 	{
 	}
 
+	virtual bool IsSafetyCritical() override
+	{
+		return true;
+	}
+
 	virtual void Draw() override
 	{
 		if (false == GetActive())
 			return;
 
-		float fCyclePosition = fmod(TimeElapsedTotal(), SequentialCycleTime);
+		uint32_t cyclePosition = TimeElapsedMs() % _phases.cycleTime;
 
-		if (fCyclePosition > SequentialOffStart)
+		if (cyclePosition > _phases.offStart)
 		{
-			for (int i = 0; i < NUMBER_TURN_PIXELS; i++)
-				SetTurnLED(i, COLOR_BLACK);
+			return;
 		}
-		else if (fCyclePosition > SequentialFadeStart)
+		else if (cyclePosition > _phases.fadeStart)
 		{
-			fCyclePosition -= SequentialFadeStart;
-			float pctComplete = fCyclePosition / SequentialFadeTime;
-			int cPixelsLit = NUMBER_TURN_PIXELS - (NUMBER_TURN_PIXELS * pctComplete);
-			for (int i = 0; i < NUMBER_TURN_PIXELS; i++)
-			{
-				if (i < cPixelsLit)
-					SetTurnLED(i, COLOR_AMBER);
-				else
-					SetTurnLED(i, COLOR_BLACK);
-			}
+			cyclePosition -= _phases.fadeStart;
+			int cPixelsLit = NUMBER_TURN_PIXELS - EaseCount(_timing.fadeCurve, NUMBER_TURN_PIXELS, cyclePosition, _timing.fadeTime, _fadeStep);
+			SetTurnSpan(0, cPixelsLit, COLOR_AMBER);
 		}
-		else if (fCyclePosition > SequentialHoldStart)
+		else if (cyclePosition > _phases.holdStart)
 		{
-			for (int i = 0; i < NUMBER_TURN_PIXELS; i++)
-				SetTurnLED(i, COLOR_AMBER);
+			SetTurnSpan(0, NUMBER_TURN_PIXELS, COLOR_AMBER);
 		}
 		else
 		{
-			assert(fCyclePosition <= SequentialBloomTime);
-			float pctComplete = fCyclePosition / SequentialBloomTime;
-			int cPixelsLit = (NUMBER_TURN_PIXELS * pctComplete);
-			for (int i = 0; i < NUMBER_TURN_PIXELS; i++)
-			{
-				if (i >= (NUMBER_TURN_PIXELS - cPixelsLit))
-					SetTurnLED(i, COLOR_AMBER);
-				else
-					SetTurnLED(i, COLOR_BLACK);
-			}
-
+			int cPixelsLit = EaseCount(_timing.bloomCurve, NUMBER_TURN_PIXELS, cyclePosition, _timing.bloomTime, _bloomStep);
+			SetTurnSpan(NUMBER_TURN_PIXELS - cPixelsLit, cPixelsLit, COLOR_AMBER);
 		}
-		_pStrip->show();
+	}
+
+	// The bloom and the fade move all the time, but the hold stays put until the fade
+	// starts and the off phase stays dark until the next cycle begins.  The phases
+	// change a ms after their start times, as Draw() compares them with >.
+
+	virtual uint32_t MsUntilChange() override
+	{
+		if (false == GetActive())
+			return EVENT_NO_CHANGE;
+
+		uint32_t cyclePosition = TimeElapsedMs() % _phases.cycleTime;
 
+		if (cyclePosition > _phases.offStart)
+			return _phases.cycleTime - cyclePosition;
+		if (cyclePosition > _phases.fadeStart)
+			return 0;
+		if (cyclePosition > _phases.holdStart)
+			return _phases.fadeStart + 1 - cyclePosition;
+		return 0;
 	}
 };
 
@@ -264,56 +484,171 @@ class SignalEvent : public LightingEvent
 //
 // The police bar breaks the light strip into 8 sections, and then alternates patterns based on a table
 
+#define POLICE_SECTIONS 8
+
 struct PoliceLightBarState
 {
-	uint32_t sectionColor[8];
+	uint32_t sectionColor[POLICE_SECTIONS];
 	uint32_t duration;
 };
 
+// The firmware's table lives in flash.  It's nearly 400 bytes, a fifth of the 328P's RAM.
+
+static constexpr PoliceLightBarState g_policeBarStates[] HAL_FLASH =
+{
+#ifdef VEHICLE_POLICE_STATES
+	VEHICLE_POLICE_STATES
+#else
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   }, 200 },
+	{  { COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE  }, 200 },
+	{  { COLOR_WHITE, COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_WHITE },  20 },
+	{  { COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_WHITE, COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_WHITE, COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_WHITE, COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
+	{  { COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE  }, 200 },
+#endif
+};
+
+// Police table checks.  Every row has to show for some time, and the whole cycle is
+// the sum of them.  These read the table directly, so at run time they only work on
+// a table in RAM; the flash table is only ever handed to them at compile time.
+
+constexpr uint32_t PoliceCycleTime(const PoliceLightBarState * pStates, size_t cStates)
+{
+	return cStates == 0 ? 0 : pStates->duration + PoliceCycleTime(pStates + 1, cStates - 1);
+}
+
+constexpr bool PoliceRowsNonZero(const PoliceLightBarState * pStates, size_t cStates)
+{
+	return cStates == 0 || (pStates->duration > 0 && PoliceRowsNonZero(pStates + 1, cStates - 1));
+}
+
+constexpr bool ValidPoliceStates(const PoliceLightBarState * pStates, size_t cStates)
+{
+	return cStates > 0 && PoliceRowsNonZero(pStates, cStates);
+}
+
+static constexpr uint32_t g_policeBarCycleTime = PoliceCycleTime(g_policeBarStates, ARRAYSIZE(g_policeBarStates));
+
+static_assert(ValidPoliceStates(g_policeBarStates, ARRAYSIZE(g_policeBarStates)), "g_policeBarStates: every row needs a non-zero duration");
+static_assert(NUMBER_USED_PIXELS >= POLICE_SECTIONS, "The police bar needs at least a pixel per section");
+
+// Where each section of the bar starts, and where the last one ends.  Spreading the
+// remainder across the sections covers the whole strip even when its length isn't a
+// multiple of the section count.  A vehicle profile can place them itself, to line the
+// sections up with the body work.
+
+#define POLICE_SECTION_START(i) ((uint16_t)((uint32_t)(i) * NUMBER_USED_PIXELS / POLICE_SECTIONS))
+
+#ifndef VEHICLE_POLICE_SECTION_STARTS
+#define VEHICLE_POLICE_SECTION_STARTS \
+{ \
+	POLICE_SECTION_START(0), POLICE_SECTION_START(1), POLICE_SECTION_START(2), POLICE_SECTION_START(3), \
+	POLICE_SECTION_START(4), POLICE_SECTION_START(5), POLICE_SECTION_START(6), POLICE_SECTION_START(7), \
+	POLICE_SECTION_START(8) \
+}
+#endif
+
+static constexpr uint16_t g_policeSectionStart[POLICE_SECTIONS + 1] HAL_FLASH = VEHICLE_POLICE_SECTION_STARTS;
+
+constexpr bool PoliceSectionsInOrder(const uint16_t * pStarts, size_t cSections)
+{
+	return cSections == 0 || (pStarts[0] < pStarts[1] && PoliceSectionsInOrder(pStarts + 1, cSections - 1));
+}
+
+static_assert(g_policeSectionStart[0] == 0 && g_policeSectionStart[POLICE_SECTIONS] == NUMBER_USED_PIXELS,
+			  "The police bar's sections must run from the first used pixel to the last");
+static_assert(PoliceSectionsInOrder(g_policeSectionStart, POLICE_SECTIONS), "Every police bar section needs at least a pixel");
+
 class PoliceLightBar : public LightingEvent
 {
-	static const PoliceLightBarState _PoliceBarStates1[11];		// Sadly we must spec arraysize because its a forward declaration
+	const PoliceLightBarState * _pStates;				// The table we run through, normally g_policeBarStates
+	size_t                      _cStates;
+	bool                        _statesInFlash;
+	uint32_t                    _cycleTime;				// Total length of one pass through the table, in ms
+
+	uint32_t RowDuration(size_t row)
+	{
+		if (!_statesInFlash)
+			return _pStates[row].duration;
+
+		uint32_t duration;
+		HAL_ReadFlash(&duration, &_pStates[row].duration, sizeof(duration));
+		return duration;
+	}
 
   public:  
 
-	PoliceLightBar(Adafruit_NeoPixel * pStrip)
-		: LightingEvent(pStrip)
+	PoliceLightBar(LEDOutput * pOutput)
+		: LightingEvent(pOutput),
+		  _pStates(g_policeBarStates),
+		  _cStates(ARRAYSIZE(g_policeBarStates)),
+		  _statesInFlash(true),
+		  _cycleTime(g_policeBarCycleTime)
 	{
 	}
 
+	// A table of your own must be in RAM and pass ValidPoliceStates()
+
+	PoliceLightBar(LEDOutput * pOutput, const PoliceLightBarState * pStates, size_t cStates)
+		: LightingEvent(pOutput),
+		  _pStates(pStates),
+		  _cStates(cStates),
+		  _statesInFlash(false),
+		  _cycleTime(PoliceCycleTime(pStates, cStates))
+	{
+	}
+
+	// CurrentRow
+	//
+	// Rather than delay() through the whole table inside Draw, find the row that should
+	// be showing right now based on how far into the cycle we are.  Also returns how
+	// much longer that row has to show.
+
+	size_t CurrentRow(uint32_t & msLeft)
+	{
+		uint32_t cyclePosition = TimeElapsedMs() % _cycleTime;
+
+		size_t   row = 0;
+		uint32_t duration;
+		for (; cyclePosition >= (duration = RowDuration(row)); row++)
+			cyclePosition -= duration;
+
+		msLeft = duration - cyclePosition;
+		return row;
+	}
+
+	virtual uint32_t MsUntilChange() override
+	{
+		if (false == GetActive())
+			return EVENT_NO_CHANGE;
+
+		uint32_t msLeft;
+		CurrentRow(msLeft);
+		return msLeft;
+	}
+
 	virtual void Draw() override
 	{
 		if (false == GetActive())
 			return;
 
-		const size_t sectionSize  = NUMBER_USED_PIXELS / 8;
+		uint32_t msLeft;
+		size_t   row = CurrentRow(msLeft);
 
-		for (size_t row = 0; row < ARRAYSIZE(_PoliceBarStates1); row++)
-		{
-			for (uint16_t i = 0; i < NUMBER_USED_PIXELS; i++)
-			{
-				int iSection = i / sectionSize;
-				const uint32_t color = (_PoliceBarStates1[row].sectionColor[iSection]);
-				_pStrip->setPixelColor(i, color);
-			}
-			_pStrip->show();
-			delay(_PoliceBarStates1[row].duration);
-		}
-	}
-};
+		PoliceLightBarState state;
+		uint16_t            sectionStart[POLICE_SECTIONS + 1];
+		if (_statesInFlash)
+			HAL_ReadFlash(&state, &_pStates[row], sizeof(state));
+		else
+			state = _pStates[row];
+		HAL_ReadFlash(sectionStart, g_policeSectionStart, sizeof(sectionStart));
 
-const PoliceLightBarState PoliceLightBar::_PoliceBarStates1[] =
-{
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   }, 200 },
-	{  { COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE  }, 200 },
-	{  { COLOR_WHITE, COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_WHITE },  20 },
-	{  { COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_WHITE, COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_WHITE, COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_WHITE, COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_WHITE, COLOR_BLUE,  COLOR_RED,   COLOR_RED   },  20 },
-	{  { COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE,  COLOR_RED,   COLOR_RED,   COLOR_BLUE,  COLOR_BLUE  }, 200 },
+		for (size_t iSection = 0; iSection < POLICE_SECTIONS; iSection++)
+			FillSpan(sectionStart[iSection], sectionStart[iSection + 1] - sectionStart[iSection], state.sectionColor[iSection]);
+	}
 };
-
@@ -0,0 +1,238 @@
+#pragma once
+#include "HAL.h"
+#include "LightingEvents.h"
+
+// Noise
+//
+// Slowly drifting procedural color for when the car is parked: value noise, sampled
+// along the strip in one direction and through time in the other, turned into a color
+// with an integer HSV conversion.  Everything is 8 and 16 bit math and two 256 byte
+// tables kept in flash, a permutation for the noise lattice and a sine, so a frame of
+// 144 pixels is a few thousand table reads and no divides, inside the 10ms a 100 FPS
+// frame has on a 16 MHz AVR.
+//
+// Like every other effect, a frame depends only on the time since the effect began.
+
+// The lattice: a shuffle of 0-255, read twice to hash a pair of coordinates
+
+static const uint8_t g_noisePerm[256] HAL_FLASH =
+{
+	 43, 101, 164, 223,  62, 146,  33, 145, 176, 122,  37, 107,  19,  89, 255, 126,
+	132, 211, 141, 206, 119,  61, 169, 128, 118,   9, 192,  69, 230,  70, 134,  28,
+	 55, 198,   0,  29, 148, 172,  21, 184,  12, 246, 251, 253, 137, 214,  34,  59,
+	159, 162, 133,  88, 190, 240, 114, 109,  11, 123,  47, 181, 100, 108,  95,  53,
+	 50,   6, 179,  72,  14, 170, 208, 222,   2, 151, 224,  79, 127,  82, 252,  44,
+	 68,  31,  54, 113, 250, 143,  99,  58, 229, 167, 153,  73, 125, 199, 152,  26,
+	138,  80, 194,  18, 207, 158, 106,  38, 227, 186, 210, 183, 245, 144, 205, 231,
+	 39,  24,  78,  27,  46,   1, 204,  35, 185,  15, 112,  23,  32,  97, 236, 189,
+	226, 120, 238, 124,   4, 249, 234,  77, 201, 216, 209, 193, 219, 105,  13, 228,
+	 98, 233, 215, 188,  94, 217, 203, 195, 200, 155, 139,  45,  71, 213, 174,  92,
+	147, 142, 212, 178,  22, 180, 254,  64,  63,  52, 221, 202,  84, 104, 239,  91,
+	 96,  85,  56, 168, 241, 177, 232, 161, 187,  41,  90,   3, 243, 131, 166, 175,
+	130,  36,  25, 248,  48, 165,  66,  17,  67,  87, 116, 182, 218,  81,  93, 225,
+	 40, 102, 149, 235,  74,  75, 115,  83, 121,  49, 156,  86, 157, 150, 173, 110,
+	 51,  57,  42, 191,  20,   5, 196, 154, 237, 197, 117, 242, 135, 163, 247,  16,
+	220,  10,   8, 244,  60, 140, 136, 111,  30,  76, 129, 171, 160, 103,   7,  65
+};
+
+// sin8(i): round(127.5 + 127.5 * sin(2 pi i / 256)), which stays within 0-255
+
+static const uint8_t g_sin8[256] HAL_FLASH =
+{
+	128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+	176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+	218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+	245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+	255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+	245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+	218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+	176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+	128, 124, 121, 118, 115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+	 79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,  47,  44,  42,  40,
+	 37,  35,  33,  31,  29,  27,  25,  23,  21,  20,  18,  17,  15,  14,  12,  11,
+	 10,   9,   7,   6,   5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+	  0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+	 10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+	 37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+	 79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124
+};
+
+static inline uint8_t Sin8(uint8_t theta)
+{
+	return HAL_ReadFlashByte(&g_sin8[theta]);
+}
+
+// Scale8
+//
+// a * b / 256, with 255 leaving a as it is
+
+static inline uint8_t Scale8(uint8_t a, uint8_t b)
+{
+	return (uint8_t)(((uint16_t) a * (b + 1)) >> 8);
+}
+
+// Lerp8
+//
+// From a to b by t / 256.  The difference is taken one way or the other so the
+// product stays unsigned and in 16 bits.
+
+static inline uint8_t Lerp8(uint8_t a, uint8_t b, uint8_t t)
+{
+	if (b >= a)
+		return a + (uint8_t)(((uint16_t)(b - a) * t) >> 8);
+	return a - (uint8_t)(((uint16_t)(a - b) * t) >> 8);
+}
+
+// Noise8
+//
+// Value noise at (x, y), both 8.8 fixed point with the lattice every 256: a random
+// byte at each lattice point, blended down the cell and then across it with a cosine
+// ease (half a period of the sine table) so there are no creases at the cell edges.
+// The lattice repeats every 256 cells, which is where a 16 bit coordinate wraps, so a
+// coordinate that counts up forever never jumps.
+
+static inline uint8_t NoiseLattice(uint8_t x, uint8_t y)
+{
+	return HAL_ReadFlashByte(&g_noisePerm[(uint8_t)(HAL_ReadFlashByte(&g_noisePerm[x]) + y)]);
+}
+
+static inline uint8_t NoiseEase(uint8_t f)
+{
+	return 255 - Sin8(64 + (f >> 1));
+}
+
+static inline uint8_t NoiseColumn(uint8_t xi, uint8_t yi, uint8_t yf)
+{
+	return Lerp8(NoiseLattice(xi, yi), NoiseLattice(xi, yi + 1), yf);
+}
+
+static inline uint8_t Noise8(uint16_t x, uint16_t y)
+{
+	uint8_t xi = x >> 8;
+	uint8_t yi = y >> 8, yf = NoiseEase((uint8_t) y);
+
+	return Lerp8(NoiseColumn(xi, yi, yf), NoiseColumn(xi + 1, yi, yf), NoiseEase((uint8_t) x));
+}
+
+// NoiseRow
+//
+// Noise8() along one row, for x going up: the same values, but the columns at each
+// side of a cell are worked out once for all the pixels in it, which leaves each
+// pixel one ease and one blend.
+
+class NoiseRow
+{
+	uint8_t _yi;
+	uint8_t _yf;
+	uint8_t _xi;
+	uint8_t _left;
+	uint8_t _right;
+
+  public:
+
+	NoiseRow(uint16_t y)
+		: _yi(y >> 8),
+		  _yf(NoiseEase((uint8_t) y)),
+		  _xi(0),
+		  _left(NoiseColumn(0, _yi, _yf)),
+		  _right(NoiseColumn(1, _yi, _yf))
+	{
+	}
+
+	uint8_t At(uint16_t x)
+	{
+		uint8_t xi = x >> 8;
+		if (xi != _xi)
+		{
+			_left  = (xi == (uint8_t)(_xi + 1)) ? _right : NoiseColumn(xi, _yi, _yf);
+			_right = NoiseColumn(xi + 1, _yi, _yf);
+			_xi    = xi;
+		}
+		return Lerp8(_left, _right, NoiseEase((uint8_t) x));
+	}
+};
+
+// HsvToRgb
+//
+// Hue 0-255 around the wheel from red, split into six sectors by multiplying rather
+// than dividing.  Every product is two bytes, so it all fits in 16 bits.
+
+static inline uint32_t HsvToRgb(uint8_t hue, uint8_t sat, uint8_t val)
+{
+	uint16_t h6     = (uint16_t) hue * 6;
+	uint8_t  sector = h6 >> 8;
+	uint8_t  rest   = (uint8_t) h6;
+
+	uint8_t p = Scale8(val, 255 - sat);
+	uint8_t q = Scale8(val, 255 - Scale8(sat, rest));
+	uint8_t t = Scale8(val, 255 - Scale8(sat, 255 - rest));
+
+	switch (sector)
+	{
+		case 0:  return PACK_RGB(val, t, p);
+		case 1:  return PACK_RGB(q, val, p);
+		case 2:  return PACK_RGB(p, val, t);
+		case 3:  return PACK_RGB(p, q, val);
+		case 4:  return PACK_RGB(t, p, val);
+		default: return PACK_RGB(val, p, q);
+	}
+}
+
+// NoiseEvent
+//
+// Every pixel its own color, from the noise at its place on the strip and the time.
+//
+//   EMBERS   reds and oranges glowing and dimming, like coals
+//   RAINBOW  the whole wheel of hues drifting along the strip under a slow breath
+
+#define NOISE_PIXEL_STEP 28									// Lattice cells are about 9 pixels apart
+
+class NoiseEvent : public LightingEvent
+{
+  public:
+
+	enum NOISE_STYLE
+	{
+		EMBERS = 0,
+		RAINBOW
+	};
+
+  private:
+
+	NOISE_STYLE _style;
+
+  public:
+
+	NoiseEvent(LEDOutput * pOutput, NOISE_STYLE style)
+		: LightingEvent(pOutput),
+		  _style(style)
+	{
+	}
+
+	virtual void Draw() override
+	{
+		if (false == GetActive())
+			return;
+
+		uint32_t elapsed = TimeElapsedMs();
+		uint16_t x       = 0;
+
+		if (_style == EMBERS)
+		{
+			NoiseRow row((uint16_t)(elapsed >> 2));					// A lattice row every 1024ms
+			for (int i = 0; i < NUMBER_USED_PIXELS; i++, x += NOISE_PIXEL_STEP)
+			{
+				uint8_t n = row.At(x);
+				FillSpan(i, 1, HsvToRgb(n >> 3, 255, Scale8(n, n)));
+			}
+		}
+		else
+		{
+			NoiseRow row((uint16_t)(elapsed >> 3));
+			uint8_t  shift  = (uint8_t)(elapsed >> 5);				// Around the wheel every 8s
+			uint8_t  breath = 128 + (Sin8((uint8_t)(elapsed >> 4)) >> 1);
+			for (int i = 0; i < NUMBER_USED_PIXELS; i++, x += NOISE_PIXEL_STEP)
+				FillSpan(i, 1, HsvToRgb(row.At(x) + shift, 240, breath));
+		}
+	}
+};
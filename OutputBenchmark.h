@@ -0,0 +1,60 @@
+#pragma once
+#include <stdio.h>
+#include "HAL.h"
+#include "LEDOutput.h"
+
+// OutputBenchmark
+//
+// Times the LEDOutput backends head-to-head on the same work: compose a typical frame
+// (a full-strip fill plus turn signal spans blended over it) and commit it, over and
+// over.  Results go out over Serial as microseconds per frame and the frame rate that
+// implies.  Backends are created and destroyed one at a time by the caller's factory
+// so that only one frame buffer is ever allocated at once.
+//
+// Every driver disables interrupts while it sends, so frames are timed with the HAL
+// stopwatch, which keeps counting regardless.
+
+#define OUTPUT_BENCHMARK_FRAMES 100
+
+typedef LEDOutput * (*OutputFactory)();
+
+struct OutputBenchmarkEntry
+{
+	const char  * name;
+	OutputFactory pfnCreate;
+};
+
+static unsigned long BenchmarkOutput(LEDOutput * pOutput)
+{
+	uint16_t      cPixels = pOutput->GetLength();
+	uint16_t      cTurn   = cPixels / 3;
+	unsigned long total   = 0;
+
+	for (int frame = 0; frame < OUTPUT_BENCHMARK_FRAMES; frame++)
+	{
+		HAL_StopwatchStart();
+		pOutput->Clear();
+		pOutput->WriteSpan(0, cPixels, COLOR_RED, BLEND_REPLACE);
+		pOutput->WriteSpan(0, cTurn, COLOR_AMBER, BLEND_MAX);
+		pOutput->WriteSpan(cPixels - cTurn, cTurn, COLOR_AMBER, BLEND_ALPHA, 128);
+		pOutput->Commit();
+		total += HAL_StopwatchMicros();
+	}
+	return total / OUTPUT_BENCHMARK_FRAMES;
+}
+
+static void BenchmarkOutputs(const OutputBenchmarkEntry * pEntries, size_t cEntries)
+{
+	HAL_SerialPrintln("Backend           us/frame     fps");
+
+	for (size_t i = 0; i < cEntries; i++)
+	{
+		LEDOutput   * pOutput = pEntries[i].pfnCreate();
+		unsigned long us      = BenchmarkOutput(pOutput);
+		delete pOutput;
+
+		char szBuf[48];
+		snprintf(szBuf, sizeof(szBuf), "%-16s %9lu %7lu", pEntries[i].name, us, us ? 1000000UL / us : 0);
+		HAL_SerialPrintln(szBuf);
+	}
+}
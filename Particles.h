@@ -0,0 +1,220 @@
+#pragma once
+#include "HAL.h"
+#include "LightingEvents.h"
+
+// Particles
+//
+// Effects made of many small moving lights: sparkles that scatter off the strip as
+// the brake lets go, and comets with fading tails that run out along a turn signal.
+// The particles live in a fixed pool that the caller provides, normally a static
+// array, so they take no heap and their RAM shows in the build's global variable
+// count.  Each frame costs time in proportion to the particles alive, not to the
+// strip's length.
+//
+// Positions are in 1/64ths of a pixel and velocities in 1/1024ths of a pixel per ms,
+// so all the motion is 16 and 32 bit integer math.  Positions are 32 bits, since a
+// strip of 512 pixels or more doesn't fit in 16 once it's shifted.  A particle stores where it was
+// born and how fast it goes, and where it is now is worked out from its age each
+// frame, so nothing accumulates rounding error between frames.
+//
+// Particle k of an event is always born at k * spawnMs after the event began, and
+// how it looks and moves comes from a hash of k.  So the pool is only a cache: which
+// particles are alive at a moment, and what each of them draws, depends on nothing
+// but the event's start time and the time now, the same as every other effect.  When
+// time jumps (a restored snapshot, a benchmark revisiting a moment) the pool is just
+// refilled from the particles that should be alive then.
+
+#define PARTICLE_POSITION_SHIFT 6						// Positions are pixels << 6
+#define PARTICLE_VELOCITY_SHIFT 4						// Velocity * ms >> 4 is a position
+
+#define SPARKLE_SPAWN_MS  24							// A new sparkle this often...
+#define SPARKLE_BURST_MS  400							// ...for this long after the brake lets go
+#define SPARKLE_LIFE_MS   240							// Each fades out over this long
+#define SPARKLE_POOL      ((SPARKLE_LIFE_MS + SPARKLE_SPAWN_MS - 1) / SPARKLE_SPAWN_MS + 1)
+
+#define COMET_SPAWN_MS    375							// A new comet this often while the signal is on
+#define COMET_LIFE_MS     500							// Each runs the length of the turn zone in this long
+#define COMET_TAIL        5								// Pixels of tail, each half as bright as the one before
+#define COMET_POOL        ((COMET_LIFE_MS + COMET_SPAWN_MS - 1) / COMET_SPAWN_MS + 1)
+
+struct Particle
+{
+	int32_t  position;									// Where it was born, pixels << PARTICLE_POSITION_SHIFT
+	int16_t  velocity;
+	uint16_t bornMs;									// Into the event, the low 16 bits
+	uint8_t  color;										// Index into the style's colors
+	uint8_t  reserved;
+};
+
+static const uint32_t g_sparkleColors[] HAL_FLASH = { COLOR_RED, COLOR_WHITE, COLOR_AMBER, COLOR_RED };
+static const uint32_t g_cometColors[]   HAL_FLASH = { COLOR_YELLOW, COLOR_AMBER };
+
+// ParticleHash
+//
+// Scrambles a particle's number into 16 bits that look random, with nothing wider
+// than a 16 bit multiply
+
+static inline uint16_t ParticleHash(uint16_t k)
+{
+	uint16_t x = k * 0x9E37 + 0x79B9;
+	x ^= x >> 7;
+	x *= 0x5BD1;
+	x ^= x >> 9;
+	return x;
+}
+
+class ParticleEvent : public LightingEvent
+{
+  public:
+
+	enum PARTICLE_STYLE
+	{
+		SPARKLE = 0,									// Scattered over the whole strip, for a burst after Begin()
+		LEFT_COMETS,									// Running out to the left end, for as long as it's active
+		RIGHT_COMETS
+	};
+
+  private:
+
+	Particle *     _pPool;
+	uint8_t        _cPool;
+	PARTICLE_STYLE _style;
+	uint16_t       _spawnMs;
+	uint16_t       _lifeMs;
+	uint16_t       _fade;								// Brightness lost per ms of age, << 8, so fading takes no divide
+	uint32_t       _first;								// The oldest particle in the pool...
+	uint32_t       _next;								// ...and the next to be born; each sits at its number % _cPool
+	uint32_t       _lastElapsed;
+
+	// How many particles are born by elapsed ms, and the first of them that's still
+	// alive: particle k lives from k * spawnMs until lifeMs after that
+
+	uint32_t BornBy(uint32_t elapsed)
+	{
+		if (_style == SPARKLE && elapsed >= SPARKLE_BURST_MS)
+			elapsed = SPARKLE_BURST_MS - 1;
+		return elapsed / _spawnMs + 1;
+	}
+
+	uint32_t FirstAlive(uint32_t elapsed)
+	{
+		return elapsed < _lifeMs ? 0 : (elapsed - _lifeMs) / _spawnMs + 1;
+	}
+
+	void Spawn(uint32_t k)
+	{
+		Particle & particle = _pPool[k % _cPool];
+		uint16_t   hash     = ParticleHash((uint16_t) k);
+
+		particle.bornMs = (uint16_t)(k * _spawnMs);			// Ages are taken mod 2^16, so this can wrap
+		if (_style == SPARKLE)
+		{
+			particle.position = (int32_t)((uint32_t) hash * NUMBER_USED_PIXELS >> 16) << PARTICLE_POSITION_SHIFT;
+			particle.velocity = (int16_t)(hash & 0x3F) - 32;					// A slow drift either way
+			particle.color    = (hash >> 6) & 3;
+		}
+		else
+		{
+			// From the inside edge of the turn zone out to the end of the strip, a little
+			// faster or slower than exactly one zone per lifetime
+
+			int32_t speed = ((int32_t) NUMBER_TURN_PIXELS << (PARTICLE_POSITION_SHIFT + PARTICLE_VELOCITY_SHIFT)) / COMET_LIFE_MS;
+			particle.position = (int32_t)(NUMBER_TURN_PIXELS - 1) << PARTICLE_POSITION_SHIFT;
+			particle.velocity = (int16_t)(-(speed * (224 + (hash & 63)) >> 8));
+			particle.color    = (hash >> 6) & 1;
+		}
+	}
+
+	// Makes the pool hold exactly the particles alive at elapsed ms
+
+	void Advance(uint32_t elapsed)
+	{
+		uint32_t first = FirstAlive(elapsed);
+		uint32_t born  = BornBy(elapsed);
+
+		if (elapsed < _lastElapsed || _next < first)
+			_first = _next = first;						// Time went back, or jumped past everything in the pool
+		_lastElapsed = elapsed;
+
+		if (_first < first)
+			_first = first;
+		if (born - _first > _cPool)						// A pool too small for the style drops its oldest
+			_first = born - _cPool;
+		if (_next < _first)
+			_next = _first;
+		while (_next < born)
+			Spawn(_next++);
+	}
+
+	uint32_t Color(uint8_t index)
+	{
+		uint32_t color;
+		HAL_ReadFlash(&color, (_style == SPARKLE ? g_sparkleColors : g_cometColors) + index, sizeof(color));
+		return color;
+	}
+
+	void DrawPixel(int pixel, uint32_t color, uint8_t level)
+	{
+		if (_style == RIGHT_COMETS)
+			pixel = NUMBER_USED_PIXELS - 1 - pixel;
+		FillSpan(pixel, 1, color, BLEND_ALPHA, level);
+	}
+
+  public:
+
+	ParticleEvent(LEDOutput * pOutput, PARTICLE_STYLE style, Particle * pPool, uint8_t cPool)
+		: LightingEvent(pOutput),
+		  _pPool(pPool),
+		  _cPool(cPool),
+		  _style(style),
+		  _spawnMs(style == SPARKLE ? SPARKLE_SPAWN_MS : COMET_SPAWN_MS),
+		  _lifeMs(style == SPARKLE ? SPARKLE_LIFE_MS : COMET_LIFE_MS),
+		  _fade((255 << 8) / _lifeMs),
+		  _first(0),
+		  _next(0),
+		  _lastElapsed(0)
+	{
+	}
+
+	virtual void Begin() override
+	{
+		LightingEvent::Begin();
+		_first = _next = 0;
+		_lastElapsed = 0;
+	}
+
+	// Sparkles are done once the last of the burst has faded; comets keep coming
+
+	virtual uint32_t MsUntilChange() override
+	{
+		if (false == GetActive() || (_style == SPARKLE && TimeElapsedMs() >= SPARKLE_BURST_MS + SPARKLE_LIFE_MS))
+			return EVENT_NO_CHANGE;
+		return 0;
+	}
+
+	virtual void Draw() override
+	{
+		if (false == GetActive())
+			return;
+
+		uint32_t elapsed = TimeElapsedMs();
+		if (_style == SPARKLE && elapsed >= SPARKLE_BURST_MS + SPARKLE_LIFE_MS)
+			return;
+
+		Advance(elapsed);
+
+		for (uint32_t k = _first; k < _next; k++)
+		{
+			const Particle & particle = _pPool[k % _cPool];
+			uint16_t         age      = (uint16_t) elapsed - particle.bornMs;
+			int              pixel    = (particle.position + ((int32_t) particle.velocity * age >> PARTICLE_VELOCITY_SHIFT)) >> PARTICLE_POSITION_SHIFT;
+			uint8_t          level    = (uint32_t)(_lifeMs - age) * _fade >> 8;
+			uint32_t         color    = Color(particle.color);
+
+			DrawPixel(pixel, color, level);
+			if (_style != SPARKLE)
+				for (uint8_t i = 1; i <= COMET_TAIL && (level >>= 1) != 0; i++)
+					DrawPixel(pixel + i, color, level);
+		}
+	}
+};
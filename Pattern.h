@@ -0,0 +1,368 @@
+#pragma once
+#include "HAL.h"
+#include "LightingEvents.h"
+
+// Pattern
+//
+// Effects that aren't compiled in: a small program in EEPROM, uploaded over Serial
+// (see PatternLoader.h and Tools/pattern.py) and run by PatternEvent whenever the
+// switches match the combination it was uploaded for.
+//
+// EEPROM holds an 8 byte header and then the program:
+//
+//   0  'B' 'P'          magic; anything else means there's no pattern
+//   2  version          PATTERN_VERSION
+//   3  inputs           the INPUT_ bits that select the pattern, all of them exactly
+//   4  length           program bytes, little endian
+//   6  crc              CRC-16/CCITT of the program, little endian
+//
+// The program is a list of 8 byte instructions, all the same shape:
+//
+//   op a0 a1 b0 b1 r g b
+//
+//   SEGMENT  0x10       a section of the animation, (b << 16 | a) ms long, up to
+//                       PATTERN_MAX_SEGMENT_MS.  The segments play in order and
+//                       then loop.
+//   FILL     0x20       pixels a through a + b - 1 in the color
+//   GROW     0x30 + m   the same span, lit from nothing to all of it over the
+//                       segment: m is 0 from the start, 1 from the end, 2 from the
+//                       middle out
+//   FADE     0x40 + m   the same span, blended in over the segment (m 0) or out (m 1)
+//   END      0x00       the last instruction, and only the last
+//
+// Drawing instructions belong to the segment before them.  The math is all integer,
+// the same as the compiled-in effects.
+//
+// PatternVerify() checks a whole program once, before it's ever run: every opcode,
+// every span on the strip, every segment some time long but no longer than 16 bits of
+// ms, and exactly one END at the end.  So Draw() runs without checking anything per
+// instruction, at the same cost per span as a compiled-in effect, and its grow and
+// fade math (a 16 bit count or 255 times a position in the segment) stays within 32
+// bits.
+
+#define PATTERN_MAGIC0            'B'
+#define PATTERN_MAGIC1            'P'
+#define PATTERN_VERSION           1
+#define PATTERN_HEADER_BYTES      8
+#define PATTERN_INSTRUCTION_BYTES 8
+#define PATTERN_MAX_BYTES         (HAL_EEPROM_SIZE - PATTERN_HEADER_BYTES)
+#define PATTERN_MAX_SEGMENT_MS    0xFFFFUL
+
+#define PATTERN_OP_END            0x00
+#define PATTERN_OP_SEGMENT        0x10
+#define PATTERN_OP_FILL           0x20
+#define PATTERN_OP_GROW           0x30
+#define PATTERN_OP_FADE           0x40
+
+#define PATTERN_GROW_UP           0
+#define PATTERN_GROW_DOWN         1
+#define PATTERN_GROW_CENTER       2
+#define PATTERN_FADE_IN           0
+#define PATTERN_FADE_OUT          1
+
+enum PATTERN_ERROR : uint8_t
+{
+	PATTERN_OK = 0,
+	PATTERN_BAD_LENGTH,
+	PATTERN_NO_SEGMENT,
+	PATTERN_BAD_OPCODE,
+	PATTERN_BAD_SPAN,
+	PATTERN_ZERO_SEGMENT,
+	PATTERN_TOO_LONG,
+	PATTERN_NO_END,
+	PATTERN_LONG_SEGMENT,
+};
+
+static const char * PatternErrorName(PATTERN_ERROR error)
+{
+	switch (error)
+	{
+		case PATTERN_OK:           return "ok";
+		case PATTERN_BAD_LENGTH:   return "length";
+		case PATTERN_NO_SEGMENT:   return "no-segment";
+		case PATTERN_BAD_OPCODE:   return "opcode";
+		case PATTERN_BAD_SPAN:     return "span";
+		case PATTERN_ZERO_SEGMENT: return "zero-segment";
+		case PATTERN_TOO_LONG:     return "too-long";
+		case PATTERN_NO_END:       return "no-end";
+		case PATTERN_LONG_SEGMENT: return "long-segment";
+	}
+	return "?";
+}
+
+struct PatternInstruction
+{
+	uint8_t op;
+	uint8_t a[2];
+	uint8_t b[2];
+	uint8_t rgb[3];
+
+	uint16_t First()      { return a[0] | ((uint16_t) a[1] << 8); }
+	uint16_t Count()      { return b[0] | ((uint16_t) b[1] << 8); }
+	uint32_t DurationMs() { return First() | ((uint32_t) Count() << 16); }
+	uint32_t Color()      { return PACK_RGB(rgb[0], rgb[1], rgb[2]); }
+};
+
+static_assert(sizeof(PatternInstruction) == PATTERN_INSTRUCTION_BYTES, "Instructions are 8 bytes, with no padding");
+
+static inline void ReadPatternInstruction(uint16_t iInstruction, PatternInstruction & instruction)
+{
+	HAL_EepromRead(PATTERN_HEADER_BYTES + iInstruction * PATTERN_INSTRUCTION_BYTES, &instruction, sizeof(instruction));
+}
+
+static inline uint16_t PatternCrc16(uint16_t crc, uint8_t b)
+{
+	crc ^= (uint16_t) b << 8;
+	for (uint8_t bit = 0; bit < 8; bit++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+// PatternVerify
+//
+// Checks the program of length bytes that's in EEPROM now.  On success gives the
+// length of one pass through all its segments.
+
+static PATTERN_ERROR PatternVerify(uint16_t length, uint32_t * pCycleMs)
+{
+	if (length < 2 * PATTERN_INSTRUCTION_BYTES || length > PATTERN_MAX_BYTES || length % PATTERN_INSTRUCTION_BYTES)
+		return PATTERN_BAD_LENGTH;
+
+	uint16_t cInstructions = length / PATTERN_INSTRUCTION_BYTES;
+	uint32_t cycleMs       = 0;
+
+	for (uint16_t i = 0; i < cInstructions; i++)
+	{
+		PatternInstruction instruction;
+		ReadPatternInstruction(i, instruction);
+
+		uint8_t op   = instruction.op & 0xF0;
+		uint8_t mode = instruction.op & 0x0F;
+
+		if (i == 0 && instruction.op != PATTERN_OP_SEGMENT)
+			return PATTERN_NO_SEGMENT;
+		if ((instruction.op == PATTERN_OP_END) != (i == cInstructions - 1))
+			return PATTERN_NO_END;
+
+		switch (op)
+		{
+			case PATTERN_OP_END:
+			case PATTERN_OP_SEGMENT:
+				if (mode != 0)
+					return PATTERN_BAD_OPCODE;
+				if (op == PATTERN_OP_SEGMENT)
+				{
+					uint32_t duration = instruction.DurationMs();
+					if (duration == 0)
+						return PATTERN_ZERO_SEGMENT;
+					if (duration > PATTERN_MAX_SEGMENT_MS)
+						return PATTERN_LONG_SEGMENT;
+					if (cycleMs + duration < cycleMs)
+						return PATTERN_TOO_LONG;
+					cycleMs += duration;
+				}
+				break;
+
+			case PATTERN_OP_FILL:
+			case PATTERN_OP_GROW:
+			case PATTERN_OP_FADE:
+				if ((op == PATTERN_OP_FILL && mode != 0) ||
+					(op == PATTERN_OP_GROW && mode > PATTERN_GROW_CENTER) ||
+					(op == PATTERN_OP_FADE && mode > PATTERN_FADE_OUT))
+					return PATTERN_BAD_OPCODE;
+				if (instruction.Count() == 0 || (uint32_t) instruction.First() + instruction.Count() > NUMBER_USED_PIXELS)
+					return PATTERN_BAD_SPAN;
+				break;
+
+			default:
+				return PATTERN_BAD_OPCODE;
+		}
+	}
+
+	*pCycleMs = cycleMs;
+	return PATTERN_OK;
+}
+
+// PatternEvent
+//
+// Runs whatever pattern is in EEPROM.  Load() reads and checks it, and the engine
+// calls it at startup and again whenever a new one has been uploaded.
+
+class PatternEvent : public LightingEvent
+{
+	bool     _loaded;
+	uint8_t  _inputs;
+	uint16_t _cInstructions;
+	uint32_t _cycleMs;
+
+  public:
+
+	PatternEvent(LEDOutput * pOutput)
+		: LightingEvent(pOutput),
+		  _loaded(false),
+		  _inputs(0),
+		  _cInstructions(0),
+		  _cycleMs(0)
+	{
+	}
+
+	bool IsLoaded()
+	{
+		return _loaded;
+	}
+
+	uint8_t GetInputs()								// The switch combination that selects it
+	{
+		return _inputs;
+	}
+
+	uint32_t GetCycleMs()
+	{
+		return _cycleMs;
+	}
+
+	void Unload()										// Before anything writes to the EEPROM
+	{
+		_loaded = false;
+		End();
+	}
+
+	// Load
+	//
+	// Takes up whatever pattern the EEPROM holds, if it's intact and passes the
+	// verifier.  Returns whether there was one.
+
+	bool Load()
+	{
+		Unload();
+
+		uint8_t header[PATTERN_HEADER_BYTES];
+		HAL_EepromRead(0, header, sizeof(header));
+		if (header[0] != PATTERN_MAGIC0 || header[1] != PATTERN_MAGIC1 || header[2] != PATTERN_VERSION)
+			return false;
+
+		uint8_t  inputs = header[3];
+		uint16_t length = header[4] | ((uint16_t) header[5] << 8);
+		uint16_t crc    = header[6] | ((uint16_t) header[7] << 8);
+		if (inputs == 0 || inputs > (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP | INPUT_BACKUP))
+			return false;
+		if (length == 0 || length > PATTERN_MAX_BYTES)
+			return false;
+
+		uint16_t actual = 0xFFFF;
+		for (uint16_t i = 0; i < length; i++)
+		{
+			uint8_t b;
+			HAL_EepromRead(PATTERN_HEADER_BYTES + i, &b, 1);
+			actual = PatternCrc16(actual, b);
+		}
+		if (actual != crc || PatternVerify(length, &_cycleMs) != PATTERN_OK)
+			return false;
+
+		_inputs        = inputs;
+		_cInstructions = length / PATTERN_INSTRUCTION_BYTES;
+		_loaded        = true;
+		return true;
+	}
+
+	// A segment of nothing but fills stays the same until it ends; grows and fades
+	// change all through theirs
+
+	virtual uint32_t MsUntilChange() override
+	{
+		if (false == GetActive())
+			return EVENT_NO_CHANGE;
+
+		uint32_t           position = TimeElapsedMs() % _cycleMs;
+		bool               inSegment = false;
+		PatternInstruction instruction;
+
+		for (uint16_t i = 0; i < _cInstructions; i++)
+		{
+			ReadPatternInstruction(i, instruction);
+			uint8_t op = instruction.op & 0xF0;
+
+			if (op == PATTERN_OP_SEGMENT || op == PATTERN_OP_END)
+			{
+				if (inSegment)
+					break;
+				uint32_t duration = instruction.DurationMs();
+				if (position < duration)
+				{
+					inSegment = true;
+					position  = duration - position;
+				}
+				else
+				{
+					position -= duration;
+				}
+				continue;
+			}
+			if (inSegment && op != PATTERN_OP_FILL)
+				return 0;
+		}
+		return position;
+	}
+
+	virtual void Draw() override
+	{
+		if (false == GetActive())
+			return;
+
+		// Find the segment we're in, then draw its instructions.  The verifier has
+		// already seen to it that the first instruction is a segment, the segments add
+		// up to _cycleMs, and every span is on the strip.
+
+		uint32_t           position = TimeElapsedMs() % _cycleMs;
+		uint32_t           duration = 0;
+		bool               inSegment = false;
+		PatternInstruction instruction;
+
+		for (uint16_t i = 0; i < _cInstructions; i++)
+		{
+			ReadPatternInstruction(i, instruction);
+			uint8_t op = instruction.op & 0xF0;
+
+			if (op == PATTERN_OP_END)
+				break;
+			if (op == PATTERN_OP_SEGMENT)
+			{
+				if (inSegment)
+					break;
+				duration = instruction.DurationMs();
+				if (position < duration)
+					inSegment = true;
+				else
+					position -= duration;
+				continue;
+			}
+			if (!inSegment)
+				continue;
+
+			uint8_t  mode  = instruction.op & 0x0F;
+			uint16_t first = instruction.First();
+			uint16_t count = instruction.Count();
+			uint32_t color = instruction.Color();
+
+			if (op == PATTERN_OP_FILL)
+			{
+				FillSpan(first, count, color);
+			}
+			else if (op == PATTERN_OP_GROW)
+			{
+				uint16_t cLit = (uint32_t) count * position / duration;
+				if (mode == PATTERN_GROW_UP)
+					FillSpan(first, cLit, color);
+				else if (mode == PATTERN_GROW_DOWN)
+					FillSpan(first + count - cLit, cLit, color);
+				else
+					FillSpan(first + (count - cLit) / 2, cLit, color);
+			}
+			else
+			{
+				uint8_t alpha = (uint32_t) 255 * position / duration;
+				FillSpan(first, count, color, BLEND_ALPHA, mode == PATTERN_FADE_IN ? alpha : 255 - alpha);
+			}
+		}
+	}
+};
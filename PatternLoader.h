@@ -0,0 +1,269 @@
+#pragma once
+#include <stdio.h>
+#include "HAL.h"
+#include "Pattern.h"
+
+// PatternLoader
+//
+// Takes a new pattern over Serial and writes it into EEPROM (see Pattern.h) while the
+// lights keep running.  Tools/pattern.py is the other end.  An upload is:
+//
+//   'B' 'P' inputs length-lo length-hi      -> PAT READY
+//   the program, 16 bytes at a time         -> PAT ACK <bytes so far>, after each
+//   crc-lo crc-hi                           -> PAT OK <instructions> <cycle ms> <inputs>
+//                                              or PAT ERR <why>
+//
+// The sender waits for each reply before sending more, so the receive buffer never
+// overflows however long a pass of the loop takes.  Bytes outside an upload go to the
+// command handler, if there is one, and an upload that goes quiet for
+// PATTERN_LOADER_TIMEOUT_MS is abandoned.
+//
+// EEPROM bytes are written one per call to Poll() at most, and only when the EEPROM
+// is ready for another, so an upload never holds up a frame.  At one byte a pass that
+// takes a while (about 30 seconds for the largest program), which is fine for
+// something done in the shop.  The old pattern's header is erased before any of the
+// new program is written and the new header goes in last, so a power cut part way
+// through leaves no pattern rather than half of one.
+
+#define PATTERN_LOADER_BLOCK      16
+#define PATTERN_LOADER_TIMEOUT_MS 2000
+
+class PatternLoader
+{
+	enum LOADER_STATE : uint8_t
+	{
+		LOADER_IDLE,
+		LOADER_MAGIC,									// Seen 'B', waiting for 'P'
+		LOADER_HEADER,
+		LOADER_PROGRAM,
+		LOADER_CRC,
+		LOADER_WRITING									// Waiting for the EEPROM; reads nothing
+	};
+
+	enum LOADER_NEXT : uint8_t							// What to do once a write finishes
+	{
+		NEXT_READY,
+		NEXT_ACK,
+		NEXT_DONE
+	};
+
+  public:
+
+	typedef void (*CommandHandler)(uint8_t command);
+
+  private:
+
+	PatternEvent * _pPattern;
+	CommandHandler _pfnCommand;
+	LOADER_STATE   _state;
+	LOADER_STATE   _stateAfterWrite;
+	LOADER_NEXT    _next;
+	uint8_t        _header[PATTERN_HEADER_BYTES];
+	uint8_t        _cHeader;							// Bytes of the upload's header so far, or of the crc
+	uint16_t       _length;
+	uint16_t       _cReceived;
+	uint16_t       _crc;
+	uint32_t       _lastByteMs;
+
+	uint8_t        _block[PATTERN_LOADER_BLOCK];		// Waiting to go into EEPROM
+	uint8_t        _cBlock;
+	uint8_t        _iBlock;
+	uint16_t       _blockAddr;
+
+	void Reply(const char * pszFormat, unsigned long a = 0, unsigned long b = 0, unsigned long c = 0)
+	{
+		char szBuf[48];
+		snprintf(szBuf, sizeof(szBuf), pszFormat, a, b, c);
+		HAL_SerialPrintln(szBuf);
+	}
+
+	void Fail(const char * pszWhy)
+	{
+		char szBuf[32];
+		snprintf(szBuf, sizeof(szBuf), "PAT ERR %s", pszWhy);
+		HAL_SerialPrintln(szBuf);
+		_state = LOADER_IDLE;
+	}
+
+	void StartWrite(uint16_t addr, const uint8_t * pData, uint8_t cb, LOADER_STATE stateAfter, LOADER_NEXT next)
+	{
+		memmove(_block, pData, cb);						// The program's blocks are already in _block
+		_blockAddr       = addr;
+		_cBlock          = cb;
+		_iBlock          = 0;
+		_stateAfterWrite = stateAfter;
+		_next            = next;
+		_state           = LOADER_WRITING;
+	}
+
+	void FinishWrite()
+	{
+		_state  = _stateAfterWrite;
+		_cBlock = 0;
+
+		if (_next == NEXT_READY)
+		{
+			HAL_SerialPrintln("PAT READY");
+		}
+		else if (_next == NEXT_ACK)
+		{
+			Reply("PAT ACK %lu", _cReceived);
+		}
+		else if (_pPattern->Load())
+		{
+			Reply("PAT OK %lu %lu %lx", _length / PATTERN_INSTRUCTION_BYTES, _pPattern->GetCycleMs(), _pPattern->GetInputs());
+		}
+		else
+		{
+			Fail("readback");
+		}
+		_lastByteMs = HAL_Millis();
+	}
+
+	void Receive(uint8_t b)
+	{
+		switch (_state)
+		{
+			case LOADER_IDLE:
+			case LOADER_MAGIC:
+				if (_state == LOADER_MAGIC && b == PATTERN_MAGIC1)
+				{
+					_state   = LOADER_HEADER;
+					_cHeader = 0;
+				}
+				else
+				{
+					_state = b == PATTERN_MAGIC0 ? LOADER_MAGIC : LOADER_IDLE;
+					if (_state == LOADER_IDLE && _pfnCommand)
+						_pfnCommand(b);
+				}
+				break;
+
+			case LOADER_HEADER:
+				_header[3 + _cHeader++] = b;			// inputs, length; the same place they go in EEPROM
+				if (_cHeader == 3)
+				{
+					_length = _header[4] | ((uint16_t) _header[5] << 8);
+					if (_header[3] == 0 || _header[3] > (INPUT_LEFT_TURN | INPUT_RIGHT_TURN | INPUT_STOP | INPUT_BACKUP))
+					{
+						Fail("inputs");
+						break;
+					}
+					if (_length < 2 * PATTERN_INSTRUCTION_BYTES || _length > PATTERN_MAX_BYTES || _length % PATTERN_INSTRUCTION_BYTES)
+					{
+						Fail(PatternErrorName(PATTERN_BAD_LENGTH));
+						break;
+					}
+
+					// From here on the EEPROM doesn't hold a pattern, so stop running it
+
+					_pPattern->Unload();
+					_cReceived = 0;
+					_crc       = 0xFFFF;
+					uint8_t erased = 0xFF;
+					StartWrite(0, &erased, 1, LOADER_PROGRAM, NEXT_READY);
+				}
+				break;
+
+			case LOADER_PROGRAM:
+				_block[_cBlock++] = b;
+				_crc = PatternCrc16(_crc, b);
+				_cReceived++;
+				if (_cBlock == PATTERN_LOADER_BLOCK || _cReceived == _length)
+				{
+					StartWrite(PATTERN_HEADER_BYTES + _cReceived - _cBlock, _block, _cBlock,
+							   _cReceived == _length ? LOADER_CRC : LOADER_PROGRAM, NEXT_ACK);
+					_cHeader = 0;
+				}
+				break;
+
+			case LOADER_CRC:
+				_header[6 + _cHeader++] = b;
+				if (_cHeader == 2)
+				{
+					uint32_t cycleMs;
+					PATTERN_ERROR error;
+
+					if ((_header[6] | ((uint16_t) _header[7] << 8)) != _crc)
+						Fail("crc");
+					else if ((error = PatternVerify(_length, &cycleMs)) != PATTERN_OK)
+						Fail(PatternErrorName(error));
+					else
+					{
+						_header[0] = PATTERN_MAGIC0;
+						_header[1] = PATTERN_MAGIC1;
+						_header[2] = PATTERN_VERSION;
+						StartWrite(0, _header, PATTERN_HEADER_BYTES, LOADER_IDLE, NEXT_DONE);
+					}
+				}
+				break;
+
+			case LOADER_WRITING:
+				break;
+		}
+	}
+
+  public:
+
+	PatternLoader(PatternEvent * pPattern)
+		: _pPattern(pPattern),
+		  _pfnCommand(nullptr),
+		  _state(LOADER_IDLE),
+		  _stateAfterWrite(LOADER_IDLE),
+		  _next(NEXT_READY),
+		  _cHeader(0),
+		  _length(0),
+		  _cReceived(0),
+		  _crc(0),
+		  _lastByteMs(0),
+		  _cBlock(0),
+		  _iBlock(0),
+		  _blockAddr(0)
+	{
+	}
+
+	void SetCommandHandler(CommandHandler pfnCommand)	// Gets every byte that isn't part of an upload
+	{
+		_pfnCommand = pfnCommand;
+	}
+
+	void SetPattern(PatternEvent * pPattern)			// For a copy of a loader that belonged to another engine
+	{
+		_pPattern = pPattern;
+	}
+
+	bool Busy()										// In the middle of an upload
+	{
+		return _state != LOADER_IDLE;
+	}
+
+	// Poll
+	//
+	// Call once a pass.  Moves an EEPROM write along by a byte if there's one under
+	// way, and otherwise takes whatever has arrived on Serial.
+
+	void Poll()
+	{
+		if (_state == LOADER_WRITING)
+		{
+			if (_iBlock < _cBlock && HAL_EepromReady())
+			{
+				HAL_EepromWriteByte(_blockAddr + _iBlock, _block[_iBlock]);
+				_iBlock++;
+			}
+			if (_iBlock == _cBlock && HAL_EepromReady())
+				FinishWrite();
+			return;
+		}
+
+		int b;
+		while (_state != LOADER_WRITING && (b = HAL_SerialRead()) >= 0)
+		{
+			Receive((uint8_t) b);
+			_lastByteMs = HAL_Millis();
+		}
+
+		if (_state > LOADER_MAGIC && _state != LOADER_WRITING && HAL_Millis() - _lastByteMs > PATTERN_LOADER_TIMEOUT_MS)
+			Fail("timeout");
+	}
+};
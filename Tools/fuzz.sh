@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# fuzz.sh
+#
+# Builds and runs the libFuzzer targets in Host/Fuzz, and keeps their seed corpora
+# small.  Each target lives in Host/Fuzz/Fuzz<Name>.cpp and its corpus in
+# Host/Fuzz/corpus/<name>; the fuzzer grows the corpus as it finds new paths.
+#
+#   fuzz.sh build                       build every target
+#   fuzz.sh run <target> [seconds]      fuzz one target (default 60s)
+#   fuzz.sh minimize [target]           cut the corpora down to inputs that add coverage
+#   fuzz.sh repro <target> <file>...    replay inputs without libFuzzer, under ASan/UBSan
+#
+# Targets: inputs, scenario, serial
+#
+# A crash leaves crash-<hash> in the current directory; fix it, then add the input to
+# the target's corpus so it stays fixed.
+#
+# Needs: clang++ with libFuzzer for build/run/minimize, g++ for repro
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+FUZZ="$ROOT/Host/Fuzz"
+TARGETS="inputs scenario serial"
+
+CXX=${CXX:-clang++}
+FLAGS="-std=gnu++11 -g -O1 -fsanitize=address,undefined -fno-sanitize-recover=undefined"
+
+source_for() {
+	case "$1" in
+		inputs)   echo "$FUZZ/FuzzInputs.cpp" ;;
+		scenario) echo "$FUZZ/FuzzScenario.cpp" ;;
+		serial)   echo "$FUZZ/FuzzSerial.cpp" ;;
+		*)        echo "unknown target '$1' (targets: $TARGETS)" >&2; exit 2 ;;
+	esac
+}
+
+build() {
+	src=$(source_for "$1")
+	$CXX $FLAGS -fsanitize=fuzzer -o "$FUZZ/fuzz_$1" "$src"
+}
+
+case "$1" in
+	build)
+		for t in $TARGETS; do
+			build "$t"
+		done
+		;;
+
+	run)
+		[ -n "$2" ] || { echo "usage: fuzz.sh run <target> [seconds]" >&2; exit 2; }
+		build "$2"
+		"$FUZZ/fuzz_$2" -max_total_time="${3:-60}" -timeout=10 "$FUZZ/corpus/$2"
+		;;
+
+	minimize)
+		for t in ${2:-$TARGETS}; do
+			build "$t"
+			fresh=$(mktemp -d)
+			"$FUZZ/fuzz_$t" -merge=1 "$fresh" "$FUZZ/corpus/$t"
+			rm -rf "$FUZZ/corpus/$t"
+			mv "$fresh" "$FUZZ/corpus/$t"
+			echo "$t: $(ls "$FUZZ/corpus/$t" | wc -l) inputs"
+		done
+		;;
+
+	repro)
+		[ -n "$3" ] || { echo "usage: fuzz.sh repro <target> <file>..." >&2; exit 2; }
+		t=$2
+		src=$(source_for "$t")
+		shift 2
+		work=$(mktemp -d)
+		trap 'rm -rf "$work"' EXIT
+		g++ $FLAGS -DFUZZ_STANDALONE -o "$work/fuzz_$t" "$src"
+		"$work/fuzz_$t" "$@"
+		;;
+
+	*)
+		sed -n '3,19p' "$0" | sed 's/^# \{0,1\}//'
+		exit 2
+		;;
+esac
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# gen_cost_model.py
+#
+# Measures what each effect costs per frame at the configured strip length and writes
+# EffectCosts.h, the constexpr cost budgets that CostModel.h checks the brake deadline
+# against at compile time.  Run it again whenever an effect, the LED output, or the
+# strip length changes; a build whose effects no longer fit then fails instead of
+# missing frames on the car.
+#
+# By default the sketch is built as real ATmega328P firmware with BENCHMARK_EFFECTS
+# (see EffectBenchmark.h) and run under simavr, and the worst frame of each effect is
+# recorded in CPU cycles.  --host builds Host/EffectBench.cpp on the virtual clock
+# instead, which charges the modelled wire time of each frame and the AVR cycles that
+# HAL_Host.h's render model counts for drawing it; use it only where simavr isn't
+# available, and the header says so.
+#
+# Needs: arduino-cli with the arduino:avr core and the sketch's libraries, avr-size,
+# and simavr; or just g++ with --host.
+#
+# Usage: Tools/gen_cost_model.py [--host] [--pixels N] [--out EffectCosts.h]
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from scaling_bench import ROOT, F_CPU, cycles, parse_rows, run_avr
+
+EFFECTS = ['backup', 'brake', 'signal', 'hazard', 'police', 'sparkle', 'all']
+
+
+def configured_pixels():
+    with open(os.path.join(ROOT, 'Config.h')) as f:
+        m = re.search(r'^#define TOTAL_STRIP_PIXELS (\d+)', f.read(), re.M)
+    return int(m.group(1))
+
+
+def run_host_model(work, pixels):
+    exe = os.path.join(work, 'effectbench_model')
+    subprocess.check_call(['g++', '-std=gnu++11', '-O2', '-DEFFECT_BENCH_MODELLED',
+                           '-DTOTAL_STRIP_PIXELS=%d' % pixels,
+                           '-o', exe, os.path.join(ROOT, 'Host', 'EffectBench.cpp')])
+    return parse_rows(subprocess.check_output([exe]).decode())
+
+
+def write_header(path, pixels, source, rows, modelled):
+    lines = [
+        '#pragma once',
+        '#include <stdint.h>',
+        '',
+        '// EffectCosts',
+        '//',
+        '// Generated by Tools/gen_cost_model.py; don\'t edit it by hand, run that again.',
+        '// Worst cycles per frame (render plus show) that EffectBenchmark.h measured for',
+        '// each effect alone, and for all of them stacked, at EFFECT_COSTS_PIXELS pixels,',
+        '// and the cycles that showing a frame costs whatever is in it.',
+        '//',
+        '// Source: %s' % source,
+    ] + ([
+        '//',
+        '// These should be measured under simavr; they were generated with --host because',
+        '// it wasn\'t available.  The show cost is the WS2812 wire time and the render is',
+        '// HAL_Host.h\'s count of AVR cycles for the frame buffer work, so the effects\' own',
+        '// arithmetic isn\'t in them.  Run this again without --host to replace them.',
+    ] if modelled else []) + [
+        '',
+        '#define EFFECT_COSTS_PIXELS %d' % pixels,
+        '#define EFFECT_COSTS_F_CPU  %dUL' % F_CPU,
+        '',
+        'constexpr uint32_t EFFECT_COSTS_SHOW_CYCLES = %d;' % min(cycles(rows[e]['show_ns']) for e in EFFECTS),
+        '',
+    ]
+    width = max(len(e) for e in EFFECTS)
+    for effect in EFFECTS:
+        lines.append('constexpr uint32_t EFFECT_COST_%s_CYCLES%s = %d;'
+                     % (effect.upper(), ' ' * (width - len(effect)), cycles(rows[effect]['worst_ns'])))
+
+    with open(path, 'w', newline='\r\n') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate EffectCosts.h from measured effect costs')
+    parser.add_argument('--host', action='store_true', help='use the host\'s modelled wire time instead of simavr')
+    parser.add_argument('--pixels', type=int, default=None, help='strip length (default: TOTAL_STRIP_PIXELS in Config.h)')
+    parser.add_argument('--out', default=os.path.join(ROOT, 'EffectCosts.h'), help='header to write')
+    args = parser.parse_args()
+
+    pixels = args.pixels or configured_pixels()
+    if not args.host:
+        missing = [tool for tool in ('arduino-cli', 'avr-size', 'simavr') if shutil.which(tool) is None]
+        if missing:
+            sys.exit('missing %s (or use --host)' % ', '.join(missing))
+
+    work = tempfile.mkdtemp()
+    try:
+        if args.host:
+            rows   = run_host_model(work, pixels)
+            source = 'host model (modelled wire time and render cycles, not measured on the board)'
+        else:
+            rows, _ = run_avr(work, pixels)
+            source  = 'ATmega328P @ %dMHz under simavr' % (F_CPU // 1000000)
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    missing = [e for e in EFFECTS if e not in rows]
+    if missing:
+        sys.exit('no measurement for %s (out of RAM at %d pixels?)' % (', '.join(missing), pixels))
+
+    write_header(args.out, pixels, source, rows, args.host)
+    for effect in EFFECTS:
+        print('%-8s %10d cycles' % (effect, cycles(rows[effect]['worst_ns'])))
+    print('wrote %s' % args.out)
+
+
+if __name__ == '__main__':
+    main()
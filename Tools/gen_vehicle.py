@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+#
+# gen_vehicle.py
+#
+# Turns a vehicle profile (Vehicles/*.profile) into VehicleProfile.h, which Config.h
+# includes ahead of its own defaults.  Every build after that, firmware or host, is
+# specialized for that vehicle at compile time: strip geometry, pins, effect timings,
+# the police bar's sections and pattern, with nothing left to configure at run time.
+#
+# The profile is checked here first, so that a typo is reported against the line of
+# the profile it's on rather than as a static_assert somewhere in the headers; the
+# headers check again regardless.
+#
+# A profile is "key = value" lines; # starts a comment.  See Vehicles/default.profile,
+# which generates exactly the built-in defaults.
+#
+# Usage: Tools/gen_vehicle.py Vehicles/name.profile [--out VehicleProfile.h]
+#        Tools/gen_vehicle.py --clear             (back to the defaults)
+
+import argparse
+import os
+import re
+import sys
+
+ROOT            = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+POLICE_SECTIONS = 8
+
+TIMINGS = {
+    'backup_timing': ('VEHICLE_BACKUP_TIMING', ['bloom'], ['bloom_curve']),
+    'brake_timing':  ('VEHICLE_BRAKE_TIMING',  ['strobe', 'bloom_start_permille', 'bloom', 'strobe_on', 'strobe_off', 'dim_alpha'], ['bloom_curve']),
+    'signal_timing': ('VEHICLE_SIGNAL_TIMING', ['bloom', 'hold', 'fade', 'off'], ['bloom_curve', 'fade_curve']),
+}
+
+# The easing curves a bloom or fade can take (Easing.h); linear if it doesn't say
+
+CURVES = {'linear': 'EASE_LINEAR', 'ease_out_cubic': 'EASE_OUT_CUBIC', 'ease_in_out': 'EASE_IN_OUT', 'ease_out_expo': 'EASE_OUT_EXPO'}
+
+PINS = [('left_turn_pin', 'LEFT_TURN_PIN'), ('right_turn_pin', 'RIGHT_TURN_PIN'),
+        ('stop_pin', 'STOP_PIN'), ('backup_pin', 'BACKUP_PIN')]
+
+
+class ProfileError(Exception):
+    pass
+
+
+def config_colors():
+    with open(os.path.join(ROOT, 'Config.h')) as f:
+        return {m.group(1).lower(): 'COLOR_' + m.group(1)
+                for m in re.finditer(r'^#define COLOR_(\w+)\s', f.read(), re.M)}
+
+
+def number(text, line, what, low=0, high=0xFFFFFFFF):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise ProfileError('line %d: %s: expected a number, got "%s"' % (line, what, text))
+    if not low <= value <= high:
+        raise ProfileError('line %d: %s must be %d..%d' % (line, what, low, high))
+    return value
+
+
+def color(text, line, colors):
+    if re.match(r'^#[0-9a-fA-F]{6}$', text):
+        return 'PACK_RGB(0x%s, 0x%s, 0x%s)' % (text[1:3], text[3:5], text[5:7])
+    if text.lower() in colors:
+        return colors[text.lower()]
+    raise ProfileError('line %d: unknown color "%s" (one of %s, or #RRGGBB)' % (line, text, ', '.join(sorted(colors))))
+
+
+def parse(path):
+    colors  = config_colors()
+    profile = {'police_rows': []}
+    lines   = {}
+
+    with open(path) as f:
+        for line, text in enumerate(f, 1):
+            text = text.split('#', 1)[0].strip()
+            if not text:
+                continue
+            if '=' not in text:
+                raise ProfileError('line %d: expected key = value' % line)
+            key, value = [part.strip() for part in text.split('=', 1)]
+            fields = value.split()
+
+            if key == 'police_row':
+                if len(fields) != POLICE_SECTIONS + 1:
+                    raise ProfileError('line %d: police_row is a duration and %d colors' % (line, POLICE_SECTIONS))
+                duration = number(fields[0], line, 'police_row duration', 1)
+                profile['police_rows'].append((duration, [color(c, line, colors) for c in fields[1:]]))
+                continue
+
+            if key in profile:
+                raise ProfileError('line %d: %s is already set on line %d' % (line, key, lines[key]))
+            lines[key] = line
+
+            if key == 'name':
+                if not re.match(r'^[\w-]+$', value):
+                    raise ProfileError('line %d: name is letters, digits, - and _' % line)
+                profile[key] = value
+            elif key in ('strip_pixels', 'used_pixels', 'turn_pixels', 'led_pin') or key in dict(PINS):
+                profile[key] = number(value, line, key)
+            elif key in TIMINGS:
+                _, names, curves = TIMINGS[key]
+                values = dict(zip(fields[0::2], fields[1::2]))
+                if (len(fields) != 2 * len(values) or any(n not in values for n in names)
+                        or any(n not in names + curves for n in values)):
+                    raise ProfileError('line %d: %s needs %s, and can have %s' % (line, key, ' '.join(n + ' <n>' for n in names),
+                                                                               ' '.join(c + ' <curve>' for c in curves)))
+                for c in curves:
+                    if values.get(c, 'linear') not in CURVES:
+                        raise ProfileError('line %d: %s %s must be one of %s' % (line, key, c, ', '.join(sorted(CURVES))))
+                profile[key] = ([number(values[n], line, '%s %s' % (key, n), 0, 255 if n == 'dim_alpha' else 0xFFFFFFFF)
+                                 for n in names] + [CURVES[values.get(c, 'linear')] for c in curves])
+            elif key == 'police_sections':
+                if len(fields) != POLICE_SECTIONS + 1:
+                    raise ProfileError('line %d: police_sections is the %d section starts and the end' % (line, POLICE_SECTIONS))
+                profile[key] = [number(s, line, 'police_sections', 0, 0xFFFF) for s in fields]
+            else:
+                raise ProfileError('line %d: unknown key "%s"' % (line, key))
+
+    for key in ['name', 'strip_pixels', 'led_pin'] + [p for p, _ in PINS]:
+        if key not in profile:
+            raise ProfileError('%s is required' % key)
+    return profile, lines
+
+
+def check(profile, lines):
+    strip = profile['strip_pixels']
+    used  = profile.setdefault('used_pixels', strip)
+    turn  = profile.setdefault('turn_pixels', used * 50 // 144)
+
+    if not 1 <= used <= strip:
+        line = lines.get('used_pixels', lines.get('strip_pixels', 1))
+        raise ProfileError('line %d: used_pixels must be 1..strip_pixels' % line)
+    if not 1 <= turn or 2 * turn > used:
+        raise ProfileError('turn_pixels must be at least 1 and the two turn zones must fit in used_pixels without overlapping')
+
+    pins = [profile[p] for p, _ in PINS]
+    for key, _ in PINS:
+        if not 2 <= profile[key] <= 7:
+            raise ProfileError('line %d: %s must be on PORTD, pins 2-7 (0 and 1 are the serial port)' % (lines[key], key))
+    if len(set(pins)) != len(pins) or profile['led_pin'] in pins:
+        raise ProfileError('every pin must be different')
+
+    backup = profile.get('backup_timing')
+    if backup and backup[0] == 0:
+        raise ProfileError('line %d: backup bloom must be non-zero' % lines['backup_timing'])
+    brake = profile.get('brake_timing')
+    if brake and (brake[1] > 1000 or (brake[0] and (brake[2] == 0 or brake[3] + brake[4] == 0))):
+        raise ProfileError('line %d: brake needs a non-zero bloom and strobe cycle, and bloom_start_permille <= 1000' % lines['brake_timing'])
+    signal = profile.get('signal_timing')
+    if signal and (signal[0] == 0 or sum(signal[:4]) > 0xFFFFFFFF):
+        raise ProfileError('line %d: signal bloom must be non-zero' % lines['signal_timing'])
+
+    sections = profile.get('police_sections')
+    if sections:
+        if sections[0] != 0 or sections[-1] != used:
+            raise ProfileError('line %d: police_sections must start at 0 and end at used_pixels (%d)' % (lines['police_sections'], used))
+        if any(a >= b for a, b in zip(sections, sections[1:])):
+            raise ProfileError('line %d: police_sections must go up, at least a pixel apart' % lines['police_sections'])
+    elif used < POLICE_SECTIONS:
+        raise ProfileError('the police bar needs at least %d used pixels' % POLICE_SECTIONS)
+
+
+def write_header(path, source, profile):
+    out = [
+        '#pragma once',
+        '',
+        '// VehicleProfile',
+        '//',
+        '// Generated by Tools/gen_vehicle.py from %s; don\'t edit it by hand.' % source,
+        '// Config.h and LightingEvents.h use these in place of their defaults.',
+        '',
+        '#define VEHICLE_NAME "%s"' % profile['name'],
+        '',
+        '#define TOTAL_STRIP_PIXELS %d' % profile['strip_pixels'],
+        '#define NUMBER_USED_PIXELS %d' % profile['used_pixels'],
+        '#define NUMBER_TURN_PIXELS %d' % profile['turn_pixels'],
+        '',
+        '#define PIN            %d' % profile['led_pin'],
+    ]
+    out += ['#define %-14s %d' % (name, profile[key]) for key, name in PINS]
+
+    timings = [(TIMINGS[key][0], profile[key]) for key in ('backup_timing', 'brake_timing', 'signal_timing') if key in profile]
+    if timings:
+        out.append('')
+        out += ['#define %-21s { %s }' % (name, ', '.join(map(str, values))) for name, values in timings]
+
+    if 'police_sections' in profile:
+        out += ['', '#define VEHICLE_POLICE_SECTION_STARTS { %s }' % ', '.join(map(str, profile['police_sections']))]
+
+    rows = profile['police_rows']
+    if rows:
+        width = max(len(c) for _, colors in rows for c in colors)
+        out += ['', '#define VEHICLE_POLICE_STATES \\']
+        for i, (duration, colors) in enumerate(rows):
+            cells = ' '.join((c + ',').ljust(width + 1) for c in colors[:-1]) + ' ' + colors[-1].ljust(width)
+            out.append('\t{ { %s }, %3d }%s' % (cells, duration, ', \\' if i < len(rows) - 1 else ''))
+
+    with open(path, 'w', newline='\r\n') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate VehicleProfile.h from a vehicle profile')
+    parser.add_argument('profile', nargs='?', help='the .profile file')
+    parser.add_argument('--out', default=os.path.join(ROOT, 'VehicleProfile.h'), help='header to write')
+    parser.add_argument('--clear', action='store_true', help='remove the generated header')
+    args = parser.parse_args()
+
+    if args.clear:
+        if os.path.exists(args.out):
+            os.remove(args.out)
+            print('removed %s' % args.out)
+        return
+    if not args.profile:
+        parser.error('a profile is required')
+
+    try:
+        profile, lines = parse(args.profile)
+        check(profile, lines)
+    except (ProfileError, OSError) as e:
+        sys.exit('%s: %s' % (args.profile, e))
+
+    source = os.path.relpath(os.path.abspath(args.profile), ROOT).replace(os.sep, '/')
+    write_header(args.out, source, profile)
+    print('wrote %s for %s: %d pixels, %d turn, %s' % (args.out, profile['name'], profile['used_pixels'], profile['turn_pixels'],
+          '%d police rows' % len(profile['police_rows']) if profile['police_rows'] else 'default police pattern'))
+
+
+if __name__ == '__main__':
+    main()
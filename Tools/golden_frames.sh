@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# golden_frames.sh
+#
+# Proves the host build renders exactly what the firmware does.  Builds the golden
+# frame driver (GoldenFrames.h) twice, once for the host and once as the real AVR
+# firmware, runs the firmware under simavr, and diffs the two lists of frame hashes.
+# Exits non-zero if they differ in any frame.
+#
+# Needs: g++, arduino-cli with the arduino:avr core and the sketch's libraries, simavr
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Host
+
+g++ -std=gnu++11 -O2 -o "$WORK/goldenframes" "$ROOT/Host/GoldenFrames.cpp"
+"$WORK/goldenframes" | grep '^G ' > "$WORK/host.txt"
+
+# AVR, under simavr.  arduino-cli wants the sketch folder named after the .ino
+
+ln -s "$ROOT" "$WORK/BrakeLights"
+arduino-cli compile -b arduino:avr:uno \
+	--build-property "compiler.cpp.extra_flags=-DGOLDEN_FRAMES" \
+	--output-dir "$WORK/avr" "$WORK/BrakeLights"
+
+simavr -m atmega328p -f 16000000 "$WORK/avr/BrakeLights.ino.elf" 2>&1 \
+	| sed 's/\x1b\[[0-9;]*m//g' | grep '^G ' > "$WORK/avr.txt"
+
+if diff "$WORK/host.txt" "$WORK/avr.txt"; then
+	echo "golden frames match: $(tail -1 "$WORK/host.txt")"
+else
+	echo "golden frames DIFFER between host and AVR" >&2
+	exit 1
+fi
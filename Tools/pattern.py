@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+# pattern.py
+#
+# Assembles lighting patterns for the EEPROM pattern player (Pattern.h) and uploads
+# them over Serial (PatternLoader.h), so a new effect can go on the car without
+# reflashing it.
+#
+# A pattern source is one instruction per line; # starts a comment (other than a
+# #RRGGBB color):
+#
+#   segment 400ms                          a section of the animation; they loop
+#   fill  <first> <count> <color>          light a span for the whole segment
+#   grow  <first> <count> <color> up|down|center
+#   fade  <first> <count> <color> in|out
+#
+# Colors are the COLOR_ names from Config.h (red, amber, ...) or #RRGGBB.  Drawing
+# lines belong to the segment above them.  See Patterns/ for examples.
+#
+# Usage: Tools/pattern.py assemble Patterns/name.pat [--out name.bin]
+#        Tools/pattern.py frame Patterns/name.pat --inputs LEFT+RIGHT [--out name.frame]
+#        Tools/pattern.py upload Patterns/name.pat --inputs LEFT+RIGHT --port /dev/ttyACM0
+#
+# 'frame' writes exactly the bytes an upload sends, for the host fuzzer's corpus or
+# for sending by other means.  The board checks everything again before it takes a
+# pattern; the checks here are so that mistakes are reported against the line.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+ROOT          = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+EEPROM_SIZE   = 1024
+HEADER_BYTES  = 8
+MAX_BYTES     = EEPROM_SIZE - HEADER_BYTES
+BLOCK         = 16
+MAX_SEGMENT   = 0xFFFF
+
+OP_END, OP_SEGMENT, OP_FILL, OP_GROW, OP_FADE = 0x00, 0x10, 0x20, 0x30, 0x40
+MODES  = {'grow': {'up': 0, 'down': 1, 'center': 2}, 'fade': {'in': 0, 'out': 1}}
+OPS    = {'fill': OP_FILL, 'grow': OP_GROW, 'fade': OP_FADE}
+INPUTS = {'LEFT': 0x01, 'RIGHT': 0x02, 'STOP': 0x04, 'BACKUP': 0x08}
+
+
+class PatternError(Exception):
+    pass
+
+
+def config_colors():
+    with open(os.path.join(ROOT, 'Config.h')) as f:
+        return {m.group(1).lower(): tuple(int(v) for v in m.group(2, 3, 4))
+                for m in re.finditer(r'^#define COLOR_(\w+)\s+\(PACK_RGB\(\s*(\d+),\s*(\d+),\s*(\d+)\)\)', f.read(), re.M)}
+
+
+def number(text, line, what, low=0, high=0xFFFF):
+    try:
+        value = int(text, 0)
+    except ValueError:
+        raise PatternError('line %d: %s: expected a number, got "%s"' % (line, what, text))
+    if not low <= value <= high:
+        raise PatternError('line %d: %s must be %d..%d' % (line, what, low, high))
+    return value
+
+
+def color(text, line, colors):
+    if re.match(r'^#[0-9a-fA-F]{6}$', text):
+        return tuple(int(text[i:i + 2], 16) for i in (1, 3, 5))
+    if text.lower() in colors:
+        return colors[text.lower()]
+    raise PatternError('line %d: unknown color "%s" (one of %s, or #RRGGBB)' % (line, text, ', '.join(sorted(colors))))
+
+
+def instruction(op, a, b, rgb=(0, 0, 0)):
+    return struct.pack('<BHHBBB', op, a, b, *rgb)
+
+
+def assemble(path, pixels):
+    colors  = config_colors()
+    program = b''
+    segment = False
+
+    with open(path) as f:
+        for line, text in enumerate(f, 1):
+            fields = re.sub(r'(^|\s)#(?![0-9a-fA-F]{6}\b).*', '', text).split()
+            if not fields:
+                continue
+            word = fields[0].lower()
+
+            if word == 'segment':
+                m = re.match(r'^(\d+)ms$', fields[1]) if len(fields) == 2 else None
+                if not m or not 1 <= int(m.group(1)) <= MAX_SEGMENT:
+                    raise PatternError('line %d: segment takes a duration like 250ms, up to %dms' % (line, MAX_SEGMENT))
+                ms = int(m.group(1))
+                program += instruction(OP_SEGMENT, ms & 0xFFFF, ms >> 16)
+                segment = True
+            elif word in OPS:
+                need = 5 if word in MODES else 4
+                if len(fields) != need:
+                    raise PatternError('line %d: %s takes first, count, color%s' %
+                                       (line, word, ', ' + '|'.join(MODES[word]) if word in MODES else ''))
+                if not segment:
+                    raise PatternError('line %d: %s before the first segment' % (line, word))
+                first = number(fields[1], line, 'first', 0, pixels - 1)
+                count = number(fields[2], line, 'count', 1, pixels - first)
+                mode  = 0
+                if word in MODES:
+                    if fields[4].lower() not in MODES[word]:
+                        raise PatternError('line %d: %s is %s' % (line, word, ' or '.join(MODES[word])))
+                    mode = MODES[word][fields[4].lower()]
+                program += instruction(OPS[word] + mode, first, count, color(fields[3], line, colors))
+            else:
+                raise PatternError('line %d: unknown instruction "%s"' % (line, fields[0]))
+
+    if not segment:
+        raise PatternError('a pattern needs at least one segment')
+    program += instruction(OP_END, 0, 0)
+    if len(program) > MAX_BYTES:
+        raise PatternError('%d bytes is more than the %d the EEPROM holds' % (len(program), MAX_BYTES))
+    return program
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def parse_inputs(text):
+    value = 0
+    for name in text.upper().split('+'):
+        if name not in INPUTS:
+            raise PatternError('unknown input "%s" (one of %s, joined with +)' % (name, ', '.join(INPUTS)))
+        value |= INPUTS[name]
+    return value
+
+
+def frame(program, inputs):
+    return (b'BP' + struct.pack('<BH', inputs, len(program)), program, struct.pack('<H', crc16(program)))
+
+
+def upload(port, program, inputs):
+    import serial
+
+    start, body, crc = frame(program, inputs)
+    with serial.Serial(port, 115200, timeout=5) as s:
+
+        def expect(prefix):
+            while True:
+                reply = s.readline().decode('ascii', 'replace').strip()
+                if not reply:
+                    raise PatternError('no reply from the board (waiting for %s)' % prefix)
+                if reply.startswith('PAT ERR'):
+                    raise PatternError('the board says: ' + reply)
+                if reply.startswith(prefix):
+                    return reply
+
+        s.write(start)
+        expect('PAT READY')
+        for i in range(0, len(body), BLOCK):
+            s.write(body[i:i + BLOCK])
+            expect('PAT ACK')
+            print('\r%d/%d bytes' % (min(i + BLOCK, len(body)), len(body)), end='', file=sys.stderr)
+        print(file=sys.stderr)
+        s.write(crc)
+        print(expect('PAT OK'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Assemble and upload EEPROM lighting patterns')
+    parser.add_argument('command', choices=['assemble', 'frame', 'upload'])
+    parser.add_argument('source', help='the .pat file')
+    parser.add_argument('--inputs', help='switches that select it, e.g. LEFT+RIGHT or BACKUP')
+    parser.add_argument('--pixels', type=int, default=144, help='NUMBER_USED_PIXELS on the car (default 144)')
+    parser.add_argument('--port', help='serial port, for upload')
+    parser.add_argument('--out', help='file to write, for assemble and frame')
+    args = parser.parse_args()
+
+    try:
+        program = assemble(args.source, args.pixels)
+        if args.command == 'assemble':
+            out = args.out or os.path.splitext(args.source)[0] + '.bin'
+            with open(out, 'wb') as f:
+                f.write(program)
+            print('%s: %d instructions, crc %04x' % (out, len(program) // 8, crc16(program)))
+            return 0
+
+        if not args.inputs:
+            raise PatternError('--inputs is required')
+        inputs = parse_inputs(args.inputs)
+
+        if args.command == 'frame':
+            out = args.out or os.path.splitext(args.source)[0] + '.frame'
+            with open(out, 'wb') as f:
+                f.write(b''.join(frame(program, inputs)))
+            print('%s: %d bytes' % (out, len(program) + 7))
+        else:
+            if not args.port:
+                raise PatternError('--port is required')
+            upload(args.port, program, inputs)
+    except PatternError as e:
+        print('%s: %s' % (args.source, e), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
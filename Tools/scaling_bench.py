@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+#
+# scaling_bench.py
+#
+# Builds and runs the effect benchmark (EffectBenchmark.h) at several strip lengths,
+# on the host and as real ATmega328P firmware under simavr.  The results are printed
+# as a table, written to scaling.csv, and plotted to scaling.png if matplotlib is
+# installed.  The table shows where each part of the frame stops scaling on the 328P:
+#
+#   render   cycles to clear the frame and draw the effect
+#   show     cycles to clock the frame out to the strip
+#   fps      what render + show allows, against the engine's frame budget
+#   sram     static RAM from avr-size, and what's left once the frame buffer exists
+#
+# Strip lengths that don't leave room for the frame buffer show up as "no RAM".
+#
+# Needs: g++; for the AVR half, arduino-cli with the arduino:avr core and the
+# sketch's libraries, avr-size, and simavr.  --host-only skips the AVR half.
+#
+# Usage: Tools/scaling_bench.py [--host-only] [--lengths 30,60,144,300,600] [--out DIR]
+
+import argparse
+import csv
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT        = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+F_CPU       = 16000000
+SRAM_BYTES  = 2048
+BUDGET_FPS  = 1000000 // 30000          # FRAME_BUDGET_US in Config.h
+LENGTHS     = [30, 60, 144, 300, 600]
+ANSI        = re.compile(r'\x1b\[[0-9;]*m')
+
+
+def parse_rows(text):
+    rows = {}
+    for line in ANSI.sub('', text).splitlines():
+        fields = line.strip().split(',')
+        if len(fields) >= 7 and fields[0] == 'E' and fields[1] != 'effect':
+            rows[fields[1]] = {
+                'render_ns': int(fields[3]),
+                'show_ns':   int(fields[4]),
+                'fps':       int(fields[5]),
+                'free':      int(fields[6]),
+                'worst_ns':  int(fields[7]) if len(fields) > 7 else int(fields[3]) + int(fields[4]),
+            }
+    return rows
+
+
+def run_host(work, pixels):
+    exe = os.path.join(work, 'effectbench_%d' % pixels)
+    subprocess.check_call(['g++', '-std=gnu++11', '-O2', '-DTOTAL_STRIP_PIXELS=%d' % pixels,
+                           '-o', exe, os.path.join(ROOT, 'Host', 'EffectBench.cpp')])
+    return parse_rows(subprocess.check_output([exe]).decode())
+
+
+def run_avr(work, pixels):
+    # arduino-cli wants the sketch folder named after the .ino
+    sketch = os.path.join(work, 'BrakeLights')
+    if not os.path.exists(sketch):
+        os.symlink(ROOT, sketch)
+
+    out = os.path.join(work, 'avr_%d' % pixels)
+    flags = '-DBENCHMARK_EFFECTS -DTOTAL_STRIP_PIXELS=%d' % pixels
+    subprocess.check_call(['arduino-cli', 'compile', '-b', 'arduino:avr:uno',
+                           '--build-property', 'compiler.cpp.extra_flags=' + flags,
+                           '--output-dir', out, sketch], stdout=subprocess.DEVNULL)
+    elf = os.path.join(out, 'BrakeLights.ino.elf')
+
+    size = subprocess.check_output(['avr-size', '-A', elf]).decode()
+    static = sum(int(m.group(2)) for m in re.finditer(r'^\.(data|bss)\s+(\d+)', size, re.M))
+
+    try:
+        text = subprocess.run(['simavr', '-m', 'atmega328p', '-f', str(F_CPU), elf],
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=120).stdout.decode()
+    except subprocess.TimeoutExpired as e:
+        text = (e.stdout or b'').decode()
+
+    rows = parse_rows(text)
+    for row in rows.values():
+        row['static'] = static
+    return rows, static
+
+
+def cycles(ns):
+    return ns * (F_CPU // 1000000) // 1000
+
+
+def print_table(results):
+    effects = []
+    for per_length in results.values():
+        for rows in per_length.values():
+            for effect in rows:
+                if effect not in effects:
+                    effects.append(effect)
+
+    for platform in ('host', 'avr'):
+        if not any(platform in per_length for per_length in results.values()):
+            continue
+        print()
+        print('%s' % ('Host (ns/frame, this machine)' if platform == 'host' else 'ATmega328P @ 16MHz under simavr'))
+        if platform == 'host':
+            print('%-8s %6s %10s %10s %12s' % ('effect', 'pixels', 'render ns', 'show ns', 'fps'))
+        else:
+            print('%-8s %6s %12s %12s %7s %7s %7s  %s' % ('effect', 'pixels', 'render cyc', 'show cyc', 'fps', 'static', 'free', ''))
+
+        for effect in effects:
+            for pixels in sorted(results):
+                per_platform = results[pixels].get(platform)
+                if per_platform is None:
+                    continue
+                row = per_platform.get(effect)
+                if platform == 'host':
+                    if row:
+                        print('%-8s %6d %10d %10d %12d' % (effect, pixels, row['render_ns'], row['show_ns'], row['fps']))
+                    continue
+                if row is None:
+                    print('%-8s %6d %12s %12s %7s %7s %7s  no RAM' % (effect, pixels, '-', '-', '-', results[pixels].get('static', '-'), '-'))
+                    continue
+                note = 'over budget' if row['fps'] < BUDGET_FPS else ''
+                print('%-8s %6d %12d %12d %7d %7d %7d  %s' % (effect, pixels, cycles(row['render_ns']), cycles(row['show_ns']),
+                                                            row['fps'], row['static'], row['free'], note))
+
+
+def write_csv(path, results):
+    with open(path, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(['platform', 'effect', 'pixels', 'render_ns', 'render_cycles', 'show_ns', 'show_cycles', 'fps', 'static_bytes', 'free_bytes'])
+        for pixels in sorted(results):
+            for platform in ('host', 'avr'):
+                for effect, row in results[pixels].get(platform, {}).items():
+                    avr = platform == 'avr'
+                    writer.writerow([platform, effect, pixels,
+                                     row['render_ns'], cycles(row['render_ns']) if avr else '',
+                                     row['show_ns'], cycles(row['show_ns']) if avr else '',
+                                     row['fps'], row.get('static', ''), row['free'] if avr else ''])
+
+
+def plot(path, results):
+    try:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print('matplotlib not installed; skipping %s' % path)
+        return
+
+    platform = 'avr' if any('avr' in r for r in results.values()) else 'host'
+    lengths = sorted(results)
+    effects = sorted({e for r in results.values() for e in r.get(platform, {})})
+
+    fig, axes = plt.subplots(2, 2, figsize=(12, 9))
+    fig.suptitle('Effect cost vs strip length (%s)' % ('ATmega328P under simavr' if platform == 'avr' else 'host'))
+
+    for effect in effects:
+        xs = [n for n in lengths if effect in results[n].get(platform, {})]
+        rows = [results[n][platform][effect] for n in xs]
+        axes[0][0].plot(xs, [r['render_ns'] / 1000.0 for r in rows], marker='o', label=effect)
+        axes[0][1].plot(xs, [r['show_ns'] / 1000.0 for r in rows], marker='o', label=effect)
+        axes[1][0].plot(xs, [r['fps'] for r in rows], marker='o', label=effect)
+
+    axes[0][0].set_title('render (us/frame)')
+    axes[0][1].set_title('show (us/frame)')
+    axes[1][0].set_title('achievable fps')
+    axes[1][0].axhline(BUDGET_FPS, color='red', linestyle='--', label='frame budget')
+    axes[1][0].set_yscale('log')
+
+    if platform == 'avr':
+        xs = [n for n in lengths if 'static' in results[n]]
+        axes[1][1].plot(xs, [results[n]['static'] for n in xs], marker='o', label='static (.data + .bss)')
+        axes[1][1].plot(xs, [results[n]['static'] + n * 3 for n in xs], marker='o', label='static + frame buffer')
+        axes[1][1].axhline(SRAM_BYTES, color='red', linestyle='--', label='328P SRAM')
+        axes[1][1].set_title('SRAM (bytes)')
+        axes[1][1].legend()
+    else:
+        axes[1][1].axis('off')
+
+    for ax in (axes[0][0], axes[0][1], axes[1][0]):
+        ax.set_xlabel('pixels')
+        ax.grid(True, alpha=0.3)
+        ax.legend(fontsize='small')
+    axes[1][1].set_xlabel('pixels')
+
+    fig.tight_layout()
+    fig.savefig(path)
+    print('wrote %s' % path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Strip-length scaling benchmark')
+    parser.add_argument('--host-only', action='store_true', help='skip the simavr runs')
+    parser.add_argument('--lengths', default=','.join(map(str, LENGTHS)), help='comma separated strip lengths')
+    parser.add_argument('--out', default='.', help='directory for scaling.csv and scaling.png')
+    args = parser.parse_args()
+
+    lengths = [int(n) for n in args.lengths.split(',')]
+    avr = not args.host_only
+    if avr:
+        missing = [tool for tool in ('arduino-cli', 'avr-size', 'simavr') if shutil.which(tool) is None]
+        if missing:
+            sys.exit('missing %s (or use --host-only)' % ', '.join(missing))
+
+    results = {}
+    work = tempfile.mkdtemp()
+    try:
+        for pixels in lengths:
+            results[pixels] = {'host': run_host(work, pixels)}
+            if avr:
+                results[pixels]['avr'], results[pixels]['static'] = run_avr(work, pixels)
+            print('%d pixels done' % pixels, file=sys.stderr)
+    finally:
+        shutil.rmtree(work, ignore_errors=True)
+
+    print_table(results)
+    write_csv(os.path.join(args.out, 'scaling.csv'), results)
+    plot(os.path.join(args.out, 'scaling.png'), results)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,35 @@
+# The original build: a 144 pixel strip across the tailgate of a pickup, wired the
+# way Config.h describes.  Generating from this gives exactly the defaults.
+
+name            = default
+
+strip_pixels    = 144
+used_pixels     = 144
+turn_pixels     = 50
+
+led_pin         = 6
+left_turn_pin   = 3
+right_turn_pin  = 2
+stop_pin        = 4
+backup_pin      = 5
+
+# Times in ms.  Any bloom or fade can also take a curve, as "bloom_curve ease_out_cubic"
+# on its line: linear (the default), ease_out_cubic, ease_in_out, or ease_out_expo.
+
+backup_timing   = bloom 250
+brake_timing    = strobe 500  bloom_start_permille 100  bloom 500  strobe_on 30  strobe_off 20  dim_alpha 64
+signal_timing   = bloom 500  hold 250  fade 125  off 250
+
+# police_sections = 0 18 36 54 72 90 108 126 144     (evenly spread if left out)
+
+police_row      = 200  blue  blue  red   red   blue  blue  red   red
+police_row      = 200  red   red   blue  blue  red   red   blue  blue
+police_row      =  20  white blue  red   red   blue  blue  red   red
+police_row      =  20  blue  blue  red   red   blue  blue  red   white
+police_row      =  20  blue  white red   red   blue  blue  red   red
+police_row      =  20  blue  blue  red   red   blue  blue  white red
+police_row      =  20  blue  blue  white red   blue  blue  red   red
+police_row      =  20  blue  blue  red   red   blue  white red   red
+police_row      =  20  blue  blue  red   white blue  blue  red   red
+police_row      =  20  blue  blue  red   red   white blue  red   red
+police_row      = 200  red   red   blue  blue  red   red   blue  blue
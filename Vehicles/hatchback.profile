@@ -0,0 +1,26 @@
+# A hatchback with a 60 pixel strip under the rear window.  The glass is split by a
+# wiper mount at pixel 28, so the police bar's sections are laid out around it, and
+# the signals sweep faster over the shorter strip, easing out as they reach the end.
+
+name            = hatchback
+
+strip_pixels    = 60
+used_pixels     = 60
+turn_pixels     = 18
+
+led_pin         = 6
+left_turn_pin   = 3
+right_turn_pin  = 2
+stop_pin        = 4
+backup_pin      = 5
+
+backup_timing   = bloom 150
+brake_timing    = strobe 400  bloom_start_permille 200  bloom 300  strobe_on 30  strobe_off 20  dim_alpha 64
+signal_timing   = bloom 300  hold 300  fade 100  off 300  bloom_curve ease_out_cubic
+
+police_sections = 0 7 14 21 28 32 39 46 60
+
+police_row      = 250  blue  blue  blue  blue  red   red   red   red
+police_row      = 250  red   red   red   red   blue  blue  blue  blue
+police_row      =  40  white black white black white black white black
+police_row      =  40  black white black white black white black white